@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "allocator.h"
+#include "garbage_collector.h"
+#include "bench_harness.h"
+
+// Microbenchmarks comparing the Allocator against glibc malloc.
+// Every workload is run once per implementation with the same sizes, orders and seeds.
+//
+// Usage: allocator_bench [--format=csv|json] [--out=file] [--filter=regex] [--repetitions=n]
+//
+// The Allocator is a process-wide singleton, so later benchmarks run on a heap shaped by the
+// earlier ones. Use --filter to run a single benchmark on a fresh heap.
+//
+// Both allocators grow through sbrk and the Allocator's heap must stay contiguous, so HEAP_RESERVE
+// bytes are reserved up front, before glibc gets a chance to move the program break.
+
+static const std::size_t OPS = 1000;
+static const std::size_t CHURN_SLOTS = 512;
+static const std::size_t CHURN_OPS = 20000;
+static const std::uint64_t SEED = 42;
+static const std::size_t HEAP_RESERVE = 32 * 1024 * 1024;
+
+static Allocator& heap() {
+	Allocator& alloc = Allocator::getInstance();
+	// Collections are only run where a benchmark asks for them
+	alloc.GC_ENABLED = false;
+	return alloc;
+}
+
+static void* glibc_allocate(std::size_t size) {
+	void* ptr = std::malloc(size);
+	do_not_optimize(ptr);
+	return ptr;
+}
+
+static void* custom_allocate(std::size_t size) {
+	return heap().allocate(size);
+}
+
+static void glibc_free(void* ptr) {
+	std::free(ptr);
+}
+
+static void custom_free(void* ptr) {
+	heap().deallocate(ptr);
+}
+
+struct Bench_Impl {
+	const char* name;
+	void* (*allocate)(std::size_t);
+	void (*deallocate)(void*);
+};
+
+static const Bench_Impl IMPLS[] = {
+	{ "allocator", custom_allocate, custom_free },
+	{ "glibc", glibc_allocate, glibc_free },
+};
+
+/**
+ * @brief Allocates OPS chunks of one size class, then frees them in allocation order.
+ */
+BENCHMARK(alloc_free_size_class) {
+	const std::size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+	std::vector<void*> ptrs(OPS);
+
+	for (std::size_t size : sizes) {
+		for (const Bench_Impl& impl : IMPLS) {
+			reporter.measure("alloc_free/size:" + std::to_string(size), impl.name, OPS, [&]() {
+				for (std::size_t i = 0; i < OPS; i++) {
+					ptrs[i] = impl.allocate(size);
+				}
+				for (std::size_t i = 0; i < OPS; i++) {
+					impl.deallocate(ptrs[i]);
+				}
+			});
+		}
+	}
+}
+
+/**
+ * @brief Random sizes (16..2048 bytes) over a fixed pool of slots: each step frees an occupied slot or fills an empty one.
+ */
+BENCHMARK(random_churn) {
+	std::vector<void*> slots(CHURN_SLOTS);
+
+	for (const Bench_Impl& impl : IMPLS) {
+		reporter.measure("random_churn", impl.name, CHURN_OPS, [&]() {
+			Bench_Random random(SEED);
+			for (std::size_t i = 0; i < CHURN_OPS; i++) {
+				std::size_t slot = random.range(0, CHURN_SLOTS - 1);
+				if (slots[slot] != nullptr) {
+					impl.deallocate(slots[slot]);
+					slots[slot] = nullptr;
+				}
+				else {
+					slots[slot] = impl.allocate(random.range(16, 2048));
+				}
+			}
+			for (void*& ptr : slots) {
+				if (ptr != nullptr) {
+					impl.deallocate(ptr);
+					ptr = nullptr;
+				}
+			}
+		});
+	}
+}
+
+/**
+ * @brief Allocates OPS 64-byte chunks and frees them last-in first-out.
+ */
+BENCHMARK(free_order_lifo) {
+	std::vector<void*> ptrs(OPS);
+
+	for (const Bench_Impl& impl : IMPLS) {
+		reporter.measure("free_order/lifo", impl.name, OPS, [&]() {
+			for (std::size_t i = 0; i < OPS; i++) {
+				ptrs[i] = impl.allocate(64);
+			}
+			for (std::size_t i = OPS; i > 0; i--) {
+				impl.deallocate(ptrs[i - 1]);
+			}
+		});
+	}
+}
+
+/**
+ * @brief Allocates OPS 64-byte chunks and frees them first-in first-out.
+ */
+BENCHMARK(free_order_fifo) {
+	std::vector<void*> ptrs(OPS);
+
+	for (const Bench_Impl& impl : IMPLS) {
+		reporter.measure("free_order/fifo", impl.name, OPS, [&]() {
+			for (std::size_t i = 0; i < OPS; i++) {
+				ptrs[i] = impl.allocate(64);
+			}
+			for (std::size_t i = 0; i < OPS; i++) {
+				impl.deallocate(ptrs[i]);
+			}
+		});
+	}
+}
+
+struct Bench_Object {
+	int id;
+	double values[4];
+
+	explicit Bench_Object(int id) : id(id), values{ 1.0, 2.0, 3.0, 4.0 } {}
+};
+
+/**
+ * @brief Constructs and destroys OPS objects: allocate_new/free_ptr against new/delete.
+ */
+BENCHMARK(allocate_new) {
+	std::vector<Bench_Object*> objects(OPS);
+	Allocator& alloc = heap();
+
+	reporter.measure("allocate_new", "allocator", OPS, [&]() {
+		for (std::size_t i = 0; i < OPS; i++) {
+			objects[i] = alloc.allocate_new<Bench_Object>(static_cast<Bench_Object**>(nullptr), static_cast<int>(i));
+		}
+		for (std::size_t i = 0; i < OPS; i++) {
+			alloc.free_ptr(objects[i]);
+		}
+	});
+
+	reporter.measure("allocate_new", "glibc", OPS, [&]() {
+		for (std::size_t i = 0; i < OPS; i++) {
+			objects[i] = new Bench_Object(static_cast<int>(i));
+			do_not_optimize(objects[i]);
+		}
+		for (std::size_t i = 0; i < OPS; i++) {
+			delete objects[i];
+		}
+	});
+}
+
+struct Bench_Node {
+	Bench_Node* next;
+	char payload[48];
+};
+
+/**
+ * @brief Builds a linked list of `count` nodes reachable from `*head`, which is registered as a GC root.
+ */
+static void build_list(Bench_Node** head, std::size_t count) {
+	Allocator& alloc = heap();
+	new (alloc.allocate(sizeof(Bench_Node), reinterpret_cast<void**>(head))) Bench_Node();
+
+	Bench_Node* tail = *head;
+	for (std::size_t i = 1; i < count; i++) {
+		Bench_Node* node = new (alloc.allocate(sizeof(Bench_Node))) Bench_Node();
+		tail->next = node;
+		tail = node;
+	}
+}
+
+/**
+ * @brief GC pause against live-heap size.
+ *
+ * `gc_pause_live` collects while the whole list is reachable (mark cost only).
+ * `gc_reclaim` drops the list and times the collection that frees it; glibc is timed freeing
+ * the same number of nodes by hand, which is the work a collection replaces.
+ */
+BENCHMARK(gc_pause) {
+	const std::size_t live_sizes[] = { 125, 250, 500, 1000 };
+	Allocator& alloc = heap();
+	Garbage_Collector& gc = alloc.getGC();
+
+	for (std::size_t count : live_sizes) {
+		std::string suffix = "/nodes:" + std::to_string(count);
+
+		Bench_Node* head = nullptr;
+		build_list(&head, count);
+		reporter.measure("gc_pause_live" + suffix, "allocator", 1, [&]() {
+			gc.gc_collect();
+		});
+		head = nullptr;
+		gc.gc_collect();
+
+		reporter.measure_with_setup("gc_reclaim" + suffix, "allocator", 1,
+			[&]() {
+				build_list(&head, count);
+				head = nullptr;
+			},
+			[&]() {
+				gc.gc_collect();
+			});
+
+		std::vector<void*> nodes(count);
+		reporter.measure_with_setup("gc_reclaim" + suffix, "glibc", 1,
+			[&]() {
+				for (std::size_t i = 0; i < count; i++) {
+					nodes[i] = glibc_allocate(sizeof(Bench_Node));
+				}
+			},
+			[&]() {
+				for (std::size_t i = 0; i < count; i++) {
+					std::free(nodes[i]);
+				}
+			});
+	}
+}
+
+/**
+ * @brief Heap footprint while a random-size workload grows and shrinks its live set.
+ *
+ * Records live bytes (requested by the workload) and footprint bytes every STEP operations.
+ * The footprint is the heap up to its last allocated chunk (Allocator::get_heap_footprint()),
+ * i.e. live chunks plus the free holes between them. For glibc it is the growth of in-use
+ * bytes since the benchmark started plus the free bytes below the top chunk, from mallinfo2().
+ * (glibc counts foreign sbrk regions such as the Allocator's heap as arena, so the arena
+ * size itself is not comparable.)
+ */
+BENCHMARK(fragmentation) {
+	const std::size_t STEP = 2000;
+	const std::size_t PHASES = 10;
+	std::vector<void*> slots(CHURN_SLOTS);
+	std::vector<std::size_t> sizes(CHURN_SLOTS);
+
+	for (const Bench_Impl& impl : IMPLS) {
+		bool custom = std::string(impl.name) == "allocator";
+		struct mallinfo2 start_info = mallinfo2();
+		std::size_t glibc_start_in_use = start_info.uordblks + start_info.hblkhd;
+		Bench_Random random(SEED);
+		std::size_t live_bytes = 0;
+
+		for (std::size_t phase = 0; phase < PHASES; phase++) {
+			// Alternate between phases that mostly allocate and phases that mostly free
+			std::size_t allocate_percent = phase % 2 == 0 ? 75 : 25;
+			for (std::size_t i = 0; i < STEP; i++) {
+				std::size_t slot = random.range(0, CHURN_SLOTS - 1);
+				bool want_allocate = random.range(1, 100) <= allocate_percent;
+				if (want_allocate && slots[slot] == nullptr) {
+					sizes[slot] = random.range(16, 4096);
+					slots[slot] = impl.allocate(sizes[slot]);
+					live_bytes += sizes[slot];
+				}
+				else if (!want_allocate && slots[slot] != nullptr) {
+					impl.deallocate(slots[slot]);
+					slots[slot] = nullptr;
+					live_bytes -= sizes[slot];
+				}
+			}
+
+			std::size_t footprint_bytes;
+			if (custom) {
+				footprint_bytes = heap().get_heap_footprint();
+			}
+			else {
+				struct mallinfo2 info = mallinfo2();
+				footprint_bytes = info.uordblks + info.hblkhd - glibc_start_in_use + info.fordblks - info.keepcost;
+			}
+
+			std::string name = "fragmentation/ops:" + std::to_string((phase + 1) * STEP);
+			reporter.record(name, impl.name, "live_bytes", static_cast<double>(live_bytes));
+			reporter.record(name, impl.name, "footprint_bytes", static_cast<double>(footprint_bytes));
+			reporter.record(name, impl.name, "overhead_ratio", live_bytes == 0 ? 0.0 : static_cast<double>(footprint_bytes) / static_cast<double>(live_bytes));
+		}
+
+		for (void*& ptr : slots) {
+			if (ptr != nullptr) {
+				impl.deallocate(ptr);
+				ptr = nullptr;
+			}
+		}
+	}
+}
+
+/**
+ * @brief allocate_batch/deallocate_batch against the equivalent per-call loops (Allocator only).
+ */
+BENCHMARK(batch) {
+	const std::size_t BATCH_COUNT = 64;
+	const std::size_t sizes[] = { 16, 64, 256, 1024 };
+	void* ptrs[BATCH_COUNT];
+	Allocator& alloc = heap();
+
+	for (std::size_t size : sizes) {
+		std::string suffix = "/size:" + std::to_string(size);
+
+		reporter.measure("batch_loop" + suffix, "allocator", BATCH_COUNT, [&]() {
+			for (std::size_t i = 0; i < BATCH_COUNT; i++) {
+				ptrs[i] = alloc.allocate(size);
+			}
+			for (std::size_t i = 0; i < BATCH_COUNT; i++) {
+				alloc.deallocate(ptrs[i]);
+			}
+		});
+
+		reporter.measure("batch_call" + suffix, "allocator", BATCH_COUNT, [&]() {
+			alloc.allocate_batch(size, BATCH_COUNT, ptrs);
+			alloc.deallocate_batch(ptrs, BATCH_COUNT);
+		});
+	}
+}
+
+/**
+ * @brief Time to safepoint against the number of registered mutator threads (Allocator only).
+ *
+ * Every mutator allocates and frees small pinned chunks in a loop while the benchmark thread collects
+ * GC_ROUNDS times; the median and max time until all mutators were stopped are recorded.
+ * `gc_pause_mt` times the whole collection, stop and resume included.
+ */
+BENCHMARK(time_to_safepoint) {
+	const std::size_t GC_ROUNDS = 200;
+	const std::size_t mutator_counts[] = { 1, 2, 4, 8 };
+	Allocator& alloc = heap();
+	Garbage_Collector& gc = alloc.getGC();
+	gc.register_thread();
+
+	for (std::size_t mutators : mutator_counts) {
+		std::string name = "time_to_safepoint/threads:" + std::to_string(mutators);
+		std::atomic<bool> done(false);
+		std::vector<std::thread> threads;
+		for (std::size_t t = 0; t < mutators; t++) {
+			threads.emplace_back([&alloc, &gc, &done]() {
+				gc.register_thread();
+				while (!done.load(std::memory_order_relaxed)) {
+					// Pinned, so the collections running meanwhile leave the chunk alone
+					alloc.deallocate(alloc.allocate_pinned(64));
+				}
+				gc.unregister_thread();
+			});
+		}
+
+		reporter.measure("gc_pause_mt/threads:" + std::to_string(mutators), "allocator", 1, [&]() {
+			gc.gc_collect();
+		});
+
+		std::vector<std::uint64_t> safepoint_ns;
+		for (std::size_t round = 0; round < GC_ROUNDS; round++) {
+			gc.gc_collect();
+			GC_Cycle_Record record;
+			gc.get_cycle_records(&record, 1);
+			safepoint_ns.push_back(record.safepoint_ns);
+		}
+		done.store(true);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+
+		std::sort(safepoint_ns.begin(), safepoint_ns.end());
+		reporter.record(name, "allocator", "p50_ns", static_cast<double>(safepoint_ns[safepoint_ns.size() / 2]));
+		reporter.record(name, "allocator", "max_ns", static_cast<double>(safepoint_ns.back()));
+	}
+	gc.unregister_thread();
+}
+
+int main(int argc, char** argv) {
+	Allocator& alloc = heap();
+	alloc.deallocate(alloc.allocate(HEAP_RESERVE));
+
+	return run_benchmarks(argc, argv);
+}
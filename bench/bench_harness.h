@@ -0,0 +1,230 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Minimal Google Benchmark-style harness used by the benchmark executables.
+ *
+ * Benchmarks register themselves with `BENCHMARK(name)`. Each one receives a Bench_Reporter
+ * and calls `measure()` for timed runs or `record()` for plain metrics. Every result carries
+ * the implementation it was measured against ("allocator" or "glibc"), so the output can be
+ * compared side by side.
+ *
+ * Command line:
+ *   --format=csv|json      Output format (default csv)
+ *   --out=<file>           Write results to a file instead of stdout
+ *   --filter=<regex>       Only run benchmarks whose registered name matches the regex
+ *   --repetitions=<n>      Timed repetitions per measurement, the median is reported (default 5)
+ */
+
+/**
+ * @struct Bench_Result
+ * @brief A single measurement or metric.
+ */
+struct Bench_Result {
+    std::string name;           ///< Benchmark name, e.g. "alloc_free/size:64".
+    std::string impl;           ///< Implementation measured: "allocator" or "glibc".
+    std::string metric;         ///< Metric name, e.g. "ns_per_op".
+    double value;               ///< Metric value.
+};
+
+/**
+ * @class Bench_Reporter
+ * @brief Collects results from the running benchmarks.
+ */
+class Bench_Reporter {
+public:
+    explicit Bench_Reporter(std::size_t repetitions) : repetitions(repetitions) {}
+
+    /**
+     * @brief Times `body` and records the median nanoseconds per operation.
+     * @param name Benchmark name.
+     * @param impl Implementation measured.
+     * @param ops Number of operations performed by one call of `body`.
+     * @param body Work to time. It must leave the heap in the state it found it.
+     */
+    void measure(const std::string& name, const std::string& impl, std::size_t ops, const std::function<void()>& body) {
+        std::vector<double> samples;
+        for (std::size_t i = 0; i < repetitions; i++) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        }
+        record_median(name, impl, ops, samples);
+    }
+
+    /**
+     * @brief Like measure(), but runs `setup` untimed before every repetition of `body`.
+     */
+    void measure_with_setup(const std::string& name, const std::string& impl, std::size_t ops,
+        const std::function<void()>& setup, const std::function<void()>& body) {
+        std::vector<double> samples;
+        for (std::size_t i = 0; i < repetitions; i++) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        }
+        record_median(name, impl, ops, samples);
+    }
+
+    /**
+     * @brief Records an arbitrary metric.
+     */
+    void record(const std::string& name, const std::string& impl, const std::string& metric, double value) {
+        results.push_back(Bench_Result{ name, impl, metric, value });
+    }
+
+    const std::vector<Bench_Result>& get_results() const { return results; }
+
+private:
+    std::size_t repetitions;
+
+    void record_median(const std::string& name, const std::string& impl, std::size_t ops, std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+        double median = samples[samples.size() / 2];
+        record(name, impl, "ns_per_op", median / static_cast<double>(ops == 0 ? 1 : ops));
+    }
+
+    std::vector<Bench_Result> results;
+};
+
+/**
+ * @brief Keeps the compiler from optimising away a value the benchmark produced (e.g. a malloc/free pair).
+ */
+inline void do_not_optimize(void* ptr) {
+    asm volatile("" : : "g"(ptr) : "memory");
+}
+
+using Bench_Function = void (*)(Bench_Reporter&);
+
+/**
+ * @brief Registered benchmark: name plus function.
+ */
+struct Bench_Entry {
+    const char* name;
+    Bench_Function function;
+};
+
+inline std::vector<Bench_Entry>& bench_registry() {
+    static std::vector<Bench_Entry> registry;
+    return registry;
+}
+
+/**
+ * @brief Adds a benchmark to the registry at static-initialisation time.
+ */
+struct Bench_Registration {
+    Bench_Registration(const char* name, Bench_Function function) {
+        bench_registry().push_back(Bench_Entry{ name, function });
+    }
+};
+
+#define BENCHMARK(fn) static void fn(Bench_Reporter&); static Bench_Registration fn##_registration(#fn, fn); static void fn(Bench_Reporter& reporter)
+
+/**
+ * @brief Deterministic xorshift generator so that every run sees the same sequence.
+ */
+class Bench_Random {
+public:
+    explicit Bench_Random(std::uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    std::uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    /**
+     * @brief Returns a value in [low, high].
+     */
+    std::size_t range(std::size_t low, std::size_t high) {
+        return low + static_cast<std::size_t>(next() % (high - low + 1));
+    }
+
+private:
+    std::uint64_t state;
+};
+
+inline void write_csv(std::ostream& os, const std::vector<Bench_Result>& results) {
+    os << "name,impl,metric,value\n";
+    for (const Bench_Result& result : results) {
+        os << result.name << "," << result.impl << "," << result.metric << "," << result.value << "\n";
+    }
+}
+
+inline void write_json(std::ostream& os, const std::vector<Bench_Result>& results) {
+    os << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Bench_Result& result = results[i];
+        os << "    {\"name\": \"" << result.name << "\", \"impl\": \"" << result.impl
+            << "\", \"metric\": \"" << result.metric << "\", \"value\": " << result.value << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+/**
+ * @brief Parses the command line, runs the selected benchmarks and writes the results.
+ */
+inline int run_benchmarks(int argc, char** argv) {
+    std::string format = "csv";
+    std::string out_path;
+    std::string filter;
+    std::size_t repetitions = 5;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--format=", 0) == 0) format = arg.substr(9);
+        else if (arg.rfind("--out=", 0) == 0) out_path = arg.substr(6);
+        else if (arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+        else if (arg.rfind("--repetitions=", 0) == 0) repetitions = std::max<std::size_t>(1, std::stoul(arg.substr(14)));
+        else {
+            std::cerr << "Unknown argument: " << arg << '\n';
+            return 1;
+        }
+    }
+
+    Bench_Reporter reporter(repetitions);
+    for (const Bench_Entry& entry : bench_registry()) {
+        if (!filter.empty() && !std::regex_search(entry.name, std::regex(filter))) {
+            continue;
+        }
+        std::cerr << "Running " << entry.name << '\n';
+        entry.function(reporter);
+    }
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file) {
+            std::cerr << "Cannot open " << out_path << '\n';
+            return 1;
+        }
+    }
+    std::ostream& os = out_path.empty() ? std::cout : file;
+
+    if (format == "json") {
+        write_json(os, reporter.get_results());
+    }
+    else {
+        write_csv(os, reporter.get_results());
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "allocator.h"
+#include "bench_harness.h"
+
+// Pointer-chasing benchmark comparing the heap backings: sbrk, transparent huge pages and hugetlb.
+// Nodes are spread over the whole working set and linked in a random cycle, so every hop is a
+// dependent load that usually misses both the caches and the TLB.
+//
+// Usage: hugepage_bench [--format=csv|json] [--out=file] [--filter=regex] [--repetitions=n]
+//
+// The backing can only be chosen before the Allocator's first allocation, so each one runs in a
+// forked child on a fresh heap and sends its results back through a pipe. Backings the system
+// cannot provide (hugetlb without pages in /proc/sys/vm/nr_hugepages) are reported and skipped.
+//
+// glibc also grows through sbrk, so every heap is grown to hold the largest working set before
+// the benchmark allocates through glibc, as in allocator_bench.
+
+static const std::size_t BLOCK_SIZE = 256 * 1024;
+static const std::size_t MAX_WORKING_SET = 1024 * 1024 * 1024;
+static const std::size_t HOPS = 1 << 21;
+static const std::size_t HEAP_RESERVE = std::size_t(2) * 1024 * 1024 * 1024;
+static const std::uint64_t SEED = 42;
+
+static const Heap_Backing BACKINGS[] = { HEAP_BACKING_SBRK, HEAP_BACKING_THP, HEAP_BACKING_HUGETLB };
+
+struct Chase_Node {
+	Chase_Node* next;
+	char payload[56];
+};
+
+/**
+ * @brief Returns the AnonHugePages total of the process in KB, or 0 if it cannot be read.
+ */
+static double anon_huge_pages_kb() {
+	FILE* file = std::fopen("/proc/self/smaps_rollup", "r");
+	if (file == nullptr) {
+		return 0;
+	}
+	char line[256];
+	double kb = 0;
+	while (std::fgets(line, sizeof(line), file) != nullptr) {
+		if (std::strncmp(line, "AnonHugePages:", 14) == 0) {
+			kb = std::strtod(line + 14, nullptr);
+		}
+	}
+	std::fclose(file);
+	return kb;
+}
+
+/**
+ * @brief Allocates `working_set` bytes of nodes in BLOCK_SIZE chunks and links them in one random cycle.
+ */
+static Chase_Node* build_cycle(Allocator& alloc, std::size_t working_set, std::vector<void*>& blocks) {
+	std::vector<Chase_Node*> nodes;
+	for (std::size_t i = 0; i < working_set / BLOCK_SIZE; i++) {
+		void* block = alloc.allocate(BLOCK_SIZE);
+		if (block == nullptr) {
+			break;
+		}
+		blocks.push_back(block);
+		Chase_Node* first = static_cast<Chase_Node*>(block);
+		for (std::size_t j = 0; j < BLOCK_SIZE / sizeof(Chase_Node); j++) {
+			nodes.push_back(first + j);
+		}
+	}
+	if (nodes.empty()) {
+		return nullptr;
+	}
+
+	// Sattolo's shuffle yields a single cycle through every node
+	Bench_Random random(SEED);
+	for (std::size_t i = nodes.size() - 1; i > 0; i--) {
+		std::swap(nodes[i], nodes[random.range(0, i - 1)]);
+	}
+	for (std::size_t i = 0; i < nodes.size(); i++) {
+		nodes[i]->next = nodes[(i + 1) % nodes.size()];
+	}
+	return nodes[0];
+}
+
+/**
+ * @brief Runs the pointer chase on a fresh heap with `backing`. Called in the forked child.
+ * @return false if the backing is not available.
+ */
+static bool run_backing(Bench_Reporter& reporter, Heap_Backing backing) {
+	const std::size_t working_sets[] = { 32u << 20, 256u << 20, MAX_WORKING_SET };
+
+	Allocator& alloc = Allocator::getInstance();
+	alloc.GC_ENABLED = false;
+	if (backing != HEAP_BACKING_SBRK && !alloc.set_heap_backing(backing, HEAP_RESERVE)) {
+		return false;
+	}
+	alloc.deallocate(alloc.allocate(MAX_WORKING_SET + 2 * BLOCK_SIZE));
+
+	for (std::size_t working_set : working_sets) {
+		std::vector<void*> blocks;
+		Chase_Node* start = build_cycle(alloc, working_set, blocks);
+		if (start == nullptr) {
+			return false;
+		}
+
+		std::string name = "pointer_chase/working_set_mb:" + std::to_string(working_set >> 20);
+		Chase_Node* current = start;
+		reporter.measure(name, heap_backing_name(backing), HOPS, [&]() {
+			for (std::size_t i = 0; i < HOPS; i++) {
+				current = current->next;
+			}
+			do_not_optimize(current);
+		});
+		reporter.record(name, heap_backing_name(backing), "anon_huge_pages_kb", anon_huge_pages_kb());
+
+		for (void* block : blocks) {
+			alloc.deallocate(block);
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Chases pointers through 32 MB to 1 GB working sets, once per heap backing.
+ */
+BENCHMARK(pointer_chase) {
+	for (Heap_Backing backing : BACKINGS) {
+		int fds[2];
+		if (pipe(fds) != 0) {
+			std::perror("pipe");
+			return;
+		}
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			std::size_t before = reporter.get_results().size();
+			if (!run_backing(reporter, backing)) {
+				_exit(2);
+			}
+			// One result per line: name, impl, metric, value
+			std::string lines;
+			const std::vector<Bench_Result>& results = reporter.get_results();
+			for (std::size_t i = before; i < results.size(); i++) {
+				lines += results[i].name + " " + results[i].impl + " " + results[i].metric + " " + std::to_string(results[i].value) + "\n";
+			}
+			ssize_t written = write(fds[1], lines.data(), lines.size());
+			_exit(written == static_cast<ssize_t>(lines.size()) ? 0 : 1);
+		}
+		close(fds[1]);
+
+		std::string data;
+		char buffer[4096];
+		ssize_t bytes;
+		while ((bytes = read(fds[0], buffer, sizeof(buffer))) > 0) {
+			data.append(buffer, bytes);
+		}
+		close(fds[0]);
+
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			std::cerr << "Skipping " << heap_backing_name(backing) << " backing, it is not available" << '\n';
+			continue;
+		}
+
+		char name[256], impl[64], metric[64];
+		double value;
+		const char* line = data.c_str();
+		int consumed = 0;
+		while (std::sscanf(line, "%255s %63s %63s %lf%n", name, impl, metric, &value, &consumed) == 4) {
+			reporter.record(name, impl, metric, value);
+			line += consumed;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	return run_benchmarks(argc, argv);
+}
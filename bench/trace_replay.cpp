@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "allocator.h"
+#include "trace_recorder.h"
+#include "bench_harness.h"
+
+// Replays an allocation trace recorded with Allocator::start_trace() (or ALLOCATOR_TRACE=<file>
+// with the preload library) through the Allocator and/or glibc malloc.
+//
+// Usage: trace_replay <trace> [--impl=allocator|glibc|both] [--format=csv|json] [--out=file]
+//
+// Each implementation is replayed in its own forked process, so peak RSS and heap state are not
+// shared between them. The trace is replayed twice per implementation: the first pass times
+// every operation (latency percentiles) and samples the footprint, peak RSS and fragmentation;
+// the second pass runs untimed per operation and gives the throughput.
+
+static const std::size_t FOOTPRINT_SAMPLES = 200;
+
+/**
+ * @brief A trace operation with the recorded id replaced by a dense slot index.
+ */
+struct Replay_Op {
+	bool allocate;
+	std::size_t size;
+	std::size_t slot;
+};
+
+struct Replay_Trace {
+	std::vector<Replay_Op> ops;
+	std::size_t slot_count = 0;
+};
+
+/**
+ * @brief Loads a trace file and maps the recorded ids to slots that can be reused once freed.
+ *
+ * Frees of ids that were allocated before the trace started have nothing to replay and are dropped.
+ */
+static bool load_trace(const std::string& path, Replay_Trace& trace) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "Cannot open " << path << '\n';
+		return false;
+	}
+
+	Trace_File_Header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::string(header.magic, sizeof(header.magic)) != "ATRC" ||
+		header.version != 1 || header.record_size != sizeof(Trace_Record)) {
+		std::cerr << path << " is not a version 1 allocation trace" << '\n';
+		return false;
+	}
+
+	std::unordered_map<std::uint64_t, std::size_t> live;
+	std::vector<std::size_t> free_slots;
+	Trace_Record record;
+
+	while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+		if (record.op() == TRACE_ALLOCATE) {
+			std::size_t slot;
+			if (!free_slots.empty()) {
+				slot = free_slots.back();
+				free_slots.pop_back();
+			}
+			else {
+				slot = trace.slot_count++;
+			}
+
+			// An id can only be live once, a missing free means the chunk was lost (e.g. to a fork)
+			auto existing = live.find(record.id);
+			if (existing != live.end()) {
+				trace.ops.push_back(Replay_Op{ false, 0, existing->second });
+				free_slots.push_back(existing->second);
+			}
+			live[record.id] = slot;
+			trace.ops.push_back(Replay_Op{ true, static_cast<std::size_t>(record.size()), slot });
+		}
+		else if (record.op() == TRACE_GC_MOVE) {
+			// Compaction only changes the id, the replayed chunk stays where it is
+			auto entry = live.find(record.id);
+			if (entry == live.end()) {
+				continue;
+			}
+			std::size_t slot = entry->second;
+			live.erase(entry);
+			live[record.size()] = slot;
+		}
+		else {
+			auto entry = live.find(record.id);
+			if (entry == live.end()) {
+				continue;
+			}
+			trace.ops.push_back(Replay_Op{ false, 0, entry->second });
+			free_slots.push_back(entry->second);
+			live.erase(entry);
+		}
+	}
+	return true;
+}
+
+struct Replay_Impl {
+	const char* name;
+	void* (*allocate)(std::size_t);
+	void (*deallocate)(void*);
+	std::size_t (*footprint)(std::size_t start_in_use);
+};
+
+static void* custom_allocate(std::size_t size) {
+	return Allocator::getInstance().allocate(size == 0 ? 1 : size);
+}
+
+static void custom_free(void* ptr) {
+	Allocator::getInstance().deallocate(ptr);
+}
+
+static std::size_t custom_footprint(std::size_t) {
+	return Allocator::getInstance().get_heap_footprint();
+}
+
+static void* glibc_allocate(std::size_t size) {
+	void* ptr = std::malloc(size == 0 ? 1 : size);
+	do_not_optimize(ptr);
+	return ptr;
+}
+
+static void glibc_free(void* ptr) {
+	std::free(ptr);
+}
+
+// In-use growth since the replay started plus the free holes below the top chunk,
+// comparable with Allocator::get_heap_footprint()
+static std::size_t glibc_footprint(std::size_t start_in_use) {
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd - start_in_use + info.fordblks - info.keepcost;
+}
+
+static std::size_t glibc_in_use() {
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+static const Replay_Impl IMPLS[] = {
+	{ "allocator", custom_allocate, custom_free, custom_footprint },
+	{ "glibc", glibc_allocate, glibc_free, glibc_footprint },
+};
+
+static std::size_t current_rss_bytes() {
+	long pages = 0;
+	FILE* statm = std::fopen("/proc/self/statm", "r");
+	if (statm != nullptr) {
+		long size = 0;
+		if (std::fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+			pages = 0;
+		}
+		std::fclose(statm);
+	}
+	return static_cast<std::size_t>(pages) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static double percentile(const std::vector<std::uint64_t>& sorted, double fraction) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	std::size_t index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1));
+	return static_cast<double>(sorted[index]);
+}
+
+static void release_all(const Replay_Impl& impl, std::vector<void*>& slots) {
+	for (void*& ptr : slots) {
+		if (ptr != nullptr) {
+			impl.deallocate(ptr);
+			ptr = nullptr;
+		}
+	}
+}
+
+/**
+ * @brief Replays the trace through one implementation and records its metrics.
+ *
+ * Nothing on the replay path allocates: the slot table and latency buffer are sized up front.
+ */
+static void replay(const Replay_Impl& impl, const Replay_Trace& trace, const std::string& name, Bench_Reporter& reporter) {
+	std::vector<void*> slots(trace.slot_count, nullptr);
+	std::vector<std::size_t> slot_sizes(trace.slot_count, 0);
+	std::vector<std::uint64_t> latencies(trace.ops.size());
+	std::size_t sample_interval = std::max<std::size_t>(1, trace.ops.size() / FOOTPRINT_SAMPLES);
+
+	if (std::string(impl.name) == "allocator") {
+		Allocator::getInstance().GC_ENABLED = false;
+	}
+
+	std::size_t start_rss = current_rss_bytes();
+	std::size_t start_in_use = glibc_in_use();
+	std::size_t live_bytes = 0;
+	std::size_t peak_live_bytes = 0;
+	std::size_t peak_footprint_bytes = 0;
+
+	// Pass 1: per-operation latency, footprint and RSS
+	for (std::size_t i = 0; i < trace.ops.size(); i++) {
+		const Replay_Op& op = trace.ops[i];
+		auto start = std::chrono::steady_clock::now();
+		if (op.allocate) {
+			slots[op.slot] = impl.allocate(op.size);
+		}
+		else {
+			impl.deallocate(slots[op.slot]);
+		}
+		auto end = std::chrono::steady_clock::now();
+		latencies[i] = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+		// Frees do not carry a size, so the live size of a slot is remembered from its allocation
+		if (op.allocate) {
+			slot_sizes[op.slot] = op.size;
+			live_bytes += op.size;
+			peak_live_bytes = std::max(peak_live_bytes, live_bytes);
+		}
+		else {
+			live_bytes -= slot_sizes[op.slot];
+			slots[op.slot] = nullptr;
+		}
+
+		if (i % sample_interval == 0) {
+			peak_footprint_bytes = std::max(peak_footprint_bytes, impl.footprint(start_in_use));
+		}
+	}
+	release_all(impl, slots);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::size_t peak_rss = static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+
+	// Pass 2: throughput without per-operation timing
+	auto start = std::chrono::steady_clock::now();
+	for (const Replay_Op& op : trace.ops) {
+		if (op.allocate) {
+			slots[op.slot] = impl.allocate(op.size);
+		}
+		else {
+			impl.deallocate(slots[op.slot]);
+			slots[op.slot] = nullptr;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	release_all(impl, slots);
+	double elapsed_s = std::chrono::duration<double>(end - start).count();
+
+	std::sort(latencies.begin(), latencies.end());
+	reporter.record(name, impl.name, "ops", static_cast<double>(trace.ops.size()));
+	reporter.record(name, impl.name, "throughput_ops_per_s", elapsed_s > 0 ? static_cast<double>(trace.ops.size()) / elapsed_s : 0);
+	reporter.record(name, impl.name, "latency_p50_ns", percentile(latencies, 0.50));
+	reporter.record(name, impl.name, "latency_p90_ns", percentile(latencies, 0.90));
+	reporter.record(name, impl.name, "latency_p99_ns", percentile(latencies, 0.99));
+	reporter.record(name, impl.name, "latency_p999_ns", percentile(latencies, 0.999));
+	reporter.record(name, impl.name, "latency_max_ns", latencies.empty() ? 0 : static_cast<double>(latencies.back()));
+	reporter.record(name, impl.name, "peak_rss_bytes", static_cast<double>(peak_rss));
+	reporter.record(name, impl.name, "peak_rss_growth_bytes", static_cast<double>(peak_rss > start_rss ? peak_rss - start_rss : 0));
+	reporter.record(name, impl.name, "peak_live_bytes", static_cast<double>(peak_live_bytes));
+	reporter.record(name, impl.name, "peak_footprint_bytes", static_cast<double>(peak_footprint_bytes));
+	reporter.record(name, impl.name, "fragmentation_ratio", peak_live_bytes == 0 ? 0 : static_cast<double>(peak_footprint_bytes) / static_cast<double>(peak_live_bytes));
+}
+
+/**
+ * @brief Runs `replay` in a child process and collects its results through a pipe.
+ */
+static bool replay_in_child(const Replay_Impl& impl, const Replay_Trace& trace, const std::string& name, Bench_Reporter& reporter) {
+	int fds[2];
+	if (pipe(fds) != 0) {
+		std::cerr << "pipe() failed" << '\n';
+		return false;
+	}
+
+	std::cout.flush();
+	pid_t pid = fork();
+	if (pid < 0) {
+		std::cerr << "fork() failed" << '\n';
+		return false;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		Bench_Reporter child_reporter(1);
+		replay(impl, trace, name, child_reporter);
+
+		std::ostringstream lines;
+		lines.precision(17);
+		for (const Bench_Result& result : child_reporter.get_results()) {
+			lines << result.name << '\t' << result.impl << '\t' << result.metric << '\t' << result.value << '\n';
+		}
+		std::string text = lines.str();
+		std::size_t written = 0;
+		while (written < text.size()) {
+			ssize_t count = write(fds[1], text.data() + written, text.size() - written);
+			if (count <= 0) {
+				break;
+			}
+			written += static_cast<std::size_t>(count);
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	std::string text;
+	char buffer[4096];
+	ssize_t count;
+	while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+		text.append(buffer, static_cast<std::size_t>(count));
+	}
+	close(fds[0]);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		std::cerr << "Replay through " << impl.name << " failed" << '\n';
+		return false;
+	}
+
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line)) {
+		std::istringstream fields(line);
+		std::string result_name, result_impl, metric, value;
+		std::getline(fields, result_name, '\t');
+		std::getline(fields, result_impl, '\t');
+		std::getline(fields, metric, '\t');
+		std::getline(fields, value, '\t');
+		reporter.record(result_name, result_impl, metric, std::stod(value));
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::string trace_path;
+	std::string impl_name = "both";
+	std::string format = "csv";
+	std::string out_path;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.rfind("--impl=", 0) == 0) impl_name = arg.substr(7);
+		else if (arg.rfind("--format=", 0) == 0) format = arg.substr(9);
+		else if (arg.rfind("--out=", 0) == 0) out_path = arg.substr(6);
+		else if (trace_path.empty() && arg.rfind("--", 0) != 0) trace_path = arg;
+		else {
+			std::cerr << "Unknown argument: " << arg << '\n';
+			return 1;
+		}
+	}
+
+	if (trace_path.empty()) {
+		std::cerr << "Usage: trace_replay <trace> [--impl=allocator|glibc|both] [--format=csv|json] [--out=file]" << '\n';
+		return 1;
+	}
+
+	Replay_Trace trace;
+	if (!load_trace(trace_path, trace)) {
+		return 1;
+	}
+
+	std::string name = "replay/" + trace_path.substr(trace_path.find_last_of('/') + 1);
+	Bench_Reporter reporter(1);
+	for (const Replay_Impl& impl : IMPLS) {
+		if (impl_name != "both" && impl_name != impl.name) {
+			continue;
+		}
+		if (!replay_in_child(impl, trace, name, reporter)) {
+			return 1;
+		}
+	}
+
+	std::ofstream file;
+	if (!out_path.empty()) {
+		file.open(out_path);
+		if (!file) {
+			std::cerr << "Cannot open " << out_path << '\n';
+			return 1;
+		}
+	}
+	std::ostream& os = out_path.empty() ? std::cout : file;
+
+	if (format == "json") {
+		write_json(os, reporter.get_results());
+	}
+	else {
+		write_csv(os, reporter.get_results());
+	}
+	return 0;
+}
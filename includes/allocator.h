@@ -3,10 +3,19 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <unistd.h>
 #include "chunk_metadata.h"
 #include "bst_node.h"
-#include <sstream>
+#include "debug_log.h"
+#include "trace_recorder.h"
+#include "allocator_stats.h"
+#include "heap_report.h"
+#include "heap_profiler.h"
+#include "heap_growth_policy.h"
+#include "oom_policy.h"
+#include "heap_backing.h"
+#include "persistent_heap.h"
 #include <string>
 #include <iostream>
 #include <garbage_collector.h>
@@ -47,12 +56,86 @@ public:
 	 */
 	void* allocate(std::size_t size, void** root=NULL);
 
+	/**
+	 * @brief Allocates memory that is never reclaimed by the garbage collector.
+	 *
+	 * Pinned chunks are skipped by the sweep phase and scanned as GC roots, so anything
+	 * they reference stays alive. They must be released explicitly with `deallocate`.
+	 *
+	 * @param size The size of memory to allocate in bytes.
+	 * @param alignment Required alignment of the returned pointer, must be a power of two.
+	 * @return Pointer to the allocated memory, or nullptr if the allocation fails.
+	 */
+	void* allocate_pinned(std::size_t size, std::size_t alignment = ALIGNMENT);
+
 	/**
 	 * @brief Deallocates memory pointed to by a specified pointer.
 	 * @param ptr Pointer to the memory to deallocate.
 	 */
 	void deallocate(void* ptr);
 
+	/**
+	 * @brief Deallocates memory using a size hint supplied by the caller.
+	 *
+	 * The chunk header is read directly instead of searching the BST to validate the pointer. Small
+	 * chunks are parked in a per-size-class quick list and handed straight back by the next
+	 * allocation of the same size class; larger chunks, or small ones whose list is full, are freed
+	 * at once, which still descends the BST once to unlink the chunk's node.
+	 *
+	 * @param ptr Pointer to the memory to deallocate.
+	 * @param size The size that was requested when the memory was allocated.
+	 */
+	void deallocate(void* ptr, std::size_t size);
+
+	/**
+	 * @brief Releases every chunk parked in the quick lists back to the heap.
+	 *
+	 * Called automatically at the start of each garbage collection cycle.
+	 */
+	void flush_quick_lists();
+
+	/**
+	 * @brief Returns the number of usable bytes in the chunk starting at `ptr`.
+	 *
+	 * The chunk header is read directly, so `ptr` must be a pointer returned by one of the
+	 * allocation functions that has not been deallocated yet.
+	 *
+	 * @param ptr Pointer to an allocated chunk, or nullptr.
+	 * @return Size of the chunk's data area, or 0 for nullptr.
+	 */
+	std::size_t usable_size(void* ptr);
+
+	/**
+	 * @brief Checks whether a pointer lies inside the used part of the heap.
+	 * @param ptr Pointer to check.
+	 * @return True if `ptr` points into the heap managed by this allocator.
+	 */
+	bool contains(void* ptr);
+
+	/**
+	 * @brief Allocates `count` chunks of `size` bytes in a single pass.
+	 *
+	 * One free region large enough for all chunks is located (or appended at the end of the heap)
+	 * and split in place, instead of searching the heap once per chunk. Chunks allocated this way
+	 * are not registered as GC roots.
+	 *
+	 * @param size The size of each chunk in bytes.
+	 * @param count Number of chunks to allocate.
+	 * @param out_ptrs Array of at least `count` entries that receives the chunk pointers.
+	 * @return Number of chunks allocated, 0 if together they would exceed MAX_ALLOCATION_SIZE.
+	 */
+	std::size_t allocate_batch(std::size_t size, std::size_t count, void** out_ptrs);
+
+	/**
+	 * @brief Deallocates an array of pointers, coalescing neighbouring free chunks once.
+	 *
+	 * The array is sorted by address in place. Null entries are ignored.
+	 *
+	 * @param ptrs Array of pointers to deallocate.
+	 * @param count Number of entries in `ptrs`.
+	 */
+	void deallocate_batch(void** ptrs, std::size_t count);
+
 	/**
  	 * @brief Dumps the current state of the heap, including allocated chunks and free space.
 	 *
@@ -74,7 +157,7 @@ public:
 	/*
 		Note the following function body have to be here only
 		template functions need to be defined in the header file (or at least included in the same translation unit as their usage).
-		Since templates are instantiated at compile-time, the compiler needs the complete definition when generating code for each instantiation, which it doesnt have if the definition is in a separate .cpp file.
+		Since templates are instantiated at compile-time, the compiler needs the complete definition when generating code for each instantiation, which it doesnt have if the definition is in a separate .cpp file.
 	*/
 
 	/**
@@ -86,6 +169,14 @@ public:
 	 * The object is then constructed in the allocated memory using placement new, allowing the constructor of T
 	 * to be called directly in the allocated memory region.
 	 *
+	 * If T is not trivially destructible, its destructor is recorded with the chunk. While the
+	 * finalizer thread runs (Garbage_Collector::start_finalizer_thread()), the destructor then
+	 * runs once the object has become unreachable, before its memory is reclaimed. If T declares
+	 * its pointer fields (gc_pointer_fields), they are recorded too, so that compaction can move
+	 * what they reference. The chunk is pinned while the constructor runs, so a compaction started
+	 * by an allocation in the constructor does not move the object under construction. If the
+	 * constructor throws, the chunk is freed, `*root` is reset to nullptr and the exception propagates.
+	 *
 	 * @tparam T The type of the object to be allocated.
 	 * @tparam Args The types of the arguments to be forwarded to the
 	 *              constructor of T.
@@ -96,7 +187,7 @@ public:
 	 */
 	template <typename T, typename... Args>
 	T* allocate_new(T** root, Args&&... args) {
-		void* memory = allocate(sizeof(T), (void**)&root);
+		void* memory = allocate(sizeof(T), reinterpret_cast<void**>(root));
 		if (!memory) {
 			std::cerr << "Bad allocation Error" << std::endl;
 			return nullptr;
@@ -105,7 +196,21 @@ public:
 		T* obj_ptr = static_cast<T*>(memory);
 
 		// Manually invoke the constructor using placement syntax
-		new (obj_ptr) T(std::forward<Args>(args)...);
+		set_pinned(obj_ptr, true);
+		try {
+			new (obj_ptr) T(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			// Freeing the chunk also drops the pin, so nothing outlives the failed construction
+			if (root != nullptr) {
+				*root = nullptr;
+			}
+			deallocate(obj_ptr);
+			throw;
+		}
+		set_pinned(obj_ptr, false);
+		set_finalizer(obj_ptr, finalizer_index<T>());
+		set_layout(obj_ptr, layout_index<T>());
 		return obj_ptr;
 	}
 
@@ -138,6 +243,225 @@ public:
 	 * @return Reference to the Garbage_Collector instance.
 	 */
 	Garbage_Collector& getGC();
+
+	/**
+	 * @brief Returns the number of bytes currently reserved for the heap.
+	 */
+	std::size_t get_heap_capacity() const;
+
+	/**
+	 * @brief Returns the number of heap bytes up to the end of the last allocated chunk, including metadata.
+	 *
+	 * Free space after the last allocated chunk is not counted, since it could be handed back to the OS.
+	 * Comparing this with the bytes the program has live gives the heap's fragmentation overhead.
+	 */
+	std::size_t get_heap_footprint() const;
+
+	/**
+	 * @brief Sets how the heap grows when an allocation does not fit. See Heap_Growth_Policy.
+	 */
+	void set_heap_growth_policy(const Heap_Growth_Policy& policy);
+
+	const Heap_Growth_Policy& get_heap_growth_policy() const;
+
+	/**
+	 * @brief Sets how allocations recover from, and report, running out of memory. See Oom_Policy.
+	 */
+	void set_oom_policy(const Oom_Policy& policy);
+
+	const Oom_Policy& get_oom_policy() const;
+
+	/**
+	 * @brief Returns the free space at the end of the heap to the OS, like malloc_trim().
+	 *
+	 * Only possible while the heap ends at the program break, i.e. nothing else has called
+	 * sbrk() since the heap last grew.
+	 *
+	 * @param pad Free bytes to keep at the end of the heap.
+	 * @return Number of bytes released.
+	 */
+	std::size_t trim(std::size_t pad = 0);
+
+	/**
+	 * @brief Moves the heap to a huge page backed reservation. See Heap_Backing.
+	 *
+	 * Only possible before the first allocation. The heap starts at one huge page and grows in
+	 * whole huge pages up to `reserve_size`, after which expansions fail into the Oom_Policy.
+	 *
+	 * @param backing HEAP_BACKING_THP or HEAP_BACKING_HUGETLB.
+	 * @param reserve_size Address space to reserve, rounded up to a huge page.
+	 * @return false if the heap is already in use or the reservation could not be mapped, in
+	 * which case the heap is left as it was. The reason goes to the debug log only, so that the
+	 * preload library can call this while bootstrapping.
+	 */
+	bool set_heap_backing(Heap_Backing backing, std::size_t reserve_size);
+
+	Heap_Backing get_heap_backing() const;
+
+	/**
+	 * @brief Moves the heap into a file, so that the objects in it outlive the process.
+	 *
+	 * Only possible before the first allocation. A new file gets a header page and a one page
+	 * heap, and grows with the heap up to `reserve_size`. An existing heap file is mapped back at
+	 * the address it was created at, so every pointer stored in it is valid again: the chunk list
+	 * is walked to check it is intact, parked chunks are freed, and the allocated chunk index is
+	 * rebuilt balanced. Use set_persistent_root() to find the objects again after a restart.
+	 *
+	 * Persisted objects must be plain data: no virtual functions and no pointers out of the heap.
+	 * Finalizers and pointer field layouts are per process and are dropped on reopen, so restored
+	 * objects are scanned conservatively and reclaimed without running destructors. Changes made
+	 * after the last sync_persistent_heap() may be lost if the process does not exit cleanly.
+	 *
+	 * @param path Heap file, created if it does not exist.
+	 * @param reserve_size Largest heap a new file may grow to, rounded up to a page. Ignored when
+	 * reopening, the file keeps its own.
+	 * @param address Where to map a new heap, nullptr to let the kernel choose. A fixed address
+	 * away from the program's other mappings makes it more likely to be free on every restart.
+	 * @return false if the heap is already in use, the file is not a heap file of this build, or
+	 * its address range is taken, in which case the heap is left as it was.
+	 */
+	bool open_persistent_heap(const char* path, std::size_t reserve_size, void* address = nullptr);
+
+	/**
+	 * @brief Attaches to a heap in a shared memory segment that several processes allocate from.
+	 *
+	 * Only possible before the first allocation. The first process to attach to `name` creates
+	 * the segment with a one page heap that grows up to `reserve_size`; the others map it at the
+	 * same address, so pointers into the heap are the same in every process and chunk links need
+	 * no translation. A null `name` creates an anonymous memfd segment instead, shared with the
+	 * children forked after this call (e.g. pre-forked workers).
+	 *
+	 * Every allocation and deallocation takes a process-shared robust mutex in the segment's header.
+	 * A process that finds the heap changed by another one since it last held the mutex reloads its
+	 * chunk index from the chunk list first, which costs one pass over the heap. Reads of objects
+	 * need no lock. Quick lists are bypassed so that every free chunk is visible to all processes.
+	 *
+	 * The collector only knows the calling process's roots, so automatic collection is turned off
+	 * and gc_collect() does nothing while the heap is shared: objects are freed explicitly. The same
+	 * rules as open_persistent_heap() apply to what the objects may contain, and the root table
+	 * (set_persistent_root()) lets processes find the shared structures. Allocator_Stats stay per
+	 * process. Remove a named segment with shm_unlink() once no process needs it.
+	 *
+	 * A process that dies while changing the heap leaves the others to reload and check the chunk
+	 * list. If it is corrupt, each process reports it on std::cerr and carries on with an empty
+	 * private heap, which get_heap_backing() shows as HEAP_BACKING_SBRK.
+	 *
+	 * @param name Segment name for shm_open(), e.g. "/lookup_heap", or nullptr for memfd_create().
+	 * @param reserve_size Largest heap a new segment may grow to, rounded up to a page.
+	 * @param address Where to map a new segment, nullptr to let the kernel choose. Processes that
+	 * attach later need the range free, so a fixed address is recommended for named segments.
+	 * @return false if the heap is already in use, the segment is not a heap of this build, or its
+	 * address range is taken, in which case the heap is left as it was.
+	 */
+	bool attach_shared_heap(const char* name, std::size_t reserve_size, void* address = nullptr);
+
+	/**
+	 * @brief Unmaps a persistent or shared heap, after a checkpoint for a persistent one, and goes
+	 * back to an empty sbrk heap.
+	 *
+	 * Every pointer into the detached heap becomes invalid. No other thread may use the Allocator
+	 * meanwhile.
+	 */
+	void detach_heap();
+
+	/**
+	 * @brief Checkpoints a persistent heap: frees the parked chunks and writes every dirty page
+	 * of the heap file back with msync().
+	 * @return false if no persistent heap is open or the write failed.
+	 */
+	bool sync_persistent_heap();
+
+	/**
+	 * @brief Stores `ptr` in slot `index` of the persistent heap's root table.
+	 *
+	 * Roots are kept by the garbage collector and moved with their objects by compaction.
+	 *
+	 * @param index Slot, below Persistent_Heap_Header::MAX_ROOTS.
+	 * @param ptr Payload of an allocated chunk, or nullptr to clear the slot.
+	 * @return false if no persistent heap is open or `index` is out of range.
+	 */
+	bool set_persistent_root(std::size_t index, void* ptr);
+
+	/**
+	 * @brief Returns slot `index` of the persistent heap's root table, or nullptr.
+	 */
+	void* get_persistent_root(std::size_t index) const;
+
+	/**
+	 * @brief Starts recording every allocation and deallocation to a binary trace file.
+	 *
+	 * Records allocate, allocate_pinned, allocate_new, allocate_batch, deallocate (both overloads),
+	 * free_ptr, deallocate_batch and chunks reclaimed by the garbage collector. The trace can be fed
+	 * through `trace_replay` to compare allocators on a captured workload.
+	 *
+	 * @param path File to create. An existing file is truncated.
+	 * @return false if the file could not be created.
+	 */
+	bool start_trace(const char* path);
+
+	/**
+	 * @brief Flushes and closes the trace started by `start_trace`.
+	 */
+	void stop_trace();
+
+	/**
+	 * @brief Returns a snapshot of the allocator's counters.
+	 *
+	 * The counters are always maintained and cost a few plain stores per operation. The snapshot
+	 * does not walk the heap and may be taken from another thread while the allocator is in use;
+	 * each counter is read atomically, but the snapshot as a whole is not a single point in time.
+	 */
+	Allocator_Stats get_stats() const;
+
+	/**
+	 * @brief Walks the chunk list and reports how fragmented the heap is.
+	 *
+	 * Covers external fragmentation (largest free chunk against all free bytes, and a histogram of
+	 * free chunk sizes) and internal waste (chunk metadata, plus the bytes each allocated chunk holds
+	 * beyond the requested size). The walk is linear in the number of chunks.
+	 */
+	Heap_Report analyze_heap() const;
+
+	/**
+	 * @brief Writes analyze_heap() and a per-page occupancy map of the heap as one line of JSON.
+	 *
+	 * The `pages` array holds, for every page from the start of the heap to the end of the last
+	 * chunk, the percentage (0 to 100) of the page covered by allocated chunks and their metadata.
+	 * Appending one line per snapshot to a file gives a record that can be plotted over time.
+	 * Writing to `os` may allocate, so this must not be called from the malloc replacements.
+	 *
+	 * @param os Stream to write to.
+	 * @param page_size Granularity of the map in bytes.
+	 */
+	void write_heap_map(std::ostream& os, std::size_t page_size = 4096) const;
+
+	/**
+	 * @brief Starts the sampling heap profiler.
+	 *
+	 * Samples allocations made through the public entry points on average once every
+	 * `sample_interval` requested bytes and keeps each sample, with its call stack, until the
+	 * chunk is deallocated or reclaimed by the garbage collector.
+	 *
+	 * @param sample_interval Average bytes between samples.
+	 * @return false if the profiler could not be started.
+	 */
+	bool start_heap_profile(std::size_t sample_interval = Heap_Profiler::DEFAULT_SAMPLE_INTERVAL);
+
+	/**
+	 * @brief Stops the heap profiler and discards its samples.
+	 */
+	void stop_heap_profile();
+
+	/**
+	 * @brief Writes the allocations that are sampled and still live to `path`.
+	 *
+	 * Does not allocate, so it may be called from the malloc replacements.
+	 *
+	 * @param path File to create. An existing file is truncated.
+	 * @param format `HEAP_PROFILE_PPROF` for `pprof <binary> <path>`, `HEAP_PROFILE_FOLDED` for flame graphs.
+	 * @return false if the profiler is not running or the file could not be written.
+	 */
+	bool write_heap_profile(const char* path, Heap_Profile_Format format = HEAP_PROFILE_PPROF) const;
 	
 	/**
 	 * @brief Assigns a source pointer to a destination pointer and tracks the destination in GC.
@@ -151,6 +475,9 @@ public:
 	 */
 	template <typename T>
 	T* assign(T** dest, T* src) {
+		// Safepoint, and keeps the store and the root registration together while another thread collects
+		GC_Mutator_Guard guard(*gc);
+
 		out << "Called assign for dest = " << dest << " , src = " << src << '\n';
 		log_info();
 		// Update the destination pointer
@@ -163,11 +490,41 @@ public:
 		return *dest;
 	}
 
+	/**
+	 * @brief Records the destructor thunk run before the chunk at `ptr` is reclaimed by the collector.
+	 * @param ptr Payload of an allocated chunk.
+	 * @param index Thunk index from finalizer_index<T>(); 0 removes the finalizer.
+	 */
+	void set_finalizer(void* ptr, std::uint32_t index) {
+		reinterpret_cast<Chunk_Metadata*>(static_cast<char*>(ptr) - sizeof(Chunk_Metadata))->finalizer = index;
+	}
+
+	/**
+	 * @brief Records the pointer field layout of the object at `ptr`, set once it is constructed.
+	 * @param ptr Payload of an allocated chunk.
+	 * @param index Layout index from layout_index<T>(); 0 scans the chunk conservatively.
+	 */
+	void set_layout(void* ptr, std::uint32_t index) {
+		reinterpret_cast<Chunk_Metadata*>(static_cast<char*>(ptr) - sizeof(Chunk_Metadata))->layout = index;
+	}
+
+	/**
+	 * @brief Pins or unpins the chunk at `ptr`. A pinned chunk is a root and is neither swept nor moved.
+	 * @param ptr Payload of an allocated chunk.
+	 */
+	void set_pinned(void* ptr, bool pinned) {
+		reinterpret_cast<Chunk_Metadata*>(static_cast<char*>(ptr) - sizeof(Chunk_Metadata))->gc_pinned = pinned;
+	}
+
 	bool GC_ENABLED = true;
 
+	static const std::size_t ALIGNMENT = alignof(std::max_align_t);	///< Alignment of every chunk payload and chunk size.
+	static const std::size_t MAX_ALLOCATION_SIZE = PTRDIFF_MAX;		///< Largest request served; bigger ones go to the out-of-memory path, so header and padding arithmetic cannot wrap.
+
 	// FRIEND CLASSES
 	friend class Garbage_Collector;
 	friend class Chunk_Metadata;
+	friend class GC_Finalizer;
 	
 private:
 	static const std::size_t INITIAL_HEAP_CAPACITY = 1024 * 1024; 	///< Initial heap capacity (1 MB).
@@ -175,16 +532,34 @@ private:
 	Garbage_Collector* gc;
 	void* heap_start;												///< Starting address of the heap.
 	std::size_t HEAP_CAPACITY;										///< The current capacity of the heap.
+	Heap_Backing heap_backing = HEAP_BACKING_SBRK;					///< Where the heap's memory comes from.
+	std::size_t heap_reserve = 0;									///< Size of the reservation starting at heap_start; 0 for sbrk.
+	Persistent_Heap_Header* persistent = nullptr;					///< Header page of the heap file, nullptr unless the backing is HEAP_BACKING_FILE.
+	int persistent_fd = -1;											///< Heap file, kept open so the heap can grow.
+	std::uint64_t shared_generation = 0;							///< Persistent_Heap_Header::generation as of this process's last change to a shared heap.
+	static thread_local unsigned shared_lock_depth;					///< Nested lock_shared_heap() calls held by the thread.
 	std::size_t used_heap_size;										///< The total amount of memory used in the heap.
-	std::ostringstream out;											///< Output stream for logging purposes.
+	Debug_Log out;													///< Output stream for logging purposes.
+	Trace_Recorder trace;											///< Allocation trace, inactive unless start_trace() was called.
+	Allocator_Counters stats;										///< Counters behind get_stats().
+	Heap_Growth_Policy growth_policy;								///< How expand_heap() sizes each expansion.
+	Oom_Policy oom_policy;											///< How allocations recover from running out of memory.
+	bool handling_oom = false;										///< Set while out_of_memory() retries, so that nested failures give up at once.
+	Heap_Profiler profiler;											///< Sampling heap profiler, inactive unless start_heap_profile() was called.
+
+	static const std::size_t QUICK_LIST_MAX_SIZE = 512;				///< Largest chunk size kept in a quick list.
+	static const std::size_t QUICK_LIST_CAPACITY = 64;				///< Maximum number of chunks parked per size class.
+	Chunk_Metadata* quick_lists[QUICK_LIST_MAX_SIZE / ALIGNMENT + 1] = {};			///< Parked chunks per size class, linked through their payload.
+	std::size_t quick_list_counts[QUICK_LIST_MAX_SIZE / ALIGNMENT + 1] = {};		///< Number of parked chunks per size class.
+	Chunk_Metadata* hole_cursor = nullptr;							///< Next hole of a recycled block to bump allocate into, nullptr when not recycling.
+	std::uint64_t hole_epoch = 0;									///< Coalesces counted when `hole_cursor` was last known to be a chunk header.
 
 
 
 
-	static const std::size_t MAX_NODES = 1024;						///< Maximum number of chunk pointers in the node pool.
-	BST_Node* node_pool;											///< Pool of BST nodes used to manage allocated chunks.
-	bool* node_used;												///< Boolean array indicating the usage of nodes in node_pool.
-	std::size_t node_index;											///< Tracks the next available node in the node pool.
+	static const std::size_t MAX_NODES = 1024;						///< Number of BST nodes in each node pool.
+	BST_Node* free_nodes;											///< Free list of BST nodes, linked through their `right` pointer.
+	std::size_t free_node_count = 0;								///< Number of nodes on `free_nodes`.
 		
 
 	BST_Node* allocated_chunks_root = nullptr;						///< Root of the BST for allocated chunks.
@@ -201,6 +576,173 @@ private:
 
 	void* allocate(std::size_t size, bool gc_collect_flag);
 
+	/**
+	 * @brief Frees an allocated chunk and coalesces it with free neighbours.
+	 *
+	 * Shared by deallocate and the quick list flush. Parked chunks were already traced and
+	 * counted when they were parked, so the flush passes `note = false`.
+	 *
+	 * @param ptr Pointer to the chunk's payload.
+	 * @param note Trace and count the free once the pointer has been validated.
+	 * @return false if `ptr` is not an allocated chunk.
+	 */
+	bool free_chunk(void* ptr, bool note);
+
+	/**
+	 * @brief Marks an already validated chunk free, unlinks it from the BST and coalesces it.
+	 *
+	 * Used by free_chunk once it has found the chunk, and directly by the sized deallocate and the
+	 * quick list flush, which trust the header and so skip the validating BST search. Removing the
+	 * node still descends the BST once.
+	 *
+	 * @param chunk Header of an allocated chunk that is not parked in a quick list.
+	 */
+	void release_chunk(Chunk_Metadata* chunk);
+
+	/**
+	 * @brief Handles an allocation of `size` bytes that could not grow the heap.
+	 *
+	 * Runs the recovery steps of the Oom_Policy, retrying the allocation after each one, then
+	 * applies its mode.
+	 *
+	 * @return The chunk if recovery succeeded, otherwise nullptr (unless the mode throws or exits).
+	 */
+	void* out_of_memory(std::size_t size);
+
+	/**
+	 * @brief Collects because `size` bytes did not fit. If the collection did not make room and
+	 * soft references are held, collects again clearing them, before the caller grows the heap.
+	 */
+	void collect_for_allocation(std::size_t size);
+
+	/**
+	 * @brief Returns true if `size` bytes fit in a free chunk or after the last chunk, without growing the heap.
+	 */
+	bool fits_in_heap(std::size_t size) const;
+
+	/**
+	 * @brief Reports a deallocation of a pointer that is not an allocated chunk.
+	 */
+	void invalid_free(void* ptr, const char* reason);
+
+	/**
+	 * @brief Makes sure at least `count` BST nodes are available, mapping node pools as needed.
+	 * @return false if a pool could not be mapped.
+	 */
+	bool reserve_nodes(std::size_t count);
+
+	/**
+	 * @brief Maps the heap file `fd` and moves the heap into it, creating the header if the file
+	 * is empty. Shared by open_persistent_heap() and attach_shared_heap(), which describe the rules.
+	 * @param path Name of the file, for error messages.
+	 * @return false if the heap could not be moved, in which case `fd` is closed.
+	 */
+	bool map_heap_file(int fd, const char* path, std::size_t reserve_size, void* address, Heap_Backing backing);
+
+	/**
+	 * @brief Checks the chunk list of a heap file mapped at heap_start, sets used_heap_size from it
+	 * and rebuilds the BST.
+	 * @param used Bytes covered by chunks, as recorded in the header; 0 for an empty heap.
+	 * @param reopened The file was written by an earlier process: also frees the chunks it had
+	 * parked, drops its per process chunk state, and counts the restored chunks as allocations.
+	 * @return false if the chunk list is corrupt or the index could not be built.
+	 */
+	bool restore_persistent_heap(std::size_t used, bool reopened);
+
+	/**
+	 * @brief Takes the shared heap's mutex for the calling thread, and reloads the chunk index if
+	 * another process changed the heap since this one last held it. Nests.
+	 *
+	 * If the chunk list is corrupt, or the mutex was left unrecoverable by a process that found it
+	 * so, the mutex is released and the process falls back to an empty private heap (see
+	 * abandon_shared_heap()) rather than exiting.
+	 *
+	 * @return false if the shared heap was abandoned, in which case the mutex is not held.
+	 */
+	bool lock_shared_heap();
+
+	/**
+	 * @brief Publishes this process's heap bounds and releases the mutex taken by lock_shared_heap().
+	 */
+	void unlock_shared_heap();
+
+	/**
+	 * @brief Stops using a corrupt shared heap: drops its index and file descriptor and goes back to
+	 * an empty sbrk heap. The segment stays mapped, so objects the program holds remain readable.
+	 */
+	void abandon_shared_heap();
+
+	/**
+	 * @brief Points the heap at an empty sbrk heap starting at the program break. Shared by
+	 * detach_heap() and abandon_shared_heap().
+	 */
+	void use_empty_sbrk_heap();
+
+	/**
+	 * @brief Returns every node of the BST at `root` to the node free list.
+	 */
+	void release_bst(BST_Node* root);
+
+	/**
+	 * @brief Builds a balanced BST over the next `count` allocated chunks from `cursor` on.
+	 * @param cursor First chunk to consider, left after the last chunk used.
+	 */
+	BST_Node* build_bst(Chunk_Metadata*& cursor, std::size_t count);
+
+	/**
+	 * @brief Traces and counts a chunk handed out by a public allocation entry point.
+	 * @param size Requested size, as recorded in the trace.
+	 * @param ptr Payload of the chunk, ignored if nullptr.
+	 */
+	void note_allocation(std::size_t size, void* ptr);
+
+	/**
+	 * @brief Traces and counts a chunk given back through a public deallocation entry point.
+	 *
+	 * Must be called while the chunk still has its allocated size, i.e. before coalescing.
+	 * Pointers outside the heap are ignored; the caller rejects them.
+	 */
+	void note_free(void* ptr);
+
+	/**
+	 * @brief Traces and counts a chunk reclaimed by the sweep phase.
+	 */
+	void note_gc_free(Chunk_Metadata* chunk);
+
+	/**
+	 * @brief Allocates a chunk whose payload is aligned to `alignment`.
+	 *
+	 * The leading slack of an over-sized chunk is returned to the heap as a free chunk. A request
+	 * that cannot be padded without exceeding MAX_ALLOCATION_SIZE goes to the out-of-memory path.
+	 *
+	 * @param size The size of memory to allocate in bytes.
+	 * @param alignment Required alignment, must be a power of two.
+	 * @return Pointer to the aligned memory, or nullptr if the allocation fails.
+	 */
+	void* allocate_aligned(std::size_t size, std::size_t alignment);
+
+	/**
+	 * @brief Rounds a request size up to a multiple of ALIGNMENT.
+	 */
+	static std::size_t align_size(std::size_t size) {
+		return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	/**
+	 * @brief Splits a free region into `count` allocated chunks of `size` bytes.
+	 *
+	 * The region must be at least `span` bytes. The remainder becomes a trailing free chunk when it
+	 * can hold a metadata header.
+	 *
+	 * @param region Free chunk to split.
+	 * @param size The size of each chunk in bytes.
+	 * @param count Number of chunks to carve out.
+	 * @param span Bytes the chunks cover, `count * size + (count - 1) * sizeof(Chunk_Metadata)`,
+	 * as computed and overflow checked by allocate_batch().
+	 * @param out_ptrs Array that receives the chunk pointers.
+	 */
+	void carve_chunks(Chunk_Metadata* region, std::size_t size, std::size_t count, std::size_t span, void** out_ptrs);
+
 	/**
 	 * @brief Allocates a BST node for a memory chunk.
 	 * @param size The size of the chunk.
@@ -215,6 +757,13 @@ private:
 	 */
 	void deallocate_node(BST_Node* node);
 
+	/**
+	 * @brief Threads a freshly obtained pool of BST nodes onto the free list.
+	 * @param pool First node of the pool.
+	 * @param count Number of nodes in the pool.
+	 */
+	void add_node_pool(BST_Node* pool, std::size_t count);
+
 	/**
 	 * @brief Inserts a new chunk into the BST.
 	 * @param root The root node of the BST.
@@ -256,12 +805,33 @@ private:
 	void print_bst(BST_Node* root, int space = 0, int height = 10);
 
 	/**
-	* @brief Expands the heap by a specified size.
-	* @param size The size to expand the heap by.
-	* @return The new heap capacity after expansion.
+	* @brief Expands the heap so that an allocation of `size` bytes, metadata included, fits in a free chunk.
+	*
+	* The step is chosen by growth_step(). The new space becomes a free chunk at the end of the
+	* heap, merged with the last chunk if that one is free.
+	*
+	* @param size Bytes the failing allocation needs, including its metadata.
+	* @return 0 on success, 1 if the heap could not be expanded.
 	*/
 	int expand_heap(std::size_t size);
 
+	/**
+	 * @brief Returns how many bytes to grow the heap by when it is `size` bytes short, or 0 if
+	 *        the soft limit forbids growing.
+	 */
+	std::size_t growth_step(std::size_t size);
+
+	/**
+	 * @brief Returns the chunk at the end of the heap, or nullptr if there are no chunks.
+	 */
+	Chunk_Metadata* last_chunk() const;
+
+	/**
+	 * @brief Covers the space between the last chunk and the end of the heap with a free chunk.
+	 * @param last_chunk The chunk at the end of the heap (see last_chunk()), extended if it is free.
+	 */
+	void append_free_space(Chunk_Metadata* last_chunk);
+
 
 
 	/**
@@ -291,8 +861,106 @@ private:
 	 * @param top Pointer to the metadata of the top chunk to analyze.
 	 * @param root_chunk_list An array to store pointers to chunks found within the top chunk.
 	 * @param root_chunk_list_size Reference to the current size of the root chunk list, updated as new chunks are added.
+	 * @param overflow Set when a chunk is dropped because the root chunk list is full.
 	 */
-	void find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_list[], int& root_chunk_list_size);
+	void find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_list[], int& root_chunk_list_size, bool& overflow);
+
+	/**
+	 * Scans every marked chunk again and marks what it references, after the collector's root
+	 * list overflowed and dropped chunks that must still be marked.
+	 */
+	void gc_rescan_marked();
+
+	/**
+	 * Pushes every allocated pinned chunk on the collector's root list so that the chunks
+	 * they reference survive the collection.
+	 *
+	 * @return Number of pinned chunks pushed.
+	 */
+	std::size_t gc_add_pinned_roots();
+
+	/**
+	 * Pushes the allocated chunks referenced by the persistent heap's root table on the
+	 * collector's root list.
+	 *
+	 * @return Number of chunks pushed.
+	 */
+	std::size_t gc_add_persistent_roots();
+
+	/**
+	 * Pushes every unmarked allocated chunk with a finalizer on the finalizer's open batch.
+	 */
+	void gc_find_finalizable(GC_Finalizer& finalizer);
+
+	/**
+	 * Adds up the free chunks and the space after the last chunk, which count as one free block
+	 * when they touch, and finds the largest free block.
+	 */
+	void gc_measure_free_space(std::size_t& free_bytes, std::size_t& largest_free_block) const;
+
+	/**
+	 * Computes where compaction moves each allocated chunk: the chunks slide towards heap_start in
+	 * address order, and those marked gc_fixed or gc_pinned stay where they are. Fills the
+	 * compactor's relocation table with the chunks that move.
+	 *
+	 * @param fixed Receives the number of allocated chunks that stay in place.
+	 * @return false if the relocation table could not grow, in which case nothing may move.
+	 */
+	bool gc_plan_compaction(GC_Compactor& compactor, std::uint64_t& fixed);
+
+	/**
+	 * Rewrites the pointer fields of every allocated chunk with a layout, before the chunks move.
+	 */
+	void gc_relocate_fields(const GC_Compactor& compactor);
+
+	/**
+	 * Moves the chunks as planned by gc_plan_compaction(), rebuilds the chunk list with one free
+	 * chunk per gap before a fixed chunk, rekeys the BST, and shrinks used_heap_size to the end of
+	 * the last chunk.
+	 */
+	void gc_move_chunks(const GC_Compactor& compactor);
+
+	/**
+	 * Reserves a destination for every movable chunk overlapping an evacuation candidate block: a
+	 * free chunk, or the space after the last chunk, outside the candidate blocks. Stops at the
+	 * first chunk for which there is no room or the relocation table cannot grow.
+	 */
+	void gc_plan_evacuation(GC_Compactor& compactor, const GC_Line_Map& lines);
+
+	/**
+	 * Copies the chunks planned by gc_plan_evacuation() to their destinations, marks the lines
+	 * they now occupy and frees their old chunks.
+	 */
+	void gc_evacuate_chunks(const GC_Compactor& compactor, GC_Line_Map& lines);
+
+	/**
+	 * Points the hole cursor at the first free chunk of a recycled block, or clears it if `lines`
+	 * is nullptr.
+	 */
+	void gc_find_holes(const GC_Line_Map* lines);
+
+	/**
+	 * Bumps an allocation into the hole under the cursor, moving the cursor over holes too small
+	 * for a request of at most a line. A larger request that does not fit the current hole
+	 * overflows to the best fit search, as medium objects do in Immix.
+	 *
+	 * @return The payload, or nullptr if the holes are used up or do not fit.
+	 */
+	void* allocate_from_holes(std::size_t size);
+
+	/**
+	 * Allocates the first `size` bytes of the free chunk `chunk`, splitting off the rest as a
+	 * free chunk when it can hold a header and a payload. Does not touch the BST.
+	 */
+	void take_free_chunk(Chunk_Metadata* chunk, std::size_t size);
+
+	/**
+	 * @brief Returns true if an allocation on the calling thread may start a collection: GC_ENABLED
+	 * and not on the finalizer thread, which runs while other threads are not stopped.
+	 */
+	bool may_collect() const {
+		return GC_ENABLED && !GC_Finalizer::on_finalizer_thread();
+	}
 	
 	/**
 	* Performs the sweep phase of the garbage collection process.
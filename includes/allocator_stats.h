@@ -0,0 +1,188 @@
+#ifndef ALLOCATOR_STATS_H
+#define ALLOCATOR_STATS_H
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Snapshot of the allocator's counters, returned by Allocator::get_stats().
+ *
+ * Byte counts are chunk sizes (the usable size of each chunk, excluding its metadata). Chunks
+ * parked in a quick list by sized deallocation count as freed, and count as allocated again
+ * when a later allocation picks them up.
+ */
+struct Allocator_Stats {
+    static const std::size_t SIZE_CLASSES = 21;     ///< Chunk sizes up to 16, 32, ..., 8 MB, and larger.
+
+    std::uint64_t bytes_allocated;                  ///< Total bytes handed out.
+    std::uint64_t bytes_freed;                      ///< Total bytes given back, explicitly or by the GC.
+    std::uint64_t live_bytes;                       ///< bytes_allocated - bytes_freed.
+    std::uint64_t allocations;                      ///< Number of chunks handed out.
+    std::uint64_t deallocations;                    ///< Number of chunks given back, explicitly or by the GC.
+    std::uint64_t quick_list_hits;                  ///< Allocations served from a quick list.
+
+    std::uint64_t live_chunks[SIZE_CLASSES];        ///< Allocated chunks per size class (see size_class()).
+    std::uint64_t allocations_per_class[SIZE_CLASSES]; ///< Chunks handed out per size class.
+
+    std::uint64_t splits;                           ///< Free chunks split to serve an allocation.
+    std::uint64_t coalesces;                        ///< Free chunks merged with a free neighbour.
+
+    std::uint64_t heap_expansions;                  ///< Successful heap expansions.
+    std::uint64_t heap_capacity;                    ///< Current heap capacity in bytes.
+    std::uint64_t heap_used;                        ///< Bytes of the heap covered by chunks, including metadata.
+
+    std::uint64_t gc_cycles;                        ///< Completed garbage collections.
+    std::uint64_t gc_chunks_reclaimed;              ///< Chunks freed by the sweep phase.
+    std::uint64_t gc_bytes_reclaimed;               ///< Bytes freed by the sweep phase.
+    std::uint64_t gc_pause_ns;                      ///< Total time spent in gc_collect().
+    std::uint64_t gc_compactions;                   ///< Collections that compacted the heap.
+    std::uint64_t gc_evacuations;                   ///< Collections that evacuated sparse blocks.
+    std::uint64_t gc_bytes_moved;                   ///< Bytes moved by compaction and evacuation.
+    std::uint64_t hole_allocations;                 ///< Allocations bumped into a hole of a recycled block.
+
+    std::uint64_t oom_events;                       ///< Allocations that could not grow the heap.
+    std::uint64_t low_memory_handler_calls;         ///< Calls to the Oom_Policy low-memory handler.
+    std::uint64_t emergency_gcs;                    ///< Collections run to recover from running out of memory.
+    std::uint64_t heap_trims;                       ///< Trims that returned memory to the OS.
+    std::uint64_t trimmed_bytes;                    ///< Bytes returned to the OS by trimming.
+    std::uint64_t oom_recoveries;                   ///< Out-of-memory allocations served after recovery.
+    std::uint64_t oom_failures;                     ///< Allocations that failed (returned nullptr, threw or exited).
+    std::uint64_t invalid_frees;                    ///< Deallocations of pointers that are not allocated chunks.
+
+    std::uint64_t finalizers_queued;                ///< Unreachable objects queued for their destructors.
+    std::uint64_t finalizers_run;                   ///< Destructors run by the finalizer thread.
+
+    /**
+     * @brief Returns the size class of a chunk: 0 for up to 16 bytes, k for up to 16 << k bytes.
+     */
+    static std::size_t size_class(std::size_t chunk_size) {
+        if (chunk_size <= 16) {
+            return 0;
+        }
+        std::size_t bits = 64 - static_cast<std::size_t>(__builtin_clzll(static_cast<unsigned long long>(chunk_size - 1)));
+        std::size_t index = bits - 4;
+        return index < SIZE_CLASSES ? index : SIZE_CLASSES - 1;
+    }
+};
+
+/**
+ * @class Allocator_Counters
+ * @brief The live counters behind Allocator_Stats.
+ *
+ * Every update happens with the heap already serialised (the allocator is single-threaded, and
+ * the malloc and operator new replacements hold the heap lock), so the counters use relaxed loads
+ * and stores rather than read-modify-write instructions. Updating one compiles to plain loads and
+ * stores, while another thread can still take a tear-free snapshot without taking the heap lock.
+ */
+class Allocator_Counters {
+public:
+    /**
+     * @brief A counter with a single writer and any number of concurrent readers.
+     */
+    class Counter {
+    public:
+        void add(std::uint64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+        void sub(std::uint64_t amount) { value.store(value.load(std::memory_order_relaxed) - amount, std::memory_order_relaxed); }
+        void set(std::uint64_t amount) { value.store(amount, std::memory_order_relaxed); }
+        std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<std::uint64_t> value{ 0 };
+    };
+
+    /**
+     * @brief Counts a chunk handed out to the caller.
+     */
+    void on_allocate(std::size_t chunk_size) {
+        std::size_t size_class = Allocator_Stats::size_class(chunk_size);
+        bytes_allocated.add(chunk_size);
+        allocations.add(1);
+        live_chunks[size_class].add(1);
+        allocations_per_class[size_class].add(1);
+    }
+
+    /**
+     * @brief Counts a chunk given back by the caller or reclaimed by the collector.
+     */
+    void on_free(std::size_t chunk_size) {
+        bytes_freed.add(chunk_size);
+        deallocations.add(1);
+        live_chunks[Allocator_Stats::size_class(chunk_size)].sub(1);
+    }
+
+    /**
+     * @brief Copies every counter into a snapshot.
+     */
+    Allocator_Stats snapshot() const {
+        Allocator_Stats stats;
+        stats.bytes_allocated = bytes_allocated.get();
+        stats.bytes_freed = bytes_freed.get();
+        stats.live_bytes = stats.bytes_allocated - stats.bytes_freed;
+        stats.allocations = allocations.get();
+        stats.deallocations = deallocations.get();
+        stats.quick_list_hits = quick_list_hits.get();
+        for (std::size_t i = 0; i < Allocator_Stats::SIZE_CLASSES; i++) {
+            stats.live_chunks[i] = live_chunks[i].get();
+            stats.allocations_per_class[i] = allocations_per_class[i].get();
+        }
+        stats.splits = splits.get();
+        stats.coalesces = coalesces.get();
+        stats.heap_expansions = heap_expansions.get();
+        stats.heap_capacity = heap_capacity.get();
+        stats.heap_used = heap_used.get();
+        stats.gc_cycles = gc_cycles.get();
+        stats.gc_chunks_reclaimed = gc_chunks_reclaimed.get();
+        stats.gc_bytes_reclaimed = gc_bytes_reclaimed.get();
+        stats.gc_pause_ns = gc_pause_ns.get();
+        stats.gc_compactions = gc_compactions.get();
+        stats.gc_evacuations = gc_evacuations.get();
+        stats.gc_bytes_moved = gc_bytes_moved.get();
+        stats.hole_allocations = hole_allocations.get();
+        stats.oom_events = oom_events.get();
+        stats.low_memory_handler_calls = low_memory_handler_calls.get();
+        stats.emergency_gcs = emergency_gcs.get();
+        stats.heap_trims = heap_trims.get();
+        stats.trimmed_bytes = trimmed_bytes.get();
+        stats.oom_recoveries = oom_recoveries.get();
+        stats.oom_failures = oom_failures.get();
+        stats.invalid_frees = invalid_frees.get();
+        stats.finalizers_queued = finalizers_queued.get();
+        stats.finalizers_run = finalizers_run.get();
+        return stats;
+    }
+
+    Counter bytes_allocated;
+    Counter bytes_freed;
+    Counter allocations;
+    Counter deallocations;
+    Counter quick_list_hits;
+    Counter live_chunks[Allocator_Stats::SIZE_CLASSES];
+    Counter allocations_per_class[Allocator_Stats::SIZE_CLASSES];
+    Counter splits;
+    Counter coalesces;
+    Counter heap_expansions;
+    Counter heap_capacity;
+    Counter heap_used;
+    Counter gc_cycles;
+    Counter gc_chunks_reclaimed;
+    Counter gc_bytes_reclaimed;
+    Counter gc_pause_ns;
+    Counter gc_compactions;
+    Counter gc_evacuations;
+    Counter gc_bytes_moved;
+    Counter hole_allocations;
+    Counter oom_events;
+    Counter low_memory_handler_calls;
+    Counter emergency_gcs;
+    Counter heap_trims;
+    Counter trimmed_bytes;
+    Counter oom_recoveries;
+    Counter oom_failures;
+    Counter invalid_frees;
+    Counter finalizers_queued;
+    Counter finalizers_run;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef ARENA_H
+#define ARENA_H
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @class Arena
+ * @brief A scoped bump-pointer allocator built on top of the Allocator.
+ *
+ * The arena requests large pinned blocks from the Allocator and hands out memory by
+ * advancing an offset inside the current block. Individual allocations are never freed;
+ * everything is released at once by `reset()` or when the arena is destroyed.
+ *
+ * Arenas can be nested: a child arena constructed from a parent shares the parent's
+ * blocks and, when it is reset or destroyed, rewinds the parent to the point where the
+ * child was created. The parent must not be used while a child is alive.
+ */
+class Arena {
+public:
+    static const std::size_t DEFAULT_BLOCK_SIZE = 64 * 1024;   ///< Default size of each block requested from the Allocator.
+
+    /**
+     * @brief Creates a top-level arena.
+     * @param block_size Size of each block requested from the Allocator.
+     */
+    explicit Arena(std::size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    /**
+     * @brief Creates a nested arena that allocates from the parent's blocks.
+     * @param parent The enclosing arena. It is rewound when this arena is destroyed.
+     */
+    explicit Arena(Arena& parent);
+
+    /**
+     * @brief Runs all registered destructors and releases the arena's memory.
+     */
+    ~Arena();
+
+    // Arenas own raw memory and registered destructors, so they cannot be copied
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Bump-allocates memory from the arena.
+     * @param size Number of bytes to allocate.
+     * @param alignment Required alignment, must be a power of two.
+     * @return Pointer to the allocated memory, or nullptr if the Allocator is out of memory.
+     */
+    void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * @brief Registers a destructor to run when the arena is reset or destroyed.
+     *
+     * Destructors run in the reverse order of registration.
+     *
+     * @param destructor Function invoked with the object pointer.
+     * @param object Pointer passed to the destructor.
+     * @return True if the record could be stored, false if the arena is out of memory.
+     */
+    bool register_destructor(void (*destructor)(void*), void* object);
+
+    /**
+     * @brief Constructs an object of type T inside the arena.
+     *
+     * If T is not trivially destructible its destructor is registered automatically.
+     *
+     * @tparam T The type of the object to construct.
+     * @tparam Args The types of the arguments forwarded to the constructor of T.
+     * @param args The arguments forwarded to the constructor of T.
+     * @return Pointer to the constructed object, or nullptr if the allocation fails.
+     */
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        if (!memory) {
+            return nullptr;
+        }
+
+        T* obj_ptr = new (memory) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            if (!register_destructor(&Arena::destroy<T>, obj_ptr)) {
+                obj_ptr->~T();
+                return nullptr;
+            }
+        }
+        return obj_ptr;
+    }
+
+    /**
+     * @brief Runs all registered destructors and releases everything allocated by this arena.
+     *
+     * A top-level arena keeps its first block for reuse. A nested arena rewinds its parent.
+     */
+    void reset();
+
+    /**
+     * @brief Returns the number of bytes handed out since the arena was created or last reset.
+     */
+    std::size_t bytes_allocated() const;
+
+private:
+    /**
+     * @brief Header placed at the start of every block obtained from the Allocator.
+     */
+    struct Block_Header {
+        Block_Header* prev;         ///< Previously allocated block, forming a chain back to the first block.
+        std::size_t capacity;       ///< Usable bytes following the header.
+    };
+
+    /**
+     * @brief Destructor record stored inside the arena itself.
+     */
+    struct Destructor_Record {
+        void (*destructor)(void*);  ///< Function that destroys the object.
+        void* object;               ///< Object to destroy.
+        Destructor_Record* next;    ///< Record registered before this one.
+    };
+
+    Arena* owner;                   ///< Top-level arena that owns the blocks (this for a top-level arena).
+    std::size_t block_size;         ///< Size of each block requested from the Allocator.
+
+    Block_Header* current_block;    ///< Block currently being bump-allocated (top-level arena only).
+    std::size_t offset;             ///< Offset of the next free byte inside current_block.
+    Destructor_Record* destructors; ///< Most recently registered destructor.
+    std::size_t allocated;          ///< Bytes handed out so far.
+
+    Block_Header* saved_block;              ///< Owner's block when this nested arena was created.
+    std::size_t saved_offset;               ///< Owner's offset when this nested arena was created.
+    Destructor_Record* saved_destructors;   ///< Owner's destructor list when this nested arena was created.
+    std::size_t saved_allocated;            ///< Owner's allocation count when this nested arena was created.
+
+    /**
+     * @brief Requests a new block large enough for `size` bytes at `alignment`.
+     * @return True on success.
+     */
+    bool grow(std::size_t size, std::size_t alignment);
+
+    /**
+     * @brief Runs destructors and frees blocks until the arena is back at the given state.
+     * @param block Block to rewind to, or nullptr to release every block.
+     * @param block_offset Offset inside `block` to rewind to.
+     * @param destructor_list Destructor list head to rewind to.
+     * @param allocated_bytes Allocation count to rewind to.
+     */
+    void rewind(Block_Header* block, std::size_t block_offset, Destructor_Record* destructor_list, std::size_t allocated_bytes);
+
+    template <typename T>
+    static void destroy(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+};
+
+#endif
@@ -3,21 +3,29 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 /**
  * @class Chunk_Metadata
  * @brief Holds metadata for each memory chunk in the heap.
  *
  * The metadata for each chunk includes its size, allocation status, and pointers to
- * the previous and next chunks in a doubly linked list.
+ * the previous and next chunks in a doubly linked list. The class is aligned to
+ * `alignof(std::max_align_t)` so that a payload following an aligned header is aligned as well.
  */
-class Chunk_Metadata {
+class alignas(alignof(std::max_align_t)) Chunk_Metadata {
 public:
     std::size_t chunk_size;         ///< Size of the current chunk (excluding metadata)
     bool is_free;                   ///< Flag to indicate if the chunk is free or not
+    bool gc_fixed;                  ///< Set during the mark phase if compaction must leave the chunk in place (see GC_Compactor)
+    std::uint32_t layout;           ///< Index of the type's pointer field layout (see GC_Compactor), 0 to scan the chunk conservatively
     Chunk_Metadata* prev;           ///< Pointer to the previous chunk in the list
     Chunk_Metadata* next;           ///< Pointer to the next chunk in the list
-    bool gc_mark;
+    bool gc_mark;                   ///< Set during the mark phase if the chunk is reachable
+    bool gc_pinned;                 ///< Pinned chunks are never swept and are scanned as GC roots
+    bool in_quick_list;             ///< Set while the chunk is parked in a size-class quick list
+    std::uint32_t finalizer;        ///< Index of the destructor thunk run before the chunk is reclaimed (see GC_Finalizer), 0 for none
+    std::size_t requested_size;     ///< Size the caller asked for when the chunk was handed out
 
     /**
      * @brief Constructs a Chunk_Metadata object with the specified size and allocation status.
@@ -25,7 +33,7 @@ public:
      * @param is_free Boolean flag indicating if the chunk is free or allocated.
      */
     Chunk_Metadata(std::size_t chunk_size, bool is_free)
-        : chunk_size(chunk_size), is_free(is_free), prev(nullptr), next(nullptr), gc_mark(!is_free) {}
+        : chunk_size(chunk_size), is_free(is_free), gc_fixed(false), layout(0), prev(nullptr), next(nullptr), gc_mark(!is_free), gc_pinned(false), in_quick_list(false), finalizer(0), requested_size(chunk_size) {}
 
     /**
      * @brief Retrieves a pointer to the data area of the current chunk, immediately following its metadata.
@@ -0,0 +1,89 @@
+#ifndef COMPRESSED_PTR_H
+#define COMPRESSED_PTR_H
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief Address compressed_ptr offsets count from: the Allocator's heap_start, kept up to date
+ * by the Allocator whenever the heap moves (see Allocator::set_heap_backing()).
+ */
+extern char* compressed_ptr_base;
+
+/**
+ * @class compressed_ptr
+ * @brief Pointer to an object in the Allocator's heap, stored as a 32-bit offset from its start.
+ *
+ * Half the size of a raw pointer, so linked structures whose nodes hold several links take less
+ * memory and fewer cache lines. Decoding is one add to compressed_ptr_base, after a test for the
+ * null offset; the first chunk's header sits at offset 0, so no object is ever there.
+ *
+ * The target must lie in the first 4 GB of the heap. Like a raw pointer, a compressed_ptr stored
+ * in a collected object is a plain link and not a root: declare it in the type's
+ * gc_pointer_fields `compressed_offsets` so the collector traces it and compaction rewrites it, or
+ * enable Garbage_Collector::set_compressed_scan() for objects without a layout.
+ *
+ * Usage: `struct Node { long value; compressed_ptr<Node> left, right; };`
+ *
+ * @tparam T The type of the object.
+ */
+template <typename T>
+class compressed_ptr {
+public:
+	compressed_ptr() noexcept : offset(0) {}
+
+	compressed_ptr(std::nullptr_t) noexcept : offset(0) {}
+
+	/**
+	 * @brief Compresses `ptr`, which must point into the heap (or be nullptr).
+	 */
+	compressed_ptr(T* ptr) noexcept : offset(encode(ptr)) {}
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	compressed_ptr(const compressed_ptr<U>& other) noexcept : offset(encode(other.get())) {}
+
+	compressed_ptr& operator=(T* ptr) noexcept {
+		offset = encode(ptr);
+		return *this;
+	}
+
+	compressed_ptr& operator=(std::nullptr_t) noexcept {
+		offset = 0;
+		return *this;
+	}
+
+	T* get() const noexcept {
+		return offset != 0 ? reinterpret_cast<T*>(compressed_ptr_base + offset) : nullptr;
+	}
+
+	T& operator*() const noexcept { return *get(); }
+	T* operator->() const noexcept { return get(); }
+	explicit operator bool() const noexcept { return offset != 0; }
+
+	/**
+	 * @brief Returns the stored offset from compressed_ptr_base, 0 for nullptr.
+	 */
+	std::uint32_t get_offset() const noexcept { return offset; }
+
+	bool operator==(const compressed_ptr& other) const noexcept { return offset == other.offset; }
+	bool operator!=(const compressed_ptr& other) const noexcept { return offset != other.offset; }
+	bool operator==(std::nullptr_t) const noexcept { return offset == 0; }
+	bool operator!=(std::nullptr_t) const noexcept { return offset != 0; }
+
+private:
+	std::uint32_t offset;		///< Bytes from compressed_ptr_base to the target, 0 for nullptr.
+
+	static std::uint32_t encode(T* ptr) noexcept {
+		if (ptr == nullptr) {
+			return 0;
+		}
+		std::ptrdiff_t distance = reinterpret_cast<const char*>(ptr) - compressed_ptr_base;
+		assert(distance > 0 && static_cast<std::uint64_t>(distance) <= UINT32_MAX && "compressed_ptr target outside the first 4 GB of the heap");
+		return static_cast<std::uint32_t>(distance);
+	}
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef DEBUG_LOG_H
+#define DEBUG_LOG_H
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/**
+ * @class Debug_Log
+ * @brief Output stream used for debug logging by the Allocator and the Garbage_Collector.
+ *
+ * The underlying `std::ostringstream` is only created when debugging is enabled. Otherwise
+ * every `<<` is a no-op, so the allocation paths neither format messages nor allocate memory
+ * through the system allocator. This keeps the allocator usable as a `malloc` replacement.
+ *
+ * While the log is creating or writing its stream, `is_writing()` returns true on that thread,
+ * so global operator new replacements can send those allocations elsewhere instead of re-entering
+ * the Allocator.
+ */
+class Debug_Log {
+public:
+    /**
+     * @brief Constructs the log.
+     * @param enabled Whether messages should be buffered and printed.
+     */
+    explicit Debug_Log(bool enabled) : stream(nullptr) {
+        if (enabled) {
+            Writing_Scope scope;
+            stream = new std::ostringstream();
+        }
+    }
+
+    ~Debug_Log() { delete stream; }
+
+    Debug_Log(const Debug_Log&) = delete;
+    Debug_Log& operator=(const Debug_Log&) = delete;
+
+    /**
+     * @brief Appends a value to the current message if logging is enabled.
+     */
+    template <typename T>
+    Debug_Log& operator<<(const T& value) {
+        if (stream) {
+            Writing_Scope scope;
+            *stream << value;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Prints the buffered message with an `[INFO]` prefix and clears the buffer.
+     */
+    void flush() {
+        if (stream) {
+            Writing_Scope scope;
+            std::cout << "[INFO]    " << stream->str() << '\n';
+            stream->str(""); // Clear out the contents after logging
+            stream->clear();
+        }
+    }
+
+    /**
+     * @brief Returns true while any Debug_Log on the calling thread is creating or writing its stream.
+     */
+    static bool is_writing() {
+        return writing_depth() > 0;
+    }
+
+private:
+    std::ostringstream* stream;     ///< Message buffer, nullptr when logging is disabled.
+
+    static int& writing_depth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    /**
+     * @brief Marks the calling thread as writing for the lifetime of the scope.
+     */
+    struct Writing_Scope {
+        Writing_Scope() { writing_depth()++; }
+        ~Writing_Scope() { writing_depth()--; }
+    };
+};
+
+#endif
@@ -3,16 +3,97 @@
 #pragma once
 
 #include "chunk_metadata.h"
+#include "debug_log.h"
+#include "gc_telemetry.h"
+#include "gc_pacer.h"
+#include "gc_finalizer.h"
+#include "gc_compactor.h"
+#include "gc_line_map.h"
+#include "heap_lock.h"
+#include <atomic>
+#include <csetjmp>
+#include <cstddef>
+#include <pthread.h>
 #include <sstream>
 #include <string>
 #include <iostream>
 
+struct GC_Root_List;
+
+/**
+ * @brief Root slot owned by a gc_ptr handle, linked into the list of live handles of the thread that rooted it.
+ */
+struct GC_Root_Slot {
+    void* ptr;                  ///< The handle's target; a root while the slot is linked.
+    GC_Root_Slot* prev;         ///< Previous live slot, or the list head.
+    GC_Root_Slot* next;         ///< Next live slot, or the list head; next free slot while on the free list.
+    std::atomic<GC_Root_List*> list;    ///< List the slot is linked into; changes when its thread unregisters.
+};
+
+/**
+ * @brief Circular list of live gc_ptr slots with its own free list.
+ *
+ * Every registered thread has one, and the collector has one more for unregistered threads. The
+ * spin lock is only contended when a handle is destroyed on another thread than the one that
+ * rooted it.
+ */
+struct GC_Root_List {
+    GC_Root_Slot head;                          ///< Sentinel of the circular list of live slots.
+    GC_Root_Slot* free_slots = nullptr;         ///< Slots not owned by any handle, linked through `next`.
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;   ///< Held while the list is changed.
+
+    GC_Root_List() {
+        head.ptr = nullptr;
+        head.prev = &head;
+        head.next = &head;
+    }
+
+    void lock() {
+        while (busy.test_and_set(std::memory_order_acquire)) {
+        }
+    }
+
+    void unlock() {
+        busy.clear(std::memory_order_release);
+    }
+};
+
+/**
+ * @brief How a gc_reference holds its target.
+ */
+enum GC_Reference_Strength : unsigned {
+    GC_REFERENCE_WEAK = 0,      ///< Cleared by every cycle that does not mark the target.
+    GC_REFERENCE_SOFT = 1,      ///< A root, except in cycles run because the heap is out of room; then treated as weak.
+};
+
+/**
+ * @brief Where a registered thread is with respect to a stop-the-world request.
+ */
+enum GC_Thread_State : unsigned {
+    GC_THREAD_RUNNING = 0,      ///< Running mutator code; the collector waits for it to reach a safepoint.
+    GC_THREAD_PARKED = 1,       ///< Waiting at a safepoint for the collection to finish.
+    GC_THREAD_BLOCKED = 2,      ///< Waiting for the heap lock or inside a GC_Blocking_Scope; does not touch the heap.
+};
+
+/**
+ * @brief Registry entry of a mutator thread.
+ */
+struct GC_Thread {
+    std::atomic<unsigned> state{GC_THREAD_RUNNING};     ///< A GC_Thread_State.
+    bool in_use = false;                ///< The entry belongs to a registered thread. Changed under the heap lock.
+    void* stack_base = nullptr;         ///< Highest address of the thread's stack.
+    void* stack_pointer = nullptr;      ///< Lowest live stack address while parked or blocked, registers are spilled above it.
+    unsigned lock_depth = 0;            ///< Heap lock acquisitions held by the thread through GC_Mutator_Guard.
+    GC_Root_List roots;                 ///< gc_ptr handles rooted by the thread.
+};
+
 /**
  * @class Garbage_Collector
  * @brief Implements a garbage collector for managing memory within a custom allocator.
  *
  * This class provides functionality to perform garbage collection on a custom heap.
- * It follows a mark-and-sweep algorithm to identify and reclaim unused memory chunks.
+ * It follows a mark-and-sweep algorithm to identify and reclaim unused memory chunks, and can
+ * compact the heap afterwards (see set_compaction_config()).
  * The garbage collector also supports logging and debugging to help with visualization
  * and testing of the memory management system.
  */
@@ -25,8 +106,170 @@ public:
     /**
      * @brief Initiates the garbage collection process.
      * This involves marking reachable chunks (mark phase) and reclaiming unused memory (sweep phase).
+     * Every cycle is timed phase by phase and recorded in the telemetry ring buffer.
+     * Does nothing while the heap is shared with other processes.
+     * @param trigger Why the cycle runs, as reported in its GC_Cycle_Record.
+     */
+    void gc_collect(GC_Trigger trigger = GC_TRIGGER_EXPLICIT);
+
+    /**
+     * @brief Sets a callback invoked with the record of every finished cycle. nullptr removes it.
+     * @param callback Invoked on the collecting thread; it must not allocate from the Allocator.
+     * @param context Passed back to the callback.
+     */
+    void set_cycle_callback(GC_Cycle_Callback callback, void* context = nullptr);
+
+    /**
+     * @brief Copies the most recent cycle records, oldest first.
+     * @param out Array of at least `max_records` records.
+     * @param max_records Maximum number of records to copy. At most GC_Telemetry::CAPACITY are kept.
+     * @return Number of records copied.
+     */
+    std::size_t get_cycle_records(GC_Cycle_Record* out, std::size_t max_records) const;
+
+    /**
+     * @brief Returns p50, p99 and max pause times over the most recent cycles.
+     */
+    GC_Pause_Summary get_pause_summary() const;
+
+    /**
+     * @brief Configures the adaptive collection trigger. See GC_Pacing_Config for the knobs.
+     *
+     * While pacing is enabled, a full heap is expanded without collecting first, since the pacer
+     * has already decided that a collection is not worth it yet. The heap-full collection is then
+     * only a last resort when the heap cannot be expanded.
+     */
+    void set_pacing_config(const GC_Pacing_Config& config);
+
+    const GC_Pacing_Config& get_pacing_config() const;
+
+    /**
+     * @brief Returns the pacer's current heap goal, trigger and measured rates.
+     */
+    const GC_Pacing_State& get_pacing_state() const;
+
+    /**
+     * @brief Enables or disables conservative root scanning.
+     *
+     * When enabled, every collection also takes as roots the heap pointers found in the calling
+     * thread's stack (from the collecting frame up to `stack_base`), in the callee-saved registers
+     * (spilled with setjmp) and in the writable segments (.data, .bss) of the program and its
+     * shared libraries. Roots no longer have to be registered: allocate(size, &root) skips the
+     * registration of variables on the scanned stack. Any word that looks like a pointer into an
+     * allocated chunk keeps that chunk alive.
+     *
+     * The stack of every thread registered with register_thread() is scanned as well, from the
+     * point where it parked or blocked. An unregistered collecting thread uses `stack_base`.
+     *
+     * @param enabled Whether to scan.
+     * @param stack_base Highest address of the stack to scan; nullptr looks up the calling thread's
+     * stack with pthread_getattr_np().
+     * @return false if the stack could not be found, in which case scanning stays disabled.
+     */
+    bool set_conservative_roots(bool enabled, void* stack_base = nullptr);
+
+    bool get_conservative_roots() const;
+
+    /**
+     * @brief Also reads every aligned 4-byte slot of a conservatively scanned chunk as a possible
+     * compressed_ptr, so that objects without a layout keep their compressed_ptr targets alive.
+     *
+     * Off by default: most small integers are also valid offsets, so scanning retains, and pins in
+     * place, more chunks than necessary. Types that declare their compressed_ptr fields in
+     * gc_pointer_fields are traced precisely either way.
+     */
+    void set_compressed_scan(bool enabled);
+
+    bool get_compressed_scan() const;
+
+    /**
+     * @brief Configures when a cycle compacts the heap after sweeping it. See GC_Compactor for
+     * which references compaction rewrites and which chunks it leaves in place.
+     */
+    void set_compaction_config(const GC_Compaction_Config& config);
+
+    const GC_Compaction_Config& get_compaction_config() const;
+
+    /**
+     * @brief Runs a collection that compacts the heap whatever the configuration says.
+     */
+    void gc_compact();
+
+    /**
+     * @brief Configures how the line marks are used: allocating into the holes of recycled blocks
+     * and evacuating sparse blocks. See GC_Line_Map for the blocks and lines.
      */
-    void gc_collect();
+    void set_region_config(const GC_Region_Config& config);
+
+    const GC_Region_Config& get_region_config() const;
+
+    /**
+     * @brief Registers the calling thread as a mutator.
+     *
+     * Once any thread is registered, every Allocator entry point and every collection takes the
+     * heap lock, and a collection stops the world: it waits until each other registered thread is
+     * parked at a safepoint or blocked, and resumes them when it is done. Safepoints are polled in
+     * allocate() and assign(); call safepoint() in long loops that do neither, and wrap blocking
+     * calls in a GC_Blocking_Scope. Every thread that uses the collected heap while another thread
+     * is registered must register, the main thread included.
+     *
+     * @param stack_base Highest address of the thread's stack; nullptr looks it up with pthread_getattr_np().
+     * @return false if MAX_THREADS threads are already registered or the stack could not be found.
+     */
+    bool register_thread(void* stack_base = nullptr);
+
+    /**
+     * @brief Unregisters the calling thread. Its gc_ptr handles stay roots and may be destroyed on any thread.
+     */
+    void unregister_thread();
+
+    /**
+     * @brief Returns the number of registered threads.
+     */
+    std::size_t get_registered_threads() const;
+
+    /**
+     * @brief Returns true while any thread is registered, i.e. while the heap is shared between threads.
+     */
+    bool threads_active() const {
+        return registered_threads.load(std::memory_order_relaxed) != 0;
+    }
+
+    /**
+     * @brief Parks the calling thread if a collection has asked the world to stop. One relaxed load otherwise.
+     */
+    void safepoint() {
+        if (stop_requested.load(std::memory_order_relaxed)) {
+            park();
+        }
+    }
+
+    static const std::size_t MAX_THREADS = 64;              ///< Registered threads at most.
+
+    /**
+     * @brief Starts the finalizer thread (see GC_Finalizer).
+     *
+     * From then on, unreachable objects created with allocate_new() or make_gc() whose type has a
+     * non-trivial destructor are not swept: they are queued, together with what they reference,
+     * and the finalizer thread runs their destructors outside the pause before deallocating them.
+     * Other chunks are swept as before. The thread registers as a mutator, so call this before
+     * other threads use the heap (see register_thread()). Allocations made by destructors never
+     * start a collection.
+     *
+     * @return false if the thread could not be started.
+     */
+    bool start_finalizer_thread();
+
+    /**
+     * @brief Waits for the queued destructors to run, then stops the finalizer thread.
+     * Later collections sweep finalizable objects without running their destructors.
+     */
+    void stop_finalizer_thread();
+
+    /**
+     * @brief Returns the number of objects waiting for their destructors.
+     */
+    std::size_t get_pending_finalizers();
 
 
     /**
@@ -37,9 +280,14 @@ public:
 
 
     friend class Allocator;
+    friend class GC_Mutator_Guard;
+    friend class GC_Blocking_Scope;
+    friend class GC_Finalizer;
+    template <typename T> friend class gc_ptr;
+    template <typename T, GC_Reference_Strength Strength> friend class gc_reference;
 
 private:
-    std::ostringstream out;                                  ///< Output stream for logging purposes.
+    Debug_Log out;                                           ///< Output stream for logging purposes.
     bool DEBUG_MODE;                                         ///< Flag to enable or disable debug logging.
 
     void** potential_stack_vars_containing_roots_list[1000]; ///< List of potential stack roots (pointers to root variables).
@@ -47,10 +295,36 @@ private:
                     
     void* root_chunk_list[1000];                             ///< List of identified root memory chunks in the heap.
     int root_chunk_list_size = 0;                            ///< Number of root memory chunks.
+    bool mark_overflow = false;                              ///< A chunk was dropped from the full root list since the last rescan.
 
     void* heap_start;                                        ///< Pointer to the start of the custom heap.
     std::size_t HEAP_CAPACITY;                               ///< Total capacity of the custom heap in bytes.
 
+    GC_Telemetry telemetry;                                  ///< Records of the most recent cycles.
+    GC_Cycle_Record cycle = {};                              ///< Record of the cycle in progress.
+    GC_Pacer pacer;                                          ///< Adaptive collection trigger, checked on every collecting allocation.
+
+    GC_Root_List root_slots;                                 ///< gc_ptr handles rooted by unregistered threads.
+    GC_Finalizer finalizer;                                  ///< Queue and thread running the destructors of collected objects.
+    GC_Root_List weak_refs;                                  ///< Slots of gc_weak_ptr references; not roots.
+    GC_Root_List soft_refs;                                  ///< Slots of gc_soft_ptr references; roots unless `clearing_soft_refs`.
+    bool clearing_soft_refs = false;                         ///< The cycle in progress clears soft references instead of marking from them.
+    GC_Compactor compactor;                                  ///< Compaction policy and relocation table.
+    GC_Line_Map lines;                                       ///< Line marks of the cycle in progress or last finished.
+    GC_Region_Config region_config;                          ///< Whether allocation recycles lines and cycles evacuate.
+    bool heap_shared = false;                                ///< The heap is shared with other processes: entry points lock it and collection is off.
+
+    GC_Thread threads[MAX_THREADS];                          ///< Thread registry.
+    std::atomic<std::size_t> registered_threads{0};          ///< Entries of `threads` in use.
+    std::atomic<bool> stop_requested{false};                 ///< A collection is waiting for, or holding, the world stopped.
+    pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;  ///< Guards the wait for `stop_requested` to clear.
+    pthread_cond_t resume = PTHREAD_COND_INITIALIZER;        ///< Signalled when the world is started again.
+    static thread_local GC_Thread* current_thread;           ///< Registry entry of the calling thread, nullptr if unregistered.
+
+    bool conservative_roots = false;                         ///< Scan the stack, registers and static data for roots.
+    bool compressed_scan = false;                            ///< Conservatively scanned chunks are read for compressed_ptr offsets too.
+    void* stack_base = nullptr;                              ///< Highest address of the stack scanned for roots.
+
     /**
      * @brief Private constructor to enforce singleton pattern.
      * @param debug_mode Whether debug logging is enabled.
@@ -82,6 +356,7 @@ private:
 
     /**
      * @brief Scans for root pointers (global or stack variables) that point to chunks within the heap.
+     * Also pushes the pinned chunks and the targets of live gc_ptr handles. Runs after unmark_chunks().
      */
     void get_roots();
 
@@ -105,9 +380,202 @@ private:
     /**
      * @brief Performs the mark phase of the garbage collection process.
      * Identifies all reachable memory chunks starting from root pointers.
+     *
+     * Chunks found while the root list is full are dropped and `mark_overflow` is set; every
+     * marked chunk is then scanned again until a pass drops nothing, so none is left unmarked.
      */
     void mark_phase();
 
+    /**
+     * @brief Pops and marks chunks off the root list, scanning each for more, until it is empty.
+     */
+    void drain_root_list();
+
+    /**
+     * @brief Queues the unreachable finalizable chunks for the finalizer thread and marks them and
+     * what they reference, so that the sweep leaves them alone. A chunk reachable from another
+     * queued chunk stays marked but unqueued until a later cycle.
+     */
+    void finalize_phase();
+
+    /**
+     * @brief Slides the allocated chunks towards the start of the heap after the sweep and rewrites
+     * the registered roots, the gc_ptr, weak and soft slots and the laid out pointer fields that
+     * refer to them. Chunks marked gc_fixed during this cycle stay in place.
+     */
+    void compact_phase();
+
+    /**
+     * @brief Moves the movable chunks out of the sparsest blocks into free space elsewhere, as
+     * far as it goes, and rewrites the references to them like compact_phase().
+     */
+    void evacuate_phase();
+
+    /**
+     * @brief Rewrites, through the relocation table, the registered roots, the gc_ptr, weak and
+     * soft slots and the laid out pointer fields, before any chunk moves.
+     */
+    void relocate_references();
+
+    /**
+     * @brief Rewrites the target of every slot of `list` that points into a moved chunk.
+     */
+    void relocate_slots(GC_Root_List& list);
+
+    /**
+     * @brief Pushes an allocated chunk on the root list unless it is already marked.
+     *
+     * Roots are pushed after unmark_chunks(), so when the list is full it is drained by marking
+     * instead of dropping the root.
+     *
+     * @return true if the chunk was pushed.
+     */
+    bool push_root(Chunk_Metadata* chunk);
+
+    /**
+     * @brief Links a slot holding `ptr` into the calling thread's handle list. O(1) unless the free list is empty.
+     * @return The slot, or nullptr if no slot pool could be mapped.
+     */
+    GC_Root_Slot* acquire_root_slot(void* ptr) {
+        return link_slot(current_thread != nullptr ? &current_thread->roots : &root_slots, ptr);
+    }
+
+    /**
+     * @brief Links a slot holding `ptr` into the weak or soft reference list. O(1) unless the free list is empty.
+     * @return The slot, or nullptr if no slot pool could be mapped.
+     */
+    GC_Root_Slot* acquire_reference_slot(GC_Reference_Strength strength, void* ptr) {
+        return link_slot(strength == GC_REFERENCE_WEAK ? &weak_refs : &soft_refs, ptr);
+    }
+
+    /**
+     * @brief Links a slot holding `ptr` into `list`, taking it from the list's free list.
+     */
+    GC_Root_Slot* link_slot(GC_Root_List* list, void* ptr) {
+        list->lock();
+        if (list->free_slots == nullptr && !add_root_slot_pool(list)) {
+            list->unlock();
+            return nullptr;
+        }
+        GC_Root_Slot* slot = list->free_slots;
+        list->free_slots = slot->next;
+
+        slot->ptr = ptr;
+        slot->list.store(list, std::memory_order_relaxed);
+        slot->prev = &list->head;
+        slot->next = list->head.next;
+        list->head.next->prev = slot;
+        list->head.next = slot;
+        list->unlock();
+        return slot;
+    }
+
+    /**
+     * @brief Unlinks a slot from its handle list and returns it to that list's free list. O(1).
+     */
+    void release_root_slot(GC_Root_Slot* slot) {
+        for (;;) {
+            // The slot moves to root_slots if its thread unregisters before the lock is taken
+            GC_Root_List* list = slot->list.load(std::memory_order_acquire);
+            list->lock();
+            if (slot->list.load(std::memory_order_relaxed) == list) {
+                slot->prev->next = slot->next;
+                slot->next->prev = slot->prev;
+                slot->next = list->free_slots;
+                list->free_slots = slot;
+                list->unlock();
+                return;
+            }
+            list->unlock();
+        }
+    }
+
+    /**
+     * @brief Maps another block of root slots onto the free list of `list`, which the caller holds.
+     * @return false if the block could not be mapped.
+     */
+    bool add_root_slot_pool(GC_Root_List* list);
+
+    /**
+     * @brief Pushes the targets of the handles in `list` on the root list.
+     */
+    void add_handle_roots(GC_Root_List& list);
+
+    /**
+     * @brief Clears the references in `list` whose target was not marked or is no longer allocated.
+     * @return Number of references cleared.
+     */
+    std::uint64_t clear_references(GC_Root_List& list);
+
+    /**
+     * @brief Returns true if any gc_soft_ptr holds a target.
+     */
+    bool has_soft_references();
+
+    /**
+     * @brief Takes the heap lock for a GC_Mutator_Guard, polling the safepoint first and counting as
+     * blocked while waiting, so that a collection running on the lock's holder does not wait for it.
+     */
+    void lock_heap_at_safepoint();
+
+    /**
+     * @brief Releases the heap lock taken by lock_heap_at_safepoint().
+     */
+    void unlock_heap_at_safepoint();
+
+    /**
+     * @brief Takes the mutex of a shared heap for a GC_Mutator_Guard. See Allocator::attach_shared_heap().
+     * @return false if the heap was found corrupt and abandoned, in which case the mutex is not held.
+     */
+    bool lock_shared_heap();
+
+    /**
+     * @brief Releases the mutex taken by lock_shared_heap().
+     */
+    void unlock_shared_heap();
+
+    /**
+     * @brief Waits at a safepoint until the collection that asked the world to stop has finished.
+     * Does nothing on an unregistered thread or one holding the heap lock.
+     */
+    void park();
+
+    /**
+     * @brief Marks the calling thread as blocked. Spills its callee-saved registers to `registers`,
+     * which must stay alive until leave_blocking().
+     */
+    void enter_blocking(std::jmp_buf& registers);
+
+    /**
+     * @brief Marks the calling thread as running again, first waiting for a collection in progress to finish.
+     */
+    void leave_blocking();
+
+    /**
+     * @brief Asks every other registered thread to stop and waits until each one is parked or
+     * blocked. Records the time to safepoint in the cycle in progress.
+     */
+    void stop_the_world();
+
+    /**
+     * @brief Resumes the threads stopped by stop_the_world().
+     */
+    void start_the_world();
+
+    /**
+     * @brief Pushes the chunks referenced from the stack, registers and static data on the root list.
+     *
+     * Runs after unmark_chunks(): whenever the root list fills up, it is drained by marking, so
+     * the scan never drops a root.
+     */
+    void scan_conservative_roots();
+
+    /**
+     * @brief Scans `[begin, end)` word by word for pointers into allocated chunks and pushes them.
+     * Skips the collector's and the allocator's own state, whose heap pointers are not roots.
+     */
+    void scan_range(void* begin, void* end);
+
     /**
      * @brief Adds a root pointer to the list of known GC roots.
      * @param root Pointer to the root variable.
@@ -116,4 +584,68 @@ private:
 
 };
 
+/**
+ * @class GC_Mutator_Guard
+ * @brief Serialises an Allocator entry point with the other threads while any thread is registered,
+ * and with the other processes while the heap is shared.
+ *
+ * Polls the safepoint and takes the heap lock, then the shared heap's mutex. Does nothing while
+ * no thread is registered and the heap is private, so single-threaded programs pay two loads.
+ */
+class GC_Mutator_Guard {
+public:
+    explicit GC_Mutator_Guard(Garbage_Collector& gc) : gc(gc), locked(gc.threads_active()), shared(gc.heap_shared) {
+        if (locked) {
+            gc.lock_heap_at_safepoint();
+        }
+        if (shared) {
+            shared = gc.lock_shared_heap();
+        }
+    }
+
+    ~GC_Mutator_Guard() {
+        if (shared) {
+            gc.unlock_shared_heap();
+        }
+        if (locked) {
+            gc.unlock_heap_at_safepoint();
+        }
+    }
+
+    GC_Mutator_Guard(const GC_Mutator_Guard&) = delete;
+    GC_Mutator_Guard& operator=(const GC_Mutator_Guard&) = delete;
+
+private:
+    Garbage_Collector& gc;
+    bool locked;
+    bool shared;
+};
+
+/**
+ * @class GC_Blocking_Scope
+ * @brief Marks the calling thread as blocked for the lifetime of the scope.
+ *
+ * Wrap calls that may block (I/O, waiting on other threads) so that a collection does not wait
+ * for the thread to reach a safepoint. Inside the scope the thread must not touch collected
+ * memory, gc_ptr handles included, nor call the Allocator. Leaving the scope waits for a
+ * collection in progress to finish.
+ */
+class GC_Blocking_Scope {
+public:
+    explicit GC_Blocking_Scope(Garbage_Collector& gc) : gc(gc) {
+        gc.enter_blocking(registers);
+    }
+
+    ~GC_Blocking_Scope() {
+        gc.leave_blocking();
+    }
+
+    GC_Blocking_Scope(const GC_Blocking_Scope&) = delete;
+    GC_Blocking_Scope& operator=(const GC_Blocking_Scope&) = delete;
+
+private:
+    Garbage_Collector& gc;
+    std::jmp_buf registers;         ///< Callee-saved registers at the start of the scope, scanned as part of the stack.
+};
+
 #endif
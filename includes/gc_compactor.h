@@ -0,0 +1,194 @@
+#ifndef GC_COMPACTOR_H
+#define GC_COMPACTOR_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief When the collector compacts the heap, set with Garbage_Collector::set_compaction_config().
+ *
+ * After the sweep, a cycle compacts when the free space is both large and scattered: at least
+ * `min_free_bytes` are free and the largest free block holds less than `1 - fragmentation_threshold`
+ * of them (see Heap_Report::external_fragmentation). Space after the last chunk counts as one free
+ * block.
+ */
+struct GC_Compaction_Config {
+    bool enabled = false;                       ///< When false, only Garbage_Collector::gc_compact() compacts.
+    double fragmentation_threshold = 0.5;       ///< 1 - largest free block / free bytes at which a cycle compacts.
+    std::size_t min_free_bytes = 256 * 1024;    ///< Free bytes below which fragmentation is ignored.
+};
+
+/**
+ * @brief Offsets of the pointer fields of a type, registered with GC_Compactor::register_layout().
+ */
+struct GC_Type_Layout {
+    const std::size_t* offsets;             ///< Byte offsets of the fields from the start of the object.
+    std::size_t count;                      ///< Number of offsets.
+    const std::size_t* compressed_offsets;  ///< Byte offsets of the compressed_ptr fields.
+    std::size_t compressed_count;           ///< Number of compressed offsets.
+};
+
+/**
+ * @brief A chunk moved by compaction.
+ */
+struct GC_Relocation {
+    char* from;                     ///< Payload address before the move.
+    char* to;                       ///< Payload address after the move.
+    std::size_t size;               ///< Chunk size; pointers into [from, from + size) move with the chunk.
+};
+
+/**
+ * @class GC_Compactor
+ * @brief Decides when to compact and maps old addresses to new ones while the heap is compacted.
+ *
+ * Compaction slides the allocated chunks towards the start of the heap, in address order, and
+ * rewrites the references the collector knows precisely: variables registered with
+ * allocate(size, &root) and assign(), gc_ptr, gc_weak_ptr and gc_soft_ptr handles, and the pointer
+ * and compressed_ptr fields of objects whose type has a layout (see gc_pointer_fields). Any other
+ * word that looks like a pointer cannot be rewritten, so the chunk it points to stays where it is
+ * for the cycle: chunks referenced from objects without a layout, from pinned chunks or by the
+ * conservative root scan, as well as pinned chunks and objects queued for finalization. The free
+ * chunks between such fixed chunks are merged and the space after the last chunk is left to future
+ * allocations.
+ *
+ * A raw pointer to a movable object that the collector does not know about, such as a local copy
+ * of gc_ptr::get() held across an allocation, is left dangling by a compaction. Enable
+ * conservative root scanning (Garbage_Collector::set_conservative_roots()) to keep such objects in
+ * place instead.
+ *
+ * The relocation table is mmapped, so compacting never allocates from the heap being compacted.
+ * Layouts live in a process-wide table of up to MAX_LAYOUTS types, like the finalizer thunks.
+ */
+class GC_Compactor {
+public:
+    static const std::size_t MAX_LAYOUTS = 4096;        ///< Distinct types with a layout at most.
+
+    /**
+     * @brief Adds a layout to the process-wide table. The offset arrays must outlive the program's use of it.
+     * @return Its index, or 0 (scan conservatively) if the table is full.
+     */
+    static std::uint32_t register_layout(const std::size_t* offsets, std::size_t count,
+                                         const std::size_t* compressed_offsets = nullptr, std::size_t compressed_count = 0);
+
+    /**
+     * @brief Returns the layout at `index`, or nullptr for 0 and unknown indices.
+     */
+    static const GC_Type_Layout* get_layout(std::uint32_t index);
+
+    void set_config(const GC_Compaction_Config& config) { this->config = config; }
+    const GC_Compaction_Config& get_config() const { return config; }
+
+    /**
+     * @brief Returns true if the configuration asks to compact a heap with these free blocks.
+     */
+    bool should_compact(std::size_t free_bytes, std::size_t largest_free_block) const;
+
+    /**
+     * @brief Empties the relocation table, keeping its mapping.
+     */
+    void clear() { count = 0; bytes = 0; }
+
+    /**
+     * @brief Appends a move. Moves must be added in increasing `from` order.
+     * @return false if the table could not grow.
+     */
+    bool add(void* from, void* to, std::size_t size);
+
+    std::size_t size() const { return count; }
+
+    /**
+     * @brief Returns the move at `index`, in increasing `from` order.
+     */
+    const GC_Relocation& at(std::size_t index) const { return moves[index]; }
+
+    /**
+     * @brief Returns the sizes of the moved chunks added up.
+     */
+    std::size_t moved_bytes() const { return bytes; }
+
+    /**
+     * @brief Returns where `ptr` points after compaction: moved by as much as its chunk if it
+     * points into a moved chunk, unchanged otherwise. O(log moves).
+     */
+    void* relocate(void* ptr) const;
+
+private:
+    GC_Compaction_Config config;                        ///< When to compact.
+    GC_Relocation* moves = nullptr;                     ///< Mapped array of moves, sorted by `from`.
+    std::size_t capacity = 0;                           ///< Entries the mapping holds.
+    std::size_t count = 0;                              ///< Entries in use.
+    std::size_t bytes = 0;                              ///< Sum of the entries' sizes.
+
+    /**
+     * @brief Doubles the mapping.
+     */
+    bool grow();
+};
+
+/**
+ * @brief Declares the pointer fields of T. Specialise it with a static array `offsets` of raw
+ * pointer fields, a static array `compressed_offsets` of compressed_ptr fields, or both:
+ *
+ *     template <> struct gc_pointer_fields<Node> {
+ *         static constexpr std::size_t offsets[] = { offsetof(Node, parent) };
+ *         static constexpr std::size_t compressed_offsets[] = { offsetof(Node, left), offsetof(Node, right) };
+ *     };
+ *
+ * Objects of T created with allocate_new() or make_gc() are then traced through these fields only,
+ * reading a 4-byte offset from each compressed field, and compaction updates them when it moves
+ * their targets. Each field must hold nullptr, a pointer outside the heap or a pointer into an
+ * allocated chunk. Without a specialisation every word of the object is a potential pointer, and
+ * what it references is never moved.
+ */
+template <typename T>
+struct gc_pointer_fields {};
+
+/**
+ * @brief True if gc_pointer_fields<T> declares raw pointer fields.
+ */
+template <typename T, typename = void>
+struct has_gc_pointer_fields : std::false_type {};
+
+template <typename T>
+struct has_gc_pointer_fields<T, decltype(void(gc_pointer_fields<T>::offsets))> : std::true_type {};
+
+/**
+ * @brief True if gc_pointer_fields<T> declares compressed_ptr fields.
+ */
+template <typename T, typename = void>
+struct has_gc_compressed_fields : std::false_type {};
+
+template <typename T>
+struct has_gc_compressed_fields<T, decltype(void(gc_pointer_fields<T>::compressed_offsets))> : std::true_type {};
+
+/**
+ * @brief Index of T's layout, registered on first use. 0 if T has no gc_pointer_fields.
+ */
+template <typename T>
+std::uint32_t layout_index() {
+    if constexpr (!has_gc_pointer_fields<T>::value && !has_gc_compressed_fields<T>::value) {
+        return 0;
+    }
+    else {
+        static const std::uint32_t index = [] {
+            const std::size_t* offsets = nullptr;
+            std::size_t count = 0;
+            const std::size_t* compressed_offsets = nullptr;
+            std::size_t compressed_count = 0;
+            if constexpr (has_gc_pointer_fields<T>::value) {
+                offsets = gc_pointer_fields<T>::offsets;
+                count = std::extent<decltype(gc_pointer_fields<T>::offsets)>::value;
+            }
+            if constexpr (has_gc_compressed_fields<T>::value) {
+                compressed_offsets = gc_pointer_fields<T>::compressed_offsets;
+                compressed_count = std::extent<decltype(gc_pointer_fields<T>::compressed_offsets)>::value;
+            }
+            return GC_Compactor::register_layout(offsets, count, compressed_offsets, compressed_count);
+        }();
+        return index;
+    }
+}
+
+#endif
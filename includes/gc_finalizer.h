@@ -0,0 +1,168 @@
+#ifndef GC_FINALIZER_H
+#define GC_FINALIZER_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <type_traits>
+
+class Garbage_Collector;
+
+/**
+ * @brief Runs the destructor of the object at `object` without releasing its memory.
+ */
+typedef void (*Finalizer_Thunk)(void* object);
+
+/**
+ * @brief An unreachable object waiting for its destructor to run.
+ */
+struct Finalizer_Entry {
+    void* object;                   ///< Payload of the chunk.
+    Finalizer_Thunk thunk;          ///< Destructor to run before the chunk is deallocated.
+};
+
+/**
+ * @class GC_Finalizer
+ * @brief Runs the destructors of collected objects on a background thread.
+ *
+ * Chunks store a 32-bit index into a process-wide table of destructor thunks, one entry per type,
+ * in Chunk_Metadata::finalizer. While the finalizer thread runs, a collection queues unreachable
+ * chunks with a thunk instead of sweeping them, and keeps them and everything they reference
+ * alive. The thread, registered as a mutator, runs each destructor outside the pause and then
+ * deallocates the chunk. Queued objects are roots until then.
+ *
+ * A chunk reachable from another queued chunk waits for a later cycle, so destructors see the
+ * objects they own intact. Finalizable chunks that reference each other in a cycle are never
+ * finalized.
+ *
+ * The queue is mmapped, so nothing here allocates from the heap it serves.
+ */
+class GC_Finalizer {
+public:
+    static const std::size_t MAX_THUNKS = 4096;         ///< Distinct finalizable types at most.
+
+    /**
+     * @brief Adds a thunk to the process-wide table.
+     * @return Its index, or 0 (no finalizer) if the table is full.
+     */
+    static std::uint32_t register_thunk(Finalizer_Thunk thunk);
+
+    /**
+     * @brief Returns the thunk at `index`, or nullptr for 0 and unknown indices.
+     */
+    static Finalizer_Thunk get_thunk(std::uint32_t index);
+
+    /**
+     * @brief Returns true on the finalizer thread, whose allocations never start a collection.
+     */
+    static bool on_finalizer_thread();
+
+    /**
+     * @brief Starts the finalizer thread and waits until it has registered with `gc`.
+     * @return false if the thread could not be started or registered.
+     */
+    bool start(Garbage_Collector& gc);
+
+    /**
+     * @brief Lets the finalizer thread drain the queue, then joins it.
+     */
+    void stop();
+
+    bool is_running() const { return running; }
+
+    /**
+     * @brief Starts a batch of candidates for the cycle in progress, compacting the queue first.
+     * @return Index of the batch's first entry.
+     */
+    std::size_t begin_batch();
+
+    /**
+     * @brief Appends a candidate to the batch. The thread does not see it before end_batch().
+     * @return false if the queue could not grow.
+     */
+    bool push(void* object, Finalizer_Thunk thunk);
+
+    /**
+     * @brief Returns the batch's entries, for the collector to filter in place.
+     */
+    Finalizer_Entry* batch(std::size_t first) { return entries + first; }
+
+    std::size_t batch_size(std::size_t first) const { return tail - first; }
+
+    /**
+     * @brief Queues the first `keep` entries of the batch, drops the rest, and wakes the thread.
+     */
+    void end_batch(std::size_t first, std::size_t keep);
+
+    /**
+     * @brief Number of entries still waiting, not counting the one being finalized.
+     */
+    std::size_t pending();
+
+    /**
+     * @brief Calls `visit(object)` for every queued object and the one being finalized.
+     * Called by the collector with the world stopped.
+     */
+    template <typename Visitor>
+    void for_each_object(Visitor visit) {
+        pthread_mutex_lock(&mutex);
+        for (std::size_t i = head; i < ready; i++) {
+            visit(entries[i].object);
+        }
+        if (in_progress != nullptr) {
+            visit(in_progress);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    Finalizer_Entry* entries = nullptr;                 ///< Mapped array; entries [head, ready) are queued, [ready, tail) the open batch.
+    std::size_t capacity = 0;                           ///< Entries the mapping holds.
+    std::size_t head = 0;                               ///< Next entry to finalize.
+    std::size_t ready = 0;                              ///< One past the last queued entry.
+    std::size_t tail = 0;                               ///< One past the last entry of the open batch.
+    void* in_progress = nullptr;                        ///< Object whose destructor is running.
+
+    Garbage_Collector* gc = nullptr;                    ///< Collector the thread is registered with.
+    pthread_t thread;                                   ///< The finalizer thread, valid while running.
+    bool running = false;                               ///< The thread has registered and not been stopped.
+    bool stopping = false;                              ///< stop() asked the thread to exit once the queue is empty.
+    bool started = false;                               ///< The thread has finished starting up, successfully or not.
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;  ///< Guards the queue and the flags above.
+    pthread_cond_t work = PTHREAD_COND_INITIALIZER;     ///< Signalled when entries are pushed, on stop and on start up.
+
+    /**
+     * @brief Body of the finalizer thread.
+     */
+    static void* thread_main(void* finalizer);
+
+    /**
+     * @brief Doubles the mapping. Called with `mutex` held.
+     */
+    bool grow();
+};
+
+/**
+ * @brief Destructor thunk of T.
+ */
+template <typename T>
+void destroy_finalizable(void* object) {
+    static_cast<T*>(object)->~T();
+}
+
+/**
+ * @brief Index of T's destructor thunk, registered on first use. 0 for trivially destructible T.
+ */
+template <typename T>
+std::uint32_t finalizer_index() {
+    if constexpr (std::is_trivially_destructible<T>::value) {
+        return 0;
+    }
+    else {
+        static const std::uint32_t index = GC_Finalizer::register_thunk(&destroy_finalizable<T>);
+        return index;
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef GC_LINE_MAP_H
+#define GC_LINE_MAP_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief How the collector uses the line marks, set with Garbage_Collector::set_region_config().
+ *
+ * Both are off by default. Recycling changes where small allocations land; evacuation moves
+ * objects, with the same rules as compaction (see GC_Compactor).
+ */
+struct GC_Region_Config {
+    bool recycle = false;                   ///< After a cycle, small allocations bump through the holes of recycled blocks first.
+    bool evacuate = false;                  ///< Cycles move the objects out of the sparsest blocks.
+    double evacuation_threshold = 0.25;     ///< Blocks with at most this fraction of their lines marked may be evacuated.
+    std::size_t max_evacuated_blocks = 8;   ///< Blocks evacuated per cycle at most, sparsest first.
+};
+
+/**
+ * @class GC_Line_Map
+ * @brief Side table of line marks over the heap, divided into blocks of lines as in Immix.
+ *
+ * The heap is cut into BLOCK_SIZE blocks of LINE_SIZE lines, counted from heap_start. The mark
+ * phase marks every line a reachable chunk overlaps, header included, and each block counts its
+ * marked lines. After the sweep a block is free if none of its lines are marked and recycled if
+ * some are: the free lines of a recycled block hold the holes that allocations can bump through.
+ * Blocks whose marked lines fall under the evacuation threshold are candidates for evacuation.
+ *
+ * The table is mmapped and grows with the heap, so the collector never allocates from the heap
+ * it is marking.
+ */
+class GC_Line_Map {
+public:
+    static const std::size_t LINE_SIZE = 256;                           ///< Bytes per line.
+    static const std::size_t BLOCK_SIZE = 32 * 1024;                    ///< Bytes per block.
+    static const std::size_t LINES_PER_BLOCK = BLOCK_SIZE / LINE_SIZE;  ///< Lines per block.
+
+    /**
+     * @brief Clears every mark and candidate and covers a heap of `heap_capacity` bytes.
+     * @return false if the table could not grow, in which case nothing is marked this cycle.
+     */
+    bool reset(void* heap_start, std::size_t heap_capacity);
+
+    /**
+     * @brief Marks the lines overlapping [begin, end).
+     */
+    void mark(const void* begin, const void* end);
+
+    std::size_t get_block_count() const { return blocks; }
+    std::size_t get_marked_lines(std::size_t block) const { return block_lines[block]; }
+
+    /**
+     * @brief Returns the lines marked over the whole heap.
+     */
+    std::size_t get_lines_marked() const { return lines_marked; }
+
+    /**
+     * @brief Returns the block holding `address`, which must lie in the heap.
+     */
+    std::size_t block_of(const void* address) const {
+        return static_cast<std::size_t>(static_cast<const char*>(address) - heap_start) / BLOCK_SIZE;
+    }
+
+    /**
+     * @brief Returns true if `block` has both marked and free lines.
+     */
+    bool is_recycled(std::size_t block) const {
+        return block < blocks && block_lines[block] != 0 && block_lines[block] < LINES_PER_BLOCK;
+    }
+
+    /**
+     * @brief Flags as evacuation candidates up to `max_blocks` blocks that have marked lines, but
+     * no more than `threshold` of them, sparsest first.
+     * @return The number of candidates.
+     */
+    std::size_t select_candidates(double threshold, std::size_t max_blocks);
+
+    /**
+     * @brief Returns true if [begin, end) overlaps a candidate block.
+     */
+    bool overlaps_candidate(const void* begin, const void* end) const;
+
+private:
+    const char* heap_start = nullptr;       ///< Address of line 0.
+    std::size_t blocks = 0;                 ///< Blocks covered.
+    std::size_t capacity = 0;               ///< Blocks the mapping holds.
+    std::size_t lines_marked = 0;           ///< Marked lines over every block.
+    unsigned char* line_marks = nullptr;    ///< One byte per line, LINES_PER_BLOCK per block.
+    std::uint16_t* block_lines = nullptr;   ///< Marked lines per block.
+    unsigned char* candidates = nullptr;    ///< Non-zero for the evacuation candidates.
+
+    /**
+     * @brief Replaces the mapping with one holding at least `block_count` blocks.
+     */
+    bool grow(std::size_t block_count);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef GC_PACER_H
+#define GC_PACER_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "gc_telemetry.h"
+
+/**
+ * @brief Knobs of the adaptive collection trigger, set with Garbage_Collector::set_pacing_config().
+ *
+ * After every cycle the pacer sets a heap goal of `live * (1 + gc_percent / 100)` bytes, and the
+ * next cycle starts once the program has allocated the difference between the goal and the live
+ * bytes. A higher `gc_percent` trades memory for fewer collections. `max_gc_cpu_fraction` raises
+ * the goal when, at the measured allocation and mark rates, collections would otherwise take more
+ * than that fraction of the program's time; `max_heap_goal` caps the goal in the other direction.
+ */
+struct GC_Pacing_Config {
+    bool enabled = false;                       ///< When false, collections only run when the heap is full or the root list fills up.
+    unsigned gc_percent = 100;                  ///< Growth of the heap goal over the live bytes, in percent (GOGC).
+    std::size_t min_heap_goal = 4 * 1024 * 1024;    ///< The goal never drops below this many bytes.
+    std::size_t max_heap_goal = 0;              ///< The goal never exceeds this many bytes; 0 for no cap. Takes precedence over the CPU limit.
+    double max_gc_cpu_fraction = 0.25;          ///< Target share of time spent collecting; 0 disables the adjustment.
+};
+
+/**
+ * @brief The pacer's measurements and current goal, returned by Garbage_Collector::get_pacing_state().
+ */
+struct GC_Pacing_State {
+    std::uint64_t heap_goal;                    ///< Live bytes the heap may reach before the next cycle.
+    std::uint64_t live_bytes;                   ///< Live bytes after the last cycle.
+    std::uint64_t runway_bytes;                 ///< Bytes allocated after the last cycle that trigger the next one.
+    std::uint64_t trigger_at;                   ///< Value of Allocator_Stats::bytes_allocated that triggers the next cycle.
+    double mark_rate;                           ///< Smoothed bytes marked per nanosecond of mark phase.
+    double allocation_rate;                     ///< Smoothed bytes allocated per nanosecond between cycles.
+    double gc_cpu_fraction;                     ///< Share of time spent in the last cycle since the one before it.
+};
+
+/**
+ * @class GC_Pacer
+ * @brief Decides when the next garbage collection should run, GOGC style.
+ *
+ * The allocation path only compares the allocator's running byte count with a precomputed
+ * threshold; everything else happens once per cycle in `on_cycle_end()`.
+ */
+class GC_Pacer {
+public:
+    GC_Pacer();
+
+    void set_config(const GC_Pacing_Config& config);
+    const GC_Pacing_Config& get_config() const { return config; }
+    const GC_Pacing_State& get_state() const { return state; }
+
+    bool is_enabled() const { return config.enabled; }
+
+    /**
+     * @brief Returns true once `bytes_allocated` (the allocator's running total) reaches the trigger.
+     */
+    bool should_collect(std::uint64_t bytes_allocated) const {
+        return config.enabled && bytes_allocated >= state.trigger_at;
+    }
+
+    /**
+     * @brief Updates the rates and sets the next trigger after a cycle.
+     * @param cycle Record of the cycle that just finished.
+     * @param live_bytes Bytes still allocated after the sweep.
+     * @param bytes_allocated The allocator's running total of allocated bytes.
+     */
+    void on_cycle_end(const GC_Cycle_Record& cycle, std::uint64_t live_bytes, std::uint64_t bytes_allocated);
+
+private:
+    static const std::size_t MIN_RUNWAY = 64 * 1024;   ///< Least allocation between two paced cycles, so a capped goal cannot collect on every allocation.
+
+    GC_Pacing_Config config;
+    GC_Pacing_State state;
+    std::uint64_t last_cycle_end_ns = 0;                ///< steady_clock time at which the last cycle finished, 0 before the first.
+    std::uint64_t allocated_at_last_cycle = 0;          ///< bytes_allocated when the last cycle finished.
+
+    /**
+     * @brief Sets the goal for `live_bytes` and the trigger measured from `bytes_allocated`.
+     */
+    void set_goal(std::uint64_t live_bytes, std::uint64_t bytes_allocated);
+};
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef GC_PTR_H
+#define GC_PTR_H
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "allocator.h"
+#include "garbage_collector.h"
+
+/**
+ * @class gc_ptr
+ * @brief RAII root handle for an object managed by the garbage collector.
+ *
+ * A non-empty handle owns a GC_Root_Slot, linked into the intrusive list of live handles of the
+ * thread that rooted it when the handle gets a target and unlinked when it is destroyed, both in
+ * O(1). Moving
+ * a handle hands its slot to the destination without touching the list, so the root set is
+ * exactly the targets of the live handles. Unlike add_gc_roots(), nothing is left behind for
+ * get_roots() to filter out.
+ *
+ * Destroying the last handle does not destroy the object; it becomes garbage for the next
+ * collection. A handle stored inside a collected object is a root as well, so links between
+ * collected objects should be plain pointers. Handles may be passed between registered threads
+ * (see Garbage_Collector::register_thread()); storing to a handle is not a safepoint, and two
+ * threads must not change the same handle concurrently.
+ *
+ * Usage: `gc_ptr<Node> head = make_gc<Node>(1);`
+ *
+ * @tparam T The type of the object.
+ */
+template <typename T>
+class gc_ptr {
+public:
+	gc_ptr() noexcept : slot(nullptr) {}
+
+	gc_ptr(std::nullptr_t) noexcept : slot(nullptr) {}
+
+	/**
+	 * @brief Roots `ptr`, which must point into a chunk allocated by the Allocator (or be nullptr).
+	 * @throws std::bad_alloc if no root slot could be mapped.
+	 */
+	explicit gc_ptr(T* ptr) : slot(nullptr) {
+		reset(ptr);
+	}
+
+	gc_ptr(const gc_ptr& other) : slot(nullptr) {
+		reset(other.get());
+	}
+
+	gc_ptr(gc_ptr&& other) noexcept : slot(other.slot) {
+		other.slot = nullptr;
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	gc_ptr(const gc_ptr<U>& other) : slot(nullptr) {
+		reset(other.get());
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	gc_ptr(gc_ptr<U>&& other) noexcept : slot(other.slot) {
+		// The slot stores a T*, which may differ from the U* for a base class at an offset
+		if (slot != nullptr) {
+			slot->ptr = static_cast<T*>(static_cast<U*>(slot->ptr));
+		}
+		other.slot = nullptr;
+	}
+
+	~gc_ptr() {
+		if (slot != nullptr) {
+			collector().release_root_slot(slot);
+		}
+	}
+
+	gc_ptr& operator=(const gc_ptr& other) {
+		reset(other.get());
+		return *this;
+	}
+
+	gc_ptr& operator=(gc_ptr&& other) noexcept {
+		if (this != &other) {
+			if (slot != nullptr) {
+				collector().release_root_slot(slot);
+			}
+			slot = other.slot;
+			other.slot = nullptr;
+		}
+		return *this;
+	}
+
+	gc_ptr& operator=(std::nullptr_t) noexcept {
+		if (slot != nullptr) {
+			slot->ptr = nullptr;
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief Points the handle at `ptr`, taking a root slot if the handle has none yet.
+	 * @throws std::bad_alloc if no root slot could be mapped.
+	 */
+	void reset(T* ptr = nullptr) {
+		if (slot != nullptr) {
+			slot->ptr = ptr;
+		}
+		else if (ptr != nullptr) {
+			slot = collector().acquire_root_slot(ptr);
+			if (slot == nullptr) {
+				throw std::bad_alloc();
+			}
+		}
+	}
+
+	T* get() const noexcept {
+		return slot != nullptr ? static_cast<T*>(slot->ptr) : nullptr;
+	}
+
+	T& operator*() const noexcept { return *get(); }
+	T* operator->() const noexcept { return get(); }
+	explicit operator bool() const noexcept { return get() != nullptr; }
+
+	/**
+	 * @brief Allocates a T and constructs it with `args`, rooted before the constructor runs.
+	 *
+	 * The constructor may allocate and so trigger a collection; the slot already holds the
+	 * chunk by then, and the chunk is pinned so that a compaction does not move it. As with
+	 * allocate_new(), a non-trivial destructor is run by the finalizer thread once the object is
+	 * unreachable, and declared pointer fields are recorded. Returns an empty handle if the
+	 * allocation fails. If the constructor throws, the chunk is freed and the exception propagates.
+	 */
+	template <typename... Args>
+	static gc_ptr make(Args&&... args) {
+		gc_ptr handle;
+		handle.slot = collector().acquire_root_slot(nullptr);
+		if (handle.slot == nullptr) {
+			throw std::bad_alloc();
+		}
+
+		void* memory = Allocator::getInstance().allocate(sizeof(T));
+		if (memory == nullptr) {
+			return handle;
+		}
+		handle.slot->ptr = memory;
+		Allocator::getInstance().set_pinned(memory, true);
+		try {
+			new (memory) T(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			// Freeing the chunk also drops the pin; the handle gives its slot back as it unwinds
+			handle.slot->ptr = nullptr;
+			Allocator::getInstance().deallocate(memory);
+			throw;
+		}
+		Allocator::getInstance().set_pinned(memory, false);
+		Allocator::getInstance().set_finalizer(memory, finalizer_index<T>());
+		Allocator::getInstance().set_layout(memory, layout_index<T>());
+		return handle;
+	}
+
+private:
+	template <typename U> friend class gc_ptr;
+
+	GC_Root_Slot* slot;		///< Root slot owned by this handle, nullptr until it first gets a target.
+
+	static Garbage_Collector& collector() {
+		return Allocator::getInstance().getGC();
+	}
+};
+
+/**
+ * @brief Allocates and constructs a T owned by a new gc_ptr. See gc_ptr::make().
+ */
+template <typename T, typename... Args>
+gc_ptr<T> make_gc(Args&&... args) {
+	return gc_ptr<T>::make(std::forward<Args>(args)...);
+}
+
+/**
+ * @class gc_reference
+ * @brief Weak or soft reference to an object managed by the garbage collector. Use the
+ *        gc_weak_ptr and gc_soft_ptr aliases.
+ *
+ * Like a gc_ptr, a non-empty reference owns a slot, here linked into the collector's weak or soft
+ * reference list, and is not a root. The collector sets the slot to nullptr when it reclaims the
+ * target:
+ * - a weak reference is cleared by every cycle whose mark phase does not reach the target;
+ * - a soft reference keeps its target alive, except in a cycle started because a heap-full
+ *   collection did not make room for the pending allocation (GC_TRIGGER_LOW_MEMORY) or because
+ *   the heap could not grow (GC_TRIGGER_EMERGENCY). Such a cycle clears every soft reference
+ *   whose target is not otherwise reachable, before the heap is expanded.
+ *
+ * get() returns a plain pointer, which a collection may invalidate; lock() returns a gc_ptr that
+ * keeps the target alive. Caches hold values through soft references and treat a cleared
+ * reference as a miss.
+ *
+ * @tparam T The type of the object.
+ * @tparam Strength GC_REFERENCE_WEAK or GC_REFERENCE_SOFT.
+ */
+template <typename T, GC_Reference_Strength Strength>
+class gc_reference {
+public:
+	gc_reference() noexcept : slot(nullptr) {}
+
+	gc_reference(std::nullptr_t) noexcept : slot(nullptr) {}
+
+	/**
+	 * @brief References `ptr`, which must point into a chunk allocated by the Allocator (or be nullptr).
+	 * @throws std::bad_alloc if no slot could be mapped.
+	 */
+	explicit gc_reference(T* ptr) : slot(nullptr) {
+		reset(ptr);
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	gc_reference(const gc_ptr<U>& target) : slot(nullptr) {
+		reset(target.get());
+	}
+
+	gc_reference(const gc_reference& other) : slot(nullptr) {
+		reset(other.get());
+	}
+
+	gc_reference(gc_reference&& other) noexcept : slot(other.slot) {
+		other.slot = nullptr;
+	}
+
+	~gc_reference() {
+		if (slot != nullptr) {
+			collector().release_root_slot(slot);
+		}
+	}
+
+	gc_reference& operator=(const gc_reference& other) {
+		reset(other.get());
+		return *this;
+	}
+
+	gc_reference& operator=(gc_reference&& other) noexcept {
+		if (this != &other) {
+			if (slot != nullptr) {
+				collector().release_root_slot(slot);
+			}
+			slot = other.slot;
+			other.slot = nullptr;
+		}
+		return *this;
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	gc_reference& operator=(const gc_ptr<U>& target) {
+		reset(target.get());
+		return *this;
+	}
+
+	gc_reference& operator=(std::nullptr_t) noexcept {
+		if (slot != nullptr) {
+			slot->ptr = nullptr;
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief Points the reference at `ptr`, taking a slot if the reference has none yet.
+	 * @throws std::bad_alloc if no slot could be mapped.
+	 */
+	void reset(T* ptr = nullptr) {
+		if (slot != nullptr) {
+			slot->ptr = ptr;
+		}
+		else if (ptr != nullptr) {
+			slot = collector().acquire_reference_slot(Strength, ptr);
+			if (slot == nullptr) {
+				throw std::bad_alloc();
+			}
+		}
+	}
+
+	/**
+	 * @brief Returns the target, or nullptr once it has been collected. Valid until the next collection.
+	 */
+	T* get() const noexcept {
+		return slot != nullptr ? static_cast<T*>(slot->ptr) : nullptr;
+	}
+
+	/**
+	 * @brief Returns a gc_ptr to the target, or an empty one if it has been collected.
+	 * @throws std::bad_alloc if no root slot could be mapped.
+	 */
+	gc_ptr<T> lock() const {
+		// Taking a root slot is not a safepoint, so the target cannot be collected in between
+		return gc_ptr<T>(get());
+	}
+
+	/**
+	 * @brief Returns true once the target has been collected, or if there never was one.
+	 */
+	bool expired() const noexcept {
+		return get() == nullptr;
+	}
+
+private:
+	GC_Root_Slot* slot;		///< Slot in the weak or soft reference list, nullptr until the reference first gets a target.
+
+	static Garbage_Collector& collector() {
+		return Allocator::getInstance().getGC();
+	}
+};
+
+/**
+ * @brief Reference cleared by the first collection that does not reach its target.
+ */
+template <typename T>
+using gc_weak_ptr = gc_reference<T, GC_REFERENCE_WEAK>;
+
+/**
+ * @brief Reference cleared only when the heap is out of room; see gc_reference.
+ */
+template <typename T>
+using gc_soft_ptr = gc_reference<T, GC_REFERENCE_SOFT>;
+
+template <typename T, typename U>
+bool operator==(const gc_ptr<T>& a, const gc_ptr<U>& b) noexcept {
+	return a.get() == b.get();
+}
+
+template <typename T, typename U>
+bool operator!=(const gc_ptr<T>& a, const gc_ptr<U>& b) noexcept {
+	return a.get() != b.get();
+}
+
+template <typename T>
+bool operator==(const gc_ptr<T>& a, std::nullptr_t) noexcept {
+	return a.get() == nullptr;
+}
+
+template <typename T>
+bool operator!=(const gc_ptr<T>& a, std::nullptr_t) noexcept {
+	return a.get() != nullptr;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef GC_TELEMETRY_H
+#define GC_TELEMETRY_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Why a garbage collection cycle was started.
+ */
+enum GC_Trigger : unsigned {
+    GC_TRIGGER_EXPLICIT = 0,        ///< gc_collect() called by the program.
+    GC_TRIGGER_HEAP_FULL = 1,       ///< An allocation or batch did not fit in the heap's capacity.
+    GC_TRIGGER_ROOT_LIST_FULL = 2,  ///< add_gc_roots() found the potential root list full.
+    GC_TRIGGER_PACER = 3,           ///< Allocations since the last cycle reached the pacer's trigger.
+    GC_TRIGGER_EMERGENCY = 4,       ///< An allocation ran out of memory and the heap could not grow; soft references are cleared.
+    GC_TRIGGER_LOW_MEMORY = 5,      ///< A heap-full collection did not make room for the pending allocation; soft references are cleared.
+    GC_TRIGGER_COMPACT = 6,         ///< gc_compact() called by the program; the heap is compacted whatever its fragmentation.
+};
+
+/**
+ * @brief Returns a short name for a trigger, e.g. "heap_full".
+ */
+const char* gc_trigger_name(GC_Trigger trigger);
+
+/**
+ * @brief Timings and results of one garbage collection cycle.
+ *
+ * Timestamps and durations come from `std::chrono::steady_clock`. The phase durations do not add
+ * up to `pause_ns` exactly: the pause also covers stopping the other registered threads, flushing
+ * the quick lists and the bookkeeping between phases.
+ */
+struct GC_Cycle_Record {
+    std::uint64_t cycle;            ///< Cycle number, starting at 1.
+    GC_Trigger trigger;             ///< Why the cycle ran.
+    std::uint64_t start_ns;         ///< steady_clock time at which the cycle started.
+    std::uint64_t pause_ns;         ///< Duration of the whole cycle.
+    std::uint64_t safepoint_ns;     ///< Time until every other registered thread was parked or blocked, 0 without registered threads.
+    std::uint64_t get_roots_ns;     ///< Duration of get_roots().
+    std::uint64_t unmark_ns;        ///< Duration of unmark_chunks().
+    std::uint64_t scan_ns;          ///< Duration of the conservative root scan, 0 unless enabled.
+    std::uint64_t mark_ns;          ///< Duration of mark_phase().
+    std::uint64_t sweep_ns;         ///< Duration of sweep_phase().
+    std::uint64_t compact_ns;       ///< Duration of compact_phase(), 0 if the cycle did not compact.
+    std::uint64_t evacuate_ns;      ///< Duration of evacuate_phase(), 0 if the cycle did not evacuate.
+    std::uint64_t threads_stopped;  ///< Registered threads stopped for the cycle, the collecting thread excluded.
+    std::uint64_t roots;            ///< Root chunks found, including pinned chunks and gc_ptr targets.
+    std::uint64_t conservative_roots;   ///< Root chunks found by the conservative scan.
+    std::uint64_t chunks_marked;    ///< Chunks found reachable.
+    std::uint64_t bytes_marked;     ///< Sum of their chunk sizes.
+    std::uint64_t lines_marked;     ///< Heap lines overlapped by the marked chunks (see GC_Line_Map).
+    std::uint64_t chunks_freed;     ///< Chunks reclaimed by the sweep.
+    std::uint64_t bytes_swept;      ///< Sum of their chunk sizes.
+    std::uint64_t finalizers_queued;    ///< Unreachable chunks handed to the finalizer thread instead of being swept.
+    std::uint64_t weak_cleared;     ///< gc_weak_ptr references cleared because their target was not marked.
+    std::uint64_t soft_cleared;     ///< gc_soft_ptr references cleared, only by low-memory and emergency cycles.
+    std::uint64_t chunks_moved;     ///< Chunks moved by compaction or evacuation.
+    std::uint64_t bytes_moved;      ///< Sum of their chunk sizes.
+    std::uint64_t chunks_fixed;     ///< Allocated chunks compaction had to leave in place (see GC_Compactor).
+    std::uint64_t blocks_recycled;  ///< Blocks with both marked and free lines after the mark phase.
+    std::uint64_t blocks_evacuated; ///< Sparse blocks chosen for evacuation.
+};
+
+/**
+ * @brief Pause time summary over the cycles still held by a GC_Telemetry ring buffer.
+ */
+struct GC_Pause_Summary {
+    std::uint64_t cycles;           ///< Cycles summarised (at most GC_Telemetry::CAPACITY).
+    std::uint64_t p50_ns;           ///< Median pause.
+    std::uint64_t p99_ns;           ///< 99th percentile pause.
+    std::uint64_t max_ns;           ///< Longest pause.
+    std::uint64_t total_ns;         ///< Sum of the pauses.
+    std::uint64_t max_safepoint_ns; ///< Longest time to safepoint.
+};
+
+/**
+ * @brief Callback invoked after every garbage collection cycle.
+ *
+ * Runs on the collecting thread, in the middle of the allocation that triggered the cycle, so it
+ * must not allocate from or free to the Allocator.
+ */
+typedef void (*GC_Cycle_Callback)(const GC_Cycle_Record& record, void* context);
+
+/**
+ * @class GC_Telemetry
+ * @brief Keeps the most recent garbage collection cycles in a fixed-size ring buffer.
+ *
+ * Storage is inline and summaries sort a copy on the stack, so nothing here allocates.
+ */
+class GC_Telemetry {
+public:
+    static const std::size_t CAPACITY = 256;            ///< Cycles kept before the oldest is overwritten.
+
+    /**
+     * @brief Stores a finished cycle and passes it to the callback, if one is set.
+     */
+    void record(const GC_Cycle_Record& cycle);
+
+    /**
+     * @brief Sets the callback invoked after every cycle. nullptr removes it.
+     */
+    void set_callback(GC_Cycle_Callback callback, void* context) {
+        this->callback = callback;
+        callback_context = context;
+    }
+
+    /**
+     * @brief Copies up to `max_records` of the most recent cycles to `out`, oldest first.
+     * @return Number of records copied.
+     */
+    std::size_t get_records(GC_Cycle_Record* out, std::size_t max_records) const;
+
+    /**
+     * @brief Returns the most recent cycle, or nullptr if no cycle has run.
+     */
+    const GC_Cycle_Record* last() const {
+        return count == 0 ? nullptr : &records[(next + CAPACITY - 1) % CAPACITY];
+    }
+
+    /**
+     * @brief Summarises the pauses of the cycles in the buffer.
+     */
+    GC_Pause_Summary summary() const;
+
+    /**
+     * @brief Total number of cycles recorded, including those already overwritten.
+     */
+    std::uint64_t total_cycles() const { return cycles; }
+
+private:
+    GC_Cycle_Record records[CAPACITY];                  ///< Ring buffer of cycles.
+    std::size_t next = 0;                               ///< Slot the next cycle is written to.
+    std::size_t count = 0;                              ///< Number of valid records, up to CAPACITY.
+    std::uint64_t cycles = 0;                           ///< Cycles recorded since startup.
+    GC_Cycle_Callback callback = nullptr;               ///< Invoked after every cycle.
+    void* callback_context = nullptr;                   ///< Passed back to `callback`.
+};
+
+#endif
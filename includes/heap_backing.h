@@ -0,0 +1,43 @@
+#ifndef HEAP_BACKING_H
+#define HEAP_BACKING_H
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Where the heap's memory comes from, set with Allocator::set_heap_backing().
+ *
+ * The huge page backings reserve the whole address range up front, aligned to
+ * Heap_Growth_Policy::HUGE_PAGE_SIZE, and grow the heap's capacity inside it in whole huge pages.
+ * The heap stays contiguous, so the collector and the chunk list work unchanged. The file
+ * and shared backings reserve their range the same way but grow in base pages, extending the file
+ * or segment with the heap.
+ */
+enum Heap_Backing : unsigned {
+    HEAP_BACKING_SBRK = 0,          ///< Grow at the program break (default).
+    HEAP_BACKING_THP = 1,           ///< Anonymous mapping advised with MADV_HUGEPAGE; pages are backed on first touch.
+    HEAP_BACKING_HUGETLB = 2,       ///< MAP_HUGETLB mapping; the reservation is taken from the kernel's huge page pool up front.
+    HEAP_BACKING_FILE = 3,          ///< Shared mapping of a heap file, see Allocator::open_persistent_heap().
+    HEAP_BACKING_SHARED = 4,        ///< Shared memory segment several processes allocate from, see Allocator::attach_shared_heap().
+};
+
+/**
+ * @brief Returns a short name for a backing: "sbrk", "thp", "hugetlb", "file" or "shared".
+ */
+inline const char* heap_backing_name(Heap_Backing backing) {
+    switch (backing) {
+    case HEAP_BACKING_SBRK:
+        return "sbrk";
+    case HEAP_BACKING_THP:
+        return "thp";
+    case HEAP_BACKING_HUGETLB:
+        return "hugetlb";
+    case HEAP_BACKING_FILE:
+        return "file";
+    case HEAP_BACKING_SHARED:
+        return "shared";
+    }
+    return "unknown";
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HEAP_GROWTH_POLICY_H
+#define HEAP_GROWTH_POLICY_H
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Called when growing the heap would take it past Heap_Growth_Policy::soft_limit.
+ *
+ * Runs inside the allocation that needs the space, so it must not allocate from or free to the
+ * Allocator.
+ *
+ * @param capacity Current heap capacity in bytes.
+ * @param requested Bytes the heap has to grow by to serve the allocation.
+ * @param context Heap_Growth_Policy::callback_context.
+ * @return true to grow past the limit anyway, false to fail the expansion.
+ */
+typedef bool (*Heap_Limit_Callback)(std::size_t capacity, std::size_t requested, void* context);
+
+/**
+ * @brief How expand_heap() grows the heap, set with Allocator::set_heap_growth_policy().
+ *
+ * Each expansion grows the capacity geometrically, by `capacity * (growth_factor - 1)` clamped to
+ * [min_step, max_step], or by the bytes the failing allocation needs if that is more. The new end
+ * of the heap is rounded up to a page, or to a huge page once the step is at least one huge page
+ * and `huge_page_rounding` is set, so the kernel can back the heap with transparent huge pages.
+ */
+struct Heap_Growth_Policy {
+    static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;  ///< Transparent huge page size on x86-64 and most arm64 kernels.
+
+    double growth_factor = 2.0;                     ///< Capacity after an expansion relative to before, at least 1.
+    std::size_t min_step = 256 * 1024;              ///< Smallest expansion in bytes.
+    std::size_t max_step = 64 * 1024 * 1024;        ///< Largest geometric expansion; a bigger allocation still gets what it needs.
+    bool huge_page_rounding = true;                 ///< Round large expansions to huge page boundaries.
+    std::size_t soft_limit = 0;                     ///< Capacity the heap should stay within; 0 for no limit.
+    Heap_Limit_Callback on_soft_limit = nullptr;    ///< Decides whether to exceed `soft_limit`; without one the expansion fails.
+    void* callback_context = nullptr;               ///< Passed back to `on_soft_limit`.
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef HEAP_LOCK_H
+#define HEAP_LOCK_H
+#pragma once
+
+/**
+ * @brief Process-wide recursive lock serialising entry points that may be called from any thread
+ *        (the malloc replacements and the global operator new/delete overrides).
+ *
+ * The lock is statically initialised and never allocates, so it is safe to take before the
+ * Allocator singleton exists. `install_heap_lock_fork_handlers` keeps it usable across `fork()`.
+ */
+void lock_heap();
+
+/**
+ * @brief Releases the lock taken by `lock_heap`.
+ */
+void unlock_heap();
+
+/**
+ * @brief Registers `pthread_atfork` handlers so that a child never inherits a held lock.
+ *
+ * Safe to call repeatedly; the handlers are only registered once.
+ */
+void install_heap_lock_fork_handlers();
+
+/**
+ * @struct Heap_Lock_Guard
+ * @brief Holds the heap lock for the lifetime of the guard.
+ */
+struct Heap_Lock_Guard {
+    Heap_Lock_Guard() { lock_heap(); }
+    ~Heap_Lock_Guard() { unlock_heap(); }
+
+    Heap_Lock_Guard(const Heap_Lock_Guard&) = delete;
+    Heap_Lock_Guard& operator=(const Heap_Lock_Guard&) = delete;
+};
+
+#endif
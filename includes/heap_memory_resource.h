@@ -0,0 +1,52 @@
+#ifndef HEAP_MEMORY_RESOURCE_H
+#define HEAP_MEMORY_RESOURCE_H
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * @class Heap_Memory_Resource
+ * @brief A `std::pmr::memory_resource` that routes every request into the Allocator singleton.
+ *
+ * Memory is allocated as pinned chunks, so it is never swept by the garbage collector and
+ * anything it references stays reachable. Deallocation passes the size through to the sized
+ * `Allocator::deallocate`, which skips the validating BST search and recycles small chunks via
+ * quick lists; larger chunks still descend the BST once to unlink their node.
+ *
+ * Install it with `std::pmr::set_default_resource(&Heap_Memory_Resource::getInstance())`
+ * to make every `std::pmr` container use the custom heap without further code changes.
+ */
+class Heap_Memory_Resource : public std::pmr::memory_resource {
+public:
+	/**
+	 * @brief Returns the singleton instance of the memory resource.
+	 * @return Reference to the singleton instance.
+	 */
+	static Heap_Memory_Resource& getInstance();
+
+	// Disable copy constructor and assignment operator to enforce singleton pattern
+	Heap_Memory_Resource(const Heap_Memory_Resource&) = delete;
+	Heap_Memory_Resource& operator=(const Heap_Memory_Resource&) = delete;
+
+private:
+	Heap_Memory_Resource() = default;
+
+	/**
+	 * @brief Allocates `bytes` bytes aligned to `alignment` from the Allocator.
+	 * @throws std::bad_alloc if the Allocator cannot satisfy the request.
+	 */
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+	/**
+	 * @brief Returns memory to the Allocator using the size-aware deallocation path.
+	 */
+	void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+
+	/**
+	 * @brief All instances share the same heap, so any two Heap_Memory_Resources compare equal.
+	 */
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+#endif
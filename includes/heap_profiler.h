@@ -0,0 +1,133 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Output formats of Heap_Profiler::write().
+ */
+enum Heap_Profile_Format : unsigned {
+    HEAP_PROFILE_PPROF = 0,     ///< Legacy text heap profile ("heap_v2") readable by `pprof`, followed by the process mappings.
+    HEAP_PROFILE_FOLDED = 1,    ///< One "outer;...;inner bytes" line per sample, for flamegraph.pl and similar tools.
+};
+
+/**
+ * @class Heap_Profiler
+ * @brief Samples allocations with their call stacks and tracks the samples until they are freed.
+ *
+ * Allocations are sampled on average once every `sample_interval` requested bytes, with the gap
+ * between samples drawn from an exponential distribution so that sampling does not alias with
+ * allocation patterns. An unsampled allocation costs one subtraction and one comparison.
+ *
+ * Samples live in a fixed-size hash table mapped with `mmap()`, stacks are captured with
+ * `backtrace()` and profiles are written with plain `write()` calls, so the profiler never
+ * allocates through the system allocator and can run underneath the malloc replacements.
+ * Once the table is full, further samples are dropped and counted in `dropped_samples()`.
+ */
+class Heap_Profiler {
+public:
+    static const std::size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;  ///< Average bytes between samples.
+    static const std::size_t MAX_DEPTH = 32;                        ///< Frames kept per sample.
+    static const std::size_t MAX_SAMPLES = 4096;                    ///< Live samples tracked at once.
+
+    Heap_Profiler() = default;
+
+    Heap_Profiler(const Heap_Profiler&) = delete;
+    Heap_Profiler& operator=(const Heap_Profiler&) = delete;
+
+    /**
+     * @brief Starts sampling, discarding any samples from an earlier run.
+     * @param sample_interval Average number of requested bytes between samples. 0 selects the default.
+     * @return false if the sample table could not be mapped.
+     */
+    bool start(std::size_t sample_interval);
+
+    /**
+     * @brief Stops sampling and releases the sample table.
+     */
+    void stop();
+
+    bool is_active() const { return table != nullptr; }
+
+    /**
+     * @brief Counts an allocation of `size` requested bytes and samples it when its turn comes.
+     */
+    void on_allocate(void* ptr, std::size_t size) {
+        if (table == nullptr) {
+            return;
+        }
+        if (size < bytes_until_sample) {
+            bytes_until_sample -= size;
+            return;
+        }
+        sample(ptr, size);
+    }
+
+    /**
+     * @brief Forgets the sample for `ptr`, if it was sampled.
+     */
+    void on_free(void* ptr) {
+        if (live_samples != 0) {
+            forget(ptr);
+        }
+    }
+
+    /**
+     * @brief Keys the sample for `from`, if it was sampled, by `to`, where compaction moved the chunk.
+     */
+    void on_move(void* from, void* to) {
+        if (live_samples != 0) {
+            move(from, to);
+        }
+    }
+
+    /**
+     * @brief Writes the live samples to `path`, creating or truncating it.
+     * @return false if the profiler is not running or the file could not be written.
+     */
+    bool write(const char* path, Heap_Profile_Format format) const;
+
+    std::size_t sample_count() const { return live_samples; }
+    std::size_t dropped_samples() const { return dropped; }
+
+private:
+    /**
+     * @brief One sampled allocation. A slot with `ptr == nullptr` is empty.
+     */
+    struct Sample {
+        void* ptr;
+        std::size_t size;
+        std::size_t depth;
+        void* frames[MAX_DEPTH];
+    };
+
+    static const std::size_t TABLE_SLOTS = MAX_SAMPLES * 2;         ///< Power of two, kept at most half full.
+
+    Sample* table = nullptr;                                        ///< Open-addressing table keyed by payload address.
+    std::size_t live_samples = 0;                                   ///< Occupied slots.
+    std::size_t dropped = 0;                                        ///< Samples lost because the table was full.
+    std::size_t interval = DEFAULT_SAMPLE_INTERVAL;                 ///< Mean bytes between samples.
+    std::size_t bytes_until_sample = 0;                             ///< Countdown to the next sample.
+    std::uint64_t random_state = 0;                                 ///< xorshift state for the sampling gaps.
+    bool in_sample = false;                                         ///< Set while capturing a stack, in case the unwinder allocates.
+
+    /**
+     * @brief Records a sample for `ptr` and draws the distance to the next one.
+     */
+    void sample(void* ptr, std::size_t size);
+
+    void forget(void* ptr);
+
+    void move(void* from, void* to);
+
+    /**
+     * @brief Returns a gap drawn from an exponential distribution with mean `interval`.
+     */
+    std::size_t next_gap();
+
+    static std::size_t slot_of(const void* ptr);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HEAP_REPORT_H
+#define HEAP_REPORT_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "allocator_stats.h"
+
+/**
+ * @brief Fragmentation analysis of the chunk list, returned by Allocator::analyze_heap().
+ *
+ * Unlike Allocator_Stats this is computed by walking every chunk, so it describes the heap at a
+ * single point in time. Chunks parked in a quick list are reported separately: they are neither
+ * live nor available to the best-fit search.
+ */
+struct Heap_Report {
+    std::uint64_t heap_capacity;                    ///< Bytes reserved for the heap.
+    std::uint64_t heap_used;                        ///< Bytes of the heap covered by chunks, including metadata.
+
+    std::uint64_t allocated_chunks;                 ///< Chunks handed out to the caller.
+    std::uint64_t allocated_bytes;                  ///< Sum of their chunk sizes.
+    std::uint64_t requested_bytes;                  ///< Sum of the sizes the caller asked for.
+    std::uint64_t parked_chunks;                    ///< Chunks parked in a quick list.
+    std::uint64_t parked_bytes;                     ///< Sum of their chunk sizes.
+    std::uint64_t free_chunks;                      ///< Free chunks in the list.
+    std::uint64_t free_bytes;                       ///< Sum of their chunk sizes.
+    std::uint64_t largest_free_block;               ///< Size of the largest free chunk.
+
+    std::uint64_t header_bytes;                     ///< Chunk metadata, one header per chunk.
+    std::uint64_t slack_bytes;                      ///< Allocated bytes beyond the requested size (alignment and unsplit remainders).
+
+    double external_fragmentation;                  ///< 1 - largest_free_block / free_bytes, 0 when nothing is free.
+    double internal_waste;                          ///< (header_bytes + slack_bytes) / heap_used, 0 for an empty heap.
+
+    std::uint64_t free_histogram_chunks[Allocator_Stats::SIZE_CLASSES];    ///< Free chunks per size class (see Allocator_Stats::size_class()).
+    std::uint64_t free_histogram_bytes[Allocator_Stats::SIZE_CLASSES];     ///< Free bytes per size class.
+};
+
+#endif
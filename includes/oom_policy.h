@@ -0,0 +1,45 @@
+#ifndef OOM_POLICY_H
+#define OOM_POLICY_H
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief What an allocation does once the heap is exhausted and recovery has failed.
+ */
+enum Oom_Mode : unsigned {
+    OOM_RETURN_NULL = 0,            ///< Return nullptr.
+    OOM_THROW_BAD_ALLOC = 1,        ///< Throw std::bad_alloc.
+    OOM_EXIT = 2,                   ///< Print an error and exit(1), as the allocator used to.
+};
+
+/**
+ * @brief Called when an allocation cannot be served, before the emergency collection.
+ *
+ * Runs inside the failing allocation. It may free memory to the Allocator (e.g. drop a cache),
+ * but allocations it makes fail immediately.
+ *
+ * @param requested Size of the failing allocation in bytes.
+ * @param context Oom_Policy::handler_context.
+ * @return true if memory was released and the allocation should be retried.
+ */
+typedef bool (*Low_Memory_Handler)(std::size_t requested, void* context);
+
+/**
+ * @brief How the Allocator recovers from running out of memory, set with Allocator::set_oom_policy().
+ *
+ * An allocation that cannot grow the heap first calls `low_memory_handler`, then runs an
+ * emergency garbage collection (only when automatic collection is enabled, since otherwise the
+ * collector does not know the program's roots) and trims the heap, retrying after each step.
+ * Only if every step fails does `mode` apply. Allocator_Stats counts each step.
+ */
+struct Oom_Policy {
+    Oom_Mode mode = OOM_RETURN_NULL;                ///< Outcome of an allocation that cannot be served.
+    Low_Memory_Handler low_memory_handler = nullptr;    ///< Gets a chance to release memory first.
+    void* handler_context = nullptr;                ///< Passed back to `low_memory_handler`.
+    bool emergency_gc = true;                       ///< Collect before giving up, if GC_ENABLED.
+    bool trim = true;                               ///< Return free space at the end of the heap to the OS before retrying.
+    bool exit_on_invalid_free = false;              ///< exit(1) when freeing a pointer that is not an allocated chunk, instead of ignoring it.
+};
+
+#endif
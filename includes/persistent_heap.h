@@ -0,0 +1,37 @@
+#ifndef PERSISTENT_HEAP_H
+#define PERSISTENT_HEAP_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+
+/**
+ * @brief First page of a heap file, opened with Allocator::open_persistent_heap() or
+ * Allocator::attach_shared_heap().
+ *
+ * The heap follows the header in the file, and the whole file is mapped shared at `base` minus
+ * the header, so the chunk list and every pointer stored in the heap stay valid across restarts,
+ * and in every process attached to a shared heap, without being rewritten. The root table is the
+ * entry point into the object graph.
+ */
+struct Persistent_Heap_Header {
+    static const std::uint64_t MAGIC = 0x5041454850415243ULL;  ///< Identifies a heap file.
+    static const std::uint32_t VERSION = 2;                     ///< Bumped when the file layout changes.
+    static const std::size_t MAX_ROOTS = 64;                    ///< Slots in the root table.
+
+    std::uint64_t magic;                ///< MAGIC.
+    std::uint32_t version;              ///< VERSION.
+    std::uint32_t metadata_size;        ///< sizeof(Chunk_Metadata) of the process that created the file.
+    std::uint64_t alignment;            ///< Allocator::ALIGNMENT of the process that created the file.
+    std::uint64_t header_size;          ///< Bytes before the heap in the file, a whole number of pages.
+    void* base;                         ///< Address the heap is mapped at.
+    std::uint64_t reserve;              ///< Address space reserved after `base`; the heap never grows past it.
+    std::uint64_t used_heap_size;       ///< Bytes covered by chunks at the last checkpoint, or when `lock` was last released.
+    std::uint64_t heap_capacity;        ///< Bytes of heap in the file, kept up to date like `used_heap_size`.
+    std::uint64_t generation;           ///< Bumped whenever a process releases `lock`, so the others know to reload their view.
+    pthread_mutex_t lock;               ///< Process-shared robust mutex serialising a shared heap; unused by a persistent heap.
+    void* roots[MAX_ROOTS];             ///< Payloads the program can find again after a restart.
+};
+
+#endif
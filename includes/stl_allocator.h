@@ -0,0 +1,67 @@
+#ifndef STL_ALLOCATOR_H
+#define STL_ALLOCATOR_H
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include "allocator.h"
+
+/**
+ * @class Stl_Allocator
+ * @brief A standard-conforming allocator adapter that routes container storage into the Allocator singleton.
+ *
+ * Storage is allocated as pinned chunks so the garbage collector never reclaims it, and
+ * `deallocate` forwards the element count as a size hint so the free path skips the validating
+ * BST search (unlinking a chunk that is not parked in a quick list still descends the BST once).
+ *
+ * Usage: `std::vector<int, Stl_Allocator<int>> values;`
+ *
+ * @tparam T The element type.
+ */
+template <typename T>
+class Stl_Allocator {
+public:
+	using value_type = T;
+
+	Stl_Allocator() noexcept = default;
+
+	template <typename U>
+	Stl_Allocator(const Stl_Allocator<U>&) noexcept {}
+
+	/**
+	 * @brief Allocates storage for `n` objects of type T.
+	 * @throws std::bad_array_new_length if the size overflows, std::bad_alloc if the heap is exhausted.
+	 */
+	T* allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+			throw std::bad_array_new_length();
+		}
+
+		void* memory = Allocator::getInstance().allocate_pinned(n == 0 ? 1 : n * sizeof(T), alignof(T));
+		if (!memory) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(memory);
+	}
+
+	/**
+	 * @brief Releases storage previously obtained from `allocate(n)`.
+	 */
+	void deallocate(T* ptr, std::size_t n) noexcept {
+		Allocator::getInstance().deallocate(ptr, n * sizeof(T));
+	}
+};
+
+// Every Stl_Allocator draws from the same singleton heap, so all instances are interchangeable
+template <typename T, typename U>
+bool operator==(const Stl_Allocator<T>&, const Stl_Allocator<U>&) noexcept {
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const Stl_Allocator<T>&, const Stl_Allocator<U>&) noexcept {
+	return false;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @brief Header at the start of every allocation trace file.
+ */
+struct Trace_File_Header {
+    char magic[4];              ///< Always "ATRC".
+    std::uint32_t version;      ///< Format version, currently 1.
+    std::uint32_t record_size;  ///< sizeof(Trace_Record), to reject traces from incompatible builds.
+    std::uint32_t reserved;     ///< Zero.
+};
+
+/**
+ * @brief One allocator operation in a trace file.
+ *
+ * `id` is the payload address at recording time. Addresses are reused after a free, so a
+ * replayer maps each id to its own pointer when the allocation is replayed and drops the
+ * mapping when the matching free is replayed.
+ */
+struct Trace_Record {
+    std::uint64_t timestamp_ns; ///< Nanoseconds since the trace was started.
+    std::uint64_t id;           ///< Payload address of the chunk.
+    std::uint64_t op_size;      ///< Operation in the top 8 bits, requested size in the low 56 bits (0 for frees).
+
+    static const std::uint64_t SIZE_MASK = (std::uint64_t(1) << 56) - 1;
+
+    unsigned op() const { return static_cast<unsigned>(op_size >> 56); }
+    std::uint64_t size() const { return op_size & SIZE_MASK; }
+};
+
+/**
+ * @brief Operation codes stored in Trace_Record::op().
+ */
+enum Trace_Op : unsigned {
+    TRACE_ALLOCATE = 0,         ///< allocate, allocate_pinned, allocate_new or allocate_batch.
+    TRACE_FREE = 1,             ///< deallocate, free_ptr or deallocate_batch.
+    TRACE_GC_FREE = 2,          ///< Chunk reclaimed by the garbage collector's sweep.
+    TRACE_GC_MOVE = 3,          ///< Chunk moved by compaction; `id` is the old address and the size field holds the new one.
+};
+
+/**
+ * @class Trace_Recorder
+ * @brief Appends allocator operations to a compact binary trace file.
+ *
+ * Records are buffered in place and written with plain `write()` calls, so recording never
+ * allocates through the system allocator and can run underneath the malloc replacements.
+ * The buffer is only guaranteed to reach the file once `stop()` is called. A forked child
+ * inherits the open trace but never writes to it; its copy is dropped at the next flush.
+ */
+class Trace_Recorder {
+public:
+    Trace_Recorder() = default;
+
+    Trace_Recorder(const Trace_Recorder&) = delete;
+    Trace_Recorder& operator=(const Trace_Recorder&) = delete;
+
+    /**
+     * @brief Creates (or truncates) `path` and starts recording. Stops any trace already running.
+     * @return false if the file could not be created.
+     */
+    bool start(const char* path);
+
+    /**
+     * @brief Flushes the buffered records and closes the trace file.
+     */
+    void stop();
+
+    bool is_active() const { return fd >= 0; }
+
+    /**
+     * @brief Records one operation if a trace is running. `ptr == nullptr` is ignored.
+     */
+    void record(Trace_Op op, std::size_t size, const void* ptr) {
+        if (fd >= 0 && ptr != nullptr) {
+            append(op, size, ptr);
+        }
+    }
+
+private:
+    static const std::size_t BUFFER_RECORDS = 512;  ///< Records buffered between writes.
+
+    int fd = -1;                                    ///< Trace file descriptor, -1 when not recording.
+    pid_t owner = 0;                                ///< Process that started the trace.
+    std::uint64_t start_ns = 0;                     ///< Monotonic clock reading when the trace was started.
+    Trace_Record buffer[BUFFER_RECORDS];            ///< Records not yet written.
+    std::size_t buffered = 0;                       ///< Number of records in `buffer`.
+
+    void append(Trace_Op op, std::size_t size, const void* ptr);
+
+    /**
+     * @brief Writes `size` bytes to the trace file. Stops recording on a write error.
+     */
+    void write_all(const void* data, std::size_t size);
+
+    void flush();
+
+    /**
+     * @brief Closes the trace file without flushing.
+     */
+    void abandon();
+};
+
+#endif
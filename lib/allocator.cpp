@@ -4,29 +4,52 @@
 #include <cstddef>
 #include <string>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <pthread.h>
+#include <new>
 #include "chunk_metadata.h"
 #include "bst_node.h"
 #include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <garbage_collector.h>
+#include "compressed_ptr.h"
 
 #define LBR '\n'
 
-
-Allocator::Allocator(bool debug_mode):DEBUG_MODE(debug_mode), gc(NULL)
+// Out-of-class definitions so the constants can be bound to references (e.g. by the debug log)
+const std::size_t Allocator::INITIAL_HEAP_CAPACITY;
+const std::size_t Allocator::ALIGNMENT;
+const std::size_t Allocator::QUICK_LIST_MAX_SIZE;
+const std::size_t Allocator::QUICK_LIST_CAPACITY;
+const std::size_t Allocator::MAX_NODES;
+const std::size_t Allocator_Stats::SIZE_CLASSES;
+const std::uint64_t Persistent_Heap_Header::MAGIC;
+const std::uint32_t Persistent_Heap_Header::VERSION;
+const std::size_t Persistent_Heap_Header::MAX_ROOTS;
+thread_local unsigned Allocator::shared_lock_depth = 0;
+
+char* compressed_ptr_base = nullptr;
+
+Allocator::Allocator(bool debug_mode):DEBUG_MODE(debug_mode), gc(NULL), out(debug_mode)
 {       
     out << "INITILIZATING NODE POOL.." << LBR;
     log_info();
 
-    this->node_index = 0;
-    this->node_pool = static_cast<BST_Node*>(sbrk(MAX_NODES * sizeof(BST_Node)));
-    node_used = static_cast<bool*>(sbrk(MAX_NODES * sizeof(bool)));
+    this->free_nodes = nullptr;
+    BST_Node* node_pool = static_cast<BST_Node*>(sbrk(MAX_NODES * sizeof(BST_Node)));
 
-    if (node_pool == (void*)-1 || node_used == (void*)-1) {
+    // Without an initial pool, reserve_nodes() maps one on the first allocation (or fails it)
+    if (node_pool == (void*)-1) {
         std::cerr << "Failed to initialize node pool" << LBR;
-        exit(1);
     }
-
-    std::fill(node_used, node_used + MAX_NODES, false);
+    else {
+        add_node_pool(node_pool, MAX_NODES);
+    }
     
 
     out << "INITILIZATING HEAP.. " <<LBR;
@@ -35,14 +58,27 @@ Allocator::Allocator(bool debug_mode):DEBUG_MODE(debug_mode), gc(NULL)
     log_info();
     out << "Chunk Metadata Size : " << sizeof(Chunk_Metadata) << LBR;
     log_info();
+
+    // Align the program break so that every chunk payload is ALIGNMENT-aligned
+    std::uintptr_t brk_addr = reinterpret_cast<std::uintptr_t>(sbrk(0));
+    std::size_t padding = (ALIGNMENT - brk_addr % ALIGNMENT) % ALIGNMENT;
+    if (padding != 0 && sbrk(padding) == (void*)-1) {
+        std::cerr << "Failed to align initial heap space" << LBR;
+    }
+
+    // Start with an empty heap if the initial space is not available; allocations then go
+    // through expand_heap() and the out-of-memory path instead of failing here
     heap_start = sbrk(INITIAL_HEAP_CAPACITY);
+    HEAP_CAPACITY = INITIAL_HEAP_CAPACITY;
     if (heap_start == (void*)-1) {
         std::cerr << "Failed to allocate initial heap space" << LBR;
-        exit(1);
+        heap_start = reinterpret_cast<void*>(brk_addr + padding);
+        HEAP_CAPACITY = 0;
     }
 
-    HEAP_CAPACITY = INITIAL_HEAP_CAPACITY;
     used_heap_size = 0;
+    compressed_ptr_base = static_cast<char*>(heap_start);
+    stats.heap_capacity.set(HEAP_CAPACITY);
 
     out<<"Heap initialized at heap_start : " << heap_start << " with capacity of " << HEAP_CAPACITY << LBR;
     log_info();
@@ -51,8 +87,11 @@ Allocator::Allocator(bool debug_mode):DEBUG_MODE(debug_mode), gc(NULL)
 
 Allocator& Allocator::getInstance(bool debug_mode)
 {    
-    static Allocator instance(debug_mode); // Static instance created only once
-    return instance;
+    // Static instance created only once, in static storage and never destroyed, so that
+    // memory can still be released from other static destructors during program exit
+    alignas(Allocator) static unsigned char storage[sizeof(Allocator)];
+    static Allocator* instance = new (storage) Allocator(debug_mode);
+    return *instance;
 }
 
 // Private API called by Public allocate() API to prevent users from disabling gc_collect_flag
@@ -66,29 +105,45 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
     if (size <= 0) {
         return nullptr;
     }
-    
-    if (used_heap_size + size + sizeof(Chunk_Metadata) >= HEAP_CAPACITY) {
-        out << "Heap Size not sufficient: used_heap_size + size + sizeof(Chunk_Metadata) >= HEAP_CAPACITY " << used_heap_size + size + sizeof(Chunk_Metadata) << LBR;
+
+    // Rounding the size and adding a header must not wrap around
+    if (size > MAX_ALLOCATION_SIZE) {
+        return out_of_memory(size);
+    }
+
+    // Keep every chunk a multiple of ALIGNMENT so that payloads stay aligned
+    size = align_size(size);
+
+    if (gc_collect_flag && gc->pacer.should_collect(stats.bytes_allocated.get())) {
+        out << "Allocations since the last collection reached the pacer's trigger" << LBR;
         log_info();
+        gc->gc_collect(GC_TRIGGER_PACER);
+    }
 
-        // If there is no free space, then call the collect method in garbage collector
-        if (gc_collect_flag){
-            out << "Calling Garbage Collector to collect free space" << LBR;
-            log_info();
-            gc->gc_collect();
-            return allocate(size, false);
-        }
+    // Every allocated chunk needs a BST node, get it before touching the heap
+    if (!reserve_nodes(1)) {
+        return out_of_memory(size);
+    }
 
-        // If there is still no space after gc collect then expand memory
-        if (expand_heap(size + sizeof(Chunk_Metadata)) != 0) {
-            // If OS does not provide more memory -> Throw error
-            std::cerr << "Error: HEAP OVERFLOW" << LBR;
-            exit(1);
+    // Reuse a chunk parked by sized deallocation without touching the heap or the BST
+    if (size <= QUICK_LIST_MAX_SIZE) {
+        std::size_t index = size / ALIGNMENT;
+        Chunk_Metadata* cached = quick_lists[index];
+        if (cached != nullptr) {
+            quick_lists[index] = *reinterpret_cast<Chunk_Metadata**>(cached->currentChunk());
+            quick_list_counts[index]--;
+            cached->in_quick_list = false;
+            cached->gc_pinned = false;
+            stats.quick_list_hits.add(1);
+
+            out << "Quick list hit for size " << size << " -> " << cached << LBR;
+            log_info();
+            return cached->currentChunk();
         }
     }
-
+    
     // first chunk entry in heap    
-    if (used_heap_size == 0) {
+    if (used_heap_size == 0 && HEAP_CAPACITY > sizeof(Chunk_Metadata) && size < HEAP_CAPACITY - sizeof(Chunk_Metadata)) {
         out << "Creating first chunk " << LBR;
         log_info();
 
@@ -97,9 +152,12 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
         metadata->next = nullptr;
         metadata->prev = nullptr;
         metadata->is_free = false;
+        metadata->gc_pinned = false;
+        metadata->in_quick_list = false;
 
         // Update the used_heap_size to include metadata and the requested chunk
         used_heap_size = sizeof(Chunk_Metadata) + size;
+        stats.heap_used.set(used_heap_size);
 
         // Return the pointer to the start of the chunk's data (after metadata)
         void* chunk_ptr = reinterpret_cast<void*>(
@@ -111,6 +169,14 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
         return chunk_ptr;
     }
 
+    // After a cycle, bump through the holes of recycled blocks before searching the whole heap
+    if (hole_cursor != nullptr && gc->region_config.recycle) {
+        void* chunk_ptr = allocate_from_holes(size);
+        if (chunk_ptr != nullptr) {
+            return chunk_ptr;
+        }
+    }
+
     // now if the used_heap_size is not 0
     // the look for free chunks in the heap first 
     // linear search the heap from heap_start to heap_start + used_heap_size 
@@ -154,6 +220,8 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
             out << "Perfect Fit Found" << LBR;
             log_info();
             best_fit->is_free = false; // Mark as allocated
+            best_fit->gc_pinned = false;
+            best_fit->in_quick_list = false;
             void* chunk_ptr = best_fit->currentChunk();
             allocated_chunks_root = insert_in_bst(allocated_chunks_root, chunk_ptr, size);
             return chunk_ptr;
@@ -180,6 +248,8 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
 
                 new_chunk->chunk_size = remaining_size;
                 new_chunk->is_free = true;
+                new_chunk->gc_pinned = false;
+                new_chunk->in_quick_list = false;
 
                 new_chunk->next = best_fit->next; 
                 new_chunk->prev = best_fit; 
@@ -190,6 +260,7 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
                 }
 
                 best_fit->chunk_size = size;
+                stats.splits.add(1);
 
                 out << "New chunk created at " << new_chunk << LBR
                     << " is_free=" << new_chunk->is_free << LBR
@@ -201,6 +272,8 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
         }
 
         best_fit->is_free = false; 
+        best_fit->gc_pinned = false;
+        best_fit->in_quick_list = false;
         void* chunk_ptr = best_fit->currentChunk();
         allocated_chunks_root = insert_in_bst(allocated_chunks_root, chunk_ptr, size);
 
@@ -214,34 +287,222 @@ void* Allocator::allocate(std::size_t size, bool gc_collect_flag)
         return chunk_ptr; 
     }
 
-    // If no suitable free chunk was found, append to the end
+    // If no suitable free chunk was found and there is no room to append one, make room
+    // (written as a subtraction from the capacity, which cannot wrap like the sum could)
+    if (HEAP_CAPACITY - used_heap_size <= sizeof(Chunk_Metadata) || size >= HEAP_CAPACITY - used_heap_size - sizeof(Chunk_Metadata)) {
+        out << "Heap Size not sufficient for " << size << " bytes, " << HEAP_CAPACITY - used_heap_size << " bytes left at the end of the heap" << LBR;
+        log_info();
+
+        // If there is no free space, then call the collect method in garbage collector.
+        // With pacing enabled the pacer decides when to collect, so grow the heap instead.
+        if (gc_collect_flag && !gc->pacer.is_enabled()){
+            out << "Calling Garbage Collector to collect free space" << LBR;
+            log_info();
+            collect_for_allocation(size);
+            return allocate(size, false);
+        }
+
+        // If there is still no space after gc collect then expand memory
+        if (expand_heap(size + sizeof(Chunk_Metadata)) != 0) {
+            // The pacer skipped the collection above, try it before giving up
+            if (gc_collect_flag) {
+                collect_for_allocation(size);
+                return allocate(size, false);
+            }
+
+            // If OS does not provide more memory -> recover or report it as the OOM policy says
+            return out_of_memory(size);
+        }
+
+        // The new space is a free chunk at the end of the heap, allocate from it
+        return allocate(size, false);
+    }
+
+    // Append the chunk to the end
     Chunk_Metadata* new_chunk = reinterpret_cast<Chunk_Metadata*>(
         reinterpret_cast<char*>(heap_start) + used_heap_size
     );
 
     new_chunk->chunk_size = size;
     new_chunk->is_free = false; 
+    new_chunk->gc_pinned = false;
+    new_chunk->in_quick_list = false;
     new_chunk->next = nullptr;
     new_chunk->prev = last_chunk;
     last_chunk->next = new_chunk;
    
     used_heap_size += sizeof(Chunk_Metadata) + size;
+    stats.heap_used.set(used_heap_size);
     void* chunk_ptr = new_chunk->currentChunk();
     allocated_chunks_root = insert_in_bst(allocated_chunks_root, chunk_ptr, size);
 
     return chunk_ptr;
 }
 
+void* Allocator::allocate_from_holes(std::size_t size)
+{
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+
+    // A coalesce may have merged the hole under the cursor into the chunk before it,
+    // find the chunk that now holds the cursor's address
+    if (stats.coalesces.get() != hole_epoch) {
+        char* position = reinterpret_cast<char*>(hole_cursor);
+        Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+        while (current->next != nullptr && reinterpret_cast<char*>(current->next) <= position) {
+            current = current->next;
+        }
+        hole_cursor = current;
+        hole_epoch = stats.coalesces.get();
+    }
+
+    while (hole_cursor != nullptr && reinterpret_cast<char*>(hole_cursor) < heap_end) {
+        if (hole_cursor->is_free) {
+            if (hole_cursor->chunk_size == size || hole_cursor->chunk_size > size + sizeof(Chunk_Metadata)) {
+                Chunk_Metadata* chunk = hole_cursor;
+                take_free_chunk(chunk, size);
+                hole_cursor = chunk->next;
+                stats.hole_allocations.add(1);
+
+                void* chunk_ptr = chunk->currentChunk();
+                allocated_chunks_root = insert_in_bst(allocated_chunks_root, chunk_ptr, size);
+                return chunk_ptr;
+            }
+            if (size > GC_Line_Map::LINE_SIZE) {
+                return nullptr;
+            }
+        }
+        hole_cursor = hole_cursor->next;
+    }
+
+    out << "Holes of recycled blocks used up" << LBR;
+    log_info();
+    hole_cursor = nullptr;
+    return nullptr;
+}
+
+void Allocator::take_free_chunk(Chunk_Metadata* chunk, std::size_t size)
+{
+    if (chunk->chunk_size > size + sizeof(Chunk_Metadata)) {
+        Chunk_Metadata* rest = reinterpret_cast<Chunk_Metadata*>(
+            reinterpret_cast<char*>(chunk) + sizeof(Chunk_Metadata) + size
+        );
+        rest->chunk_size = chunk->chunk_size - size - sizeof(Chunk_Metadata);
+        rest->is_free = true;
+        rest->gc_pinned = false;
+        rest->in_quick_list = false;
+        rest->prev = chunk;
+        rest->next = chunk->next;
+        if (rest->next != nullptr) {
+            rest->next->prev = rest;
+        }
+        chunk->next = rest;
+        chunk->chunk_size = size;
+        stats.splits.add(1);
+    }
+
+    chunk->is_free = false;
+    chunk->gc_pinned = false;
+    chunk->in_quick_list = false;
+}
+
 void* Allocator::allocate(std::size_t size, void** root)
 {
+    GC_Mutator_Guard guard(*gc);
+
     if (root != NULL) {
         out << "Allocate request -> root = " << root << LBR;
         log_info();
-        *root = allocate(size, GC_ENABLED);
+        *root = allocate(size, may_collect());
+        if (*root == nullptr) {
+            return nullptr;
+        }
+        note_allocation(size, *root);
         gc->add_gc_roots(root);
         return *root;
     }
-    return allocate(size, GC_ENABLED);
+    void* chunk_ptr = allocate(size, may_collect());
+    note_allocation(size, chunk_ptr);
+    return chunk_ptr;
+}
+
+void* Allocator::allocate_pinned(std::size_t size, std::size_t alignment)
+{
+    GC_Mutator_Guard guard(*gc);
+
+    out << "Received pinned allocation request for " << size << " aligned to " << alignment << LBR;
+    log_info();
+
+    void* chunk_ptr = alignment <= ALIGNMENT ? allocate(size, may_collect()) : allocate_aligned(size, alignment);
+    if (chunk_ptr == nullptr) {
+        return nullptr;
+    }
+
+    Chunk_Metadata* metadata = reinterpret_cast<Chunk_Metadata*>(
+        reinterpret_cast<char*>(chunk_ptr) - sizeof(Chunk_Metadata)
+    );
+    metadata->gc_pinned = true;
+    note_allocation(size, chunk_ptr);
+    return chunk_ptr;
+}
+
+void* Allocator::allocate_aligned(std::size_t size, std::size_t alignment)
+{
+    if (size == 0 || (alignment & (alignment - 1)) != 0) {
+        return nullptr;
+    }
+
+    // The padded request below must stay within MAX_ALLOCATION_SIZE. The request needs at least
+    // `alignment` bytes too, so that is what the out-of-memory path is asked for when it is larger.
+    if (alignment > MAX_ALLOCATION_SIZE / 2 ||
+        size > MAX_ALLOCATION_SIZE - alignment - sizeof(Chunk_Metadata) - 2 * ALIGNMENT) {
+        return out_of_memory(std::max(size, alignment));
+    }
+
+    // Over-allocate so that an aligned payload with room for its own header always fits,
+    // then give the leading slack back to the heap as a free chunk
+    size = align_size(size);
+    void* raw = allocate(size + alignment + sizeof(Chunk_Metadata) + ALIGNMENT, may_collect());
+    if (raw == nullptr || reinterpret_cast<std::uintptr_t>(raw) % alignment == 0) {
+        return raw;
+    }
+
+    Chunk_Metadata* leading = reinterpret_cast<Chunk_Metadata*>(
+        reinterpret_cast<char*>(raw) - sizeof(Chunk_Metadata)
+    );
+    std::uintptr_t first_candidate = reinterpret_cast<std::uintptr_t>(raw) + sizeof(Chunk_Metadata) + ALIGNMENT;
+    char* aligned = reinterpret_cast<char*>((first_candidate + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1));
+
+    Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(aligned - sizeof(Chunk_Metadata));
+    chunk->chunk_size = leading->chunk_size - static_cast<std::size_t>(aligned - reinterpret_cast<char*>(raw));
+    chunk->is_free = false;
+    chunk->gc_mark = false;
+    chunk->gc_pinned = false;
+    chunk->in_quick_list = false;
+    chunk->prev = leading;
+    chunk->next = leading->next;
+    if (chunk->next != nullptr) {
+        chunk->next->prev = chunk;
+    }
+
+    leading->next = chunk;
+    leading->chunk_size = static_cast<std::size_t>(reinterpret_cast<char*>(chunk) - reinterpret_cast<char*>(raw));
+    leading->is_free = true;
+    leading->gc_pinned = false;
+    stats.splits.add(1);
+
+    allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, raw);
+    allocated_chunks_root = insert_in_bst(allocated_chunks_root, aligned, chunk->chunk_size);
+
+    if (leading->prev != nullptr && leading->prev->is_free) {
+        leading->prev->chunk_size += leading->chunk_size + sizeof(Chunk_Metadata);
+        leading->prev->next = chunk;
+        chunk->prev = leading->prev;
+        stats.coalesces.add(1);
+    }
+
+    out << "Aligned chunk created at " << chunk << " for alignment " << alignment << LBR;
+    log_info();
+    return aligned;
 }
 
 Chunk_Metadata* Allocator::get_chunk(void* ptr)
@@ -290,6 +551,7 @@ void Allocator::gc_unmark_chunks()
 
     while (current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size) {
         current->gc_mark = false;
+        current->gc_fixed = false;
         out << "Unmarked << " << current << LBR;
         log_info();
 
@@ -300,7 +562,33 @@ void Allocator::gc_unmark_chunks()
     log_info();
 }
 
-void Allocator::find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_list[], int& root_chunk_list_size) {
+std::size_t Allocator::gc_add_persistent_roots()
+{
+    std::size_t pushed = 0;
+    for (std::size_t i = 0; persistent != nullptr && i < Persistent_Heap_Header::MAX_ROOTS; i++) {
+        Chunk_Metadata* chunk = persistent->roots[i] != nullptr ? get_chunk(persistent->roots[i]) : nullptr;
+        if (chunk != nullptr && !chunk->is_free && gc->push_root(chunk)) {
+            pushed++;
+        }
+    }
+    return pushed;
+}
+
+std::size_t Allocator::gc_add_pinned_roots()
+{
+    std::size_t pushed = 0;
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+
+    while (current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size) {
+        if (!current->is_free && current->gc_pinned && gc->push_root(current)) {
+            pushed++;
+        }
+        current = current->next;
+    }
+    return pushed;
+}
+
+void Allocator::find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_list[], int& root_chunk_list_size, bool& overflow) {
     if (top == nullptr || top->chunk_size < sizeof(void*)) {
         return;
     }
@@ -310,6 +598,46 @@ void Allocator::find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_l
     char* data_start = reinterpret_cast<char*>(top) + sizeof(Chunk_Metadata);
     char* data_end = data_start + top->chunk_size;
 
+    // Every chunk found is pushed here. A full root list drops it and raises `overflow`, and the
+    // collector then rescans the marked chunks, this one included, so it is found again.
+    auto push = [&](Chunk_Metadata* chunk_ptr) {
+        if (chunk_ptr == nullptr || chunk_ptr->is_free || chunk_ptr->gc_mark) {
+            return false;
+        }
+        if (root_chunk_list_size >= 1000) {
+            out << "Root list is full. Deferring chunk to the overflow rescan." << LBR;
+            log_info();
+            overflow = true;
+            return false;
+        }
+        root_chunk_list[root_chunk_list_size] = reinterpret_cast<void*>(chunk_ptr);
+        root_chunk_list_size++;
+        return true;
+    };
+
+    // Objects with a layout are traced through their pointer fields only, which compaction can rewrite
+    const GC_Type_Layout* layout = GC_Compactor::get_layout(top->layout);
+    if (layout != nullptr) {
+        for (std::size_t i = 0; i < layout->count; i++) {
+            char* field = data_start + layout->offsets[i];
+            if (field + sizeof(void*) <= data_end) {
+                push(get_chunk(*reinterpret_cast<void**>(field)));
+            }
+        }
+        // compressed_ptr fields hold 4-byte offsets from the heap's start
+        for (std::size_t i = 0; i < layout->compressed_count; i++) {
+            char* field = data_start + layout->compressed_offsets[i];
+            if (field + sizeof(std::uint32_t) > data_end) {
+                continue;
+            }
+            std::uint32_t offset = *reinterpret_cast<std::uint32_t*>(field);
+            if (offset != 0) {
+                push(get_chunk(compressed_ptr_base + offset));
+            }
+        }
+        return;
+    }
+
     out << "SEARCH DETAILS " << LBR
         << "chunk_ptr = " << (void*)top << LBR
         << "data_start = " << (void*)data_start << LBR
@@ -329,44 +657,77 @@ void Allocator::find_chunks_within_chunk(Chunk_Metadata* top, void* root_chunk_l
         // Get the chunk metadata for the pointer
         Chunk_Metadata* chunk_ptr = get_chunk(potential_pointer);
 
-        // If the chunk is valid and not already marked, add it to the root list
-        if (chunk_ptr != nullptr && !chunk_ptr->gc_mark) {
-            if (root_chunk_list_size >= 1000) {
-                out << "Root list is full. Skipping additional chunks." << LBR;
-                log_info();
-                return;
-            }
+        // The word may not be a pointer, so compaction must not rewrite it nor move its target
+        if (chunk_ptr != nullptr && !chunk_ptr->is_free) {
+            chunk_ptr->gc_fixed = true;
+        }
 
-            // Add the chunk to the root list and increment the size
-            root_chunk_list[root_chunk_list_size] = reinterpret_cast<void*>(chunk_ptr);
-            root_chunk_list_size++; 
+        // If the chunk is valid, allocated and not already marked, add it to the root list
+        // (stale words left in recycled payloads can point into free chunks, which must not be scanned)
+        if (push(chunk_ptr)) {
             exists = true;
         }
         
     }
 
+    // Every aligned 4-byte slot may also be a compressed_ptr, an offset from the heap's start
+    for (char* current = data_start; gc->compressed_scan && current + sizeof(std::uint32_t) <= data_end; current += sizeof(std::uint32_t)) {
+        std::uint32_t offset = *reinterpret_cast<std::uint32_t*>(current);
+        if (offset == 0 || offset >= used_heap_size) {
+            continue;
+        }
+        Chunk_Metadata* chunk_ptr = get_chunk(compressed_ptr_base + offset);
+        if (chunk_ptr == nullptr || chunk_ptr->is_free) {
+            continue;
+        }
+        chunk_ptr->gc_fixed = true;
+        if (push(chunk_ptr)) {
+            exists = true;
+        }
+    }
+
     if (!exists) {
         out << "Pointer not found within Chunk pointed by chunk_ptr = " << (void*)top << LBR;
         log_info();
     }
 }
 
+void Allocator::gc_rescan_marked()
+{
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+
+    while (current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size) {
+        if (!current->is_free && current->gc_mark) {
+            // Drain after every chunk, so that the list overflows again only for a chunk referencing more than it holds
+            gc->find_chunks_within_chunk(current);
+            gc->drain_root_list();
+        }
+        current = current->next;
+    }
+}
+
 void Allocator::gc_sweep()
 {
     Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
 
     while (current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size) {
-        if (!current->gc_mark) {
+        if (!current->gc_mark && !current->gc_pinned) {
             out << "\tSweeping pointer -> " << (void*)current << LBR;
             log_info();
 
+            // Free chunks are visited too, only chunks that were still allocated are reclaimed
+            if (!current->is_free) {
+                note_gc_free(current);
+            }
+
             current->is_free = true;
-            allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, (void*)current);
+            allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, current->currentChunk());
 
             // Coalesce with next chunk if it's free
             if (current->next != nullptr && current->next->is_free) {
                 out << "\tCoalescing with next chunk -> " << (void*)current->next << LBR;
                 log_info();
+                stats.coalesces.add(1);
                 current->chunk_size += current->next->chunk_size + sizeof(Chunk_Metadata);
                 current->next = current->next->next;
                 if (current->next != nullptr) {
@@ -378,6 +739,7 @@ void Allocator::gc_sweep()
             if (current->prev != nullptr && current->prev->is_free) {
                 out << "\tCoalescing with previous chunk -> " << (void*)current->prev << LBR;
                 log_info();
+                stats.coalesces.add(1);
                 current->prev->chunk_size += current->chunk_size + sizeof(Chunk_Metadata);
                 current->prev->next = current->next;
                 if (current->next != nullptr) {
@@ -394,113 +756,953 @@ void Allocator::gc_sweep()
 
 
 
-Garbage_Collector& Allocator::getGC()
+void Allocator::gc_find_finalizable(GC_Finalizer& finalizer)
 {
-    return *gc;
+    for (Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+         current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size;
+         current = current->next) {
+        if (current->is_free || current->gc_mark || current->gc_pinned || current->finalizer == 0) {
+            continue;
+        }
+        Finalizer_Thunk thunk = GC_Finalizer::get_thunk(current->finalizer);
+        if (thunk != nullptr && !finalizer.push(current->currentChunk(), thunk)) {
+            out << "Finalizer queue is full, sweeping " << (void*)current << " without finalizing it" << LBR;
+            log_info();
+        }
+    }
 }
 
-
-void Allocator::deallocate(void* ptr)
+void Allocator::gc_measure_free_space(std::size_t& free_bytes, std::size_t& largest_free_block) const
 {
-    out << "Received request for deallocation of pointer " << ptr << LBR;
-    log_info();
-
-    // to implement deallocate function
-    // first we need to check if the ptr provided is valid or not
-    // there are two cases for invalid pointers
-    // 1. if the pointer is pointing to the memory location inside of heap but it is not starting, i.e currentChunk()
-    // 2. if the pointer is pointing to memory location completely outside the heap
-    // we are going to treat both of them the same by throwing an error
-    // NOTE: nullptr is valid and thus we also need to check if the ptr is nullptr
-    // in case of nullptr, we simply want to end the function as it has no effect
-    // we need to iterate through the heap using (current!=nullptr) while loop
-    // if the current->currentChunk() == ptr then it is valid
-    // after entire iteration of heap, if we do not find the chunk ptr, then exit with error state
-    // if we found the chunk to be deallocated, then we need to do the following
-    // 1. set the is_free flag = true
-    // 2. check if the next chunk is free. If it is, then let the size of the current chunk_size += next chunk size and current next = next chunk next()
-    // 3. check if the previous chunk if free. If it is then let the size of the previous chunk += current chunk size and prev chunk next() = current chunk
-    // essentially we need to coalesces the free adjacent chunks
-
-    // Check if the pointer is nullptr
-    if (ptr == nullptr) {
-        return;
+    free_bytes = 0;
+    largest_free_block = 0;
+
+    Chunk_Metadata* last = nullptr;
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        if (current->is_free) {
+            free_bytes += current->chunk_size;
+            largest_free_block = std::max(largest_free_block, current->chunk_size);
+        }
+        last = current;
+        current = current->next;
     }
 
-    // Check if the pointer is within the heap range
-    if (reinterpret_cast<char*>(ptr) < reinterpret_cast<char*>(heap_start) ||
-        reinterpret_cast<char*>(ptr) >= reinterpret_cast<char*>(heap_start) + used_heap_size) {
-        std::cerr << "Error: Invalid pointer provided to deallocate" << LBR;
-        exit(1);
+    // The space after the last chunk extends a trailing free chunk
+    std::size_t tail = HEAP_CAPACITY - used_heap_size;
+    free_bytes += tail;
+    if (last != nullptr && last->is_free) {
+        tail += last->chunk_size;
     }
+    largest_free_block = std::max(largest_free_block, tail);
+}
 
-    out << "Verification Done:  " << ptr << " is valid" << LBR;
-    log_info();
-
-    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
-    bool found = false;
-
-    /*while (current != nullptr) {
-        if (current->currentChunk() == ptr) {
-            found = true;
-            break;
+bool Allocator::gc_plan_compaction(GC_Compactor& compactor, std::uint64_t& fixed)
+{
+    fixed = 0;
+    char* dest = reinterpret_cast<char*>(heap_start);
+    char* heap_end = dest + used_heap_size;
+
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        if (!current->is_free) {
+            if (current->gc_fixed || current->gc_pinned) {
+                // Chunks after it slide up to its end at most
+                fixed++;
+                dest = reinterpret_cast<char*>(current);
+            }
+            else if (reinterpret_cast<char*>(current) != dest &&
+                     !compactor.add(current->currentChunk(), dest + sizeof(Chunk_Metadata), current->chunk_size)) {
+                return false;
+            }
+            dest += sizeof(Chunk_Metadata) + current->chunk_size;
         }
         current = current->next;
-    }*/
+    }
+    return true;
+}
 
-    BST_Node* bst_node = search_ptr_in_bst(allocated_chunks_root, ptr);
-    if (bst_node != nullptr) {
-        found = true;
-        current = reinterpret_cast<Chunk_Metadata*>(reinterpret_cast<char*>(bst_node->chunk_ptr) - sizeof(Chunk_Metadata));
-        out << "Pointer found in allocation tree" << LBR
-            << " ptr=" << ptr << LBR
-            << " chunk_ptr=" << bst_node->chunk_ptr << LBR
-            << " bst_chunk_node=" << current << LBR;
-        log_info();
+void Allocator::gc_relocate_fields(const GC_Compactor& compactor)
+{
+    for (std::size_t i = 0; persistent != nullptr && i < Persistent_Heap_Header::MAX_ROOTS; i++) {
+        persistent->roots[i] = compactor.relocate(persistent->roots[i]);
     }
 
-    if (!found) {
-        std::cerr << "Error: Pointer does not point to a valid allocated chunk" << LBR;
-        exit(1);
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        const GC_Type_Layout* layout = current->is_free ? nullptr : GC_Compactor::get_layout(current->layout);
+        if (layout != nullptr) {
+            char* data_start = reinterpret_cast<char*>(current->currentChunk());
+            for (std::size_t i = 0; i < layout->count; i++) {
+                if (layout->offsets[i] + sizeof(void*) > current->chunk_size) {
+                    continue;
+                }
+                void** field = reinterpret_cast<void**>(data_start + layout->offsets[i]);
+                *field = compactor.relocate(*field);
+            }
+            for (std::size_t i = 0; i < layout->compressed_count; i++) {
+                if (layout->compressed_offsets[i] + sizeof(std::uint32_t) > current->chunk_size) {
+                    continue;
+                }
+                std::uint32_t* field = reinterpret_cast<std::uint32_t*>(data_start + layout->compressed_offsets[i]);
+                if (*field != 0) {
+                    *field = static_cast<std::uint32_t>(static_cast<char*>(compactor.relocate(compressed_ptr_base + *field)) - compressed_ptr_base);
+                }
+            }
+        }
+        current = current->next;
     }
+}
 
-    current->is_free = true;
-    allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, ptr);
+void Allocator::gc_move_chunks(const GC_Compactor& compactor)
+{
+    char* dest = reinterpret_cast<char*>(heap_start);
+    char* heap_end = dest + used_heap_size;
+    Chunk_Metadata* placed = nullptr;   // Last chunk of the rebuilt list
+
+    // Same walk as gc_plan_compaction(). Chunks only move down, so the next one is still intact.
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        Chunk_Metadata* next = current->next;
+        if (current->is_free) {
+            current = next;
+            continue;
+        }
 
-    // Coalescing adjacent free chunks
-    if (current->next != nullptr && current->next->is_free) {
-        current->chunk_size += current->next->chunk_size + sizeof(Chunk_Metadata);
-        current->next = current->next->next; 
+        Chunk_Metadata* target = reinterpret_cast<Chunk_Metadata*>(dest);
+        if (current->gc_fixed || current->gc_pinned) {
+            std::size_t gap = reinterpret_cast<char*>(current) - dest;
+            if (gap >= sizeof(Chunk_Metadata) && (placed == nullptr || gap >= sizeof(Chunk_Metadata) + ALIGNMENT)) {
+                Chunk_Metadata* free_chunk = target;
+                free_chunk->chunk_size = gap - sizeof(Chunk_Metadata);
+                free_chunk->is_free = true;
+                free_chunk->gc_fixed = false;
+                free_chunk->layout = 0;
+                free_chunk->gc_mark = false;
+                free_chunk->gc_pinned = false;
+                free_chunk->in_quick_list = false;
+                free_chunk->finalizer = 0;
+                free_chunk->prev = placed;
+                if (placed != nullptr) {
+                    placed->next = free_chunk;
+                }
+                placed = free_chunk;
+            }
+            else if (gap > 0 && placed != nullptr) {
+                // Too small for a free chunk, the chunk before it grows over the gap
+                std::size_t old_size = placed->chunk_size;
+                placed->chunk_size += gap;
+                stats.bytes_allocated.add(gap);
+                stats.live_chunks[Allocator_Stats::size_class(old_size)].sub(1);
+                stats.live_chunks[Allocator_Stats::size_class(placed->chunk_size)].add(1);
+                BST_Node* bst_node = search_ptr_in_bst(allocated_chunks_root, placed->currentChunk());
+                if (bst_node != nullptr) {
+                    bst_node->chunk_size = placed->chunk_size;
+                }
+            }
+            target = current;
+        }
+        else if (target != current) {
+            void* old_ptr = current->currentChunk();
+            std::memmove(target, current, sizeof(Chunk_Metadata) + current->chunk_size);
+
+            // Keys keep their order, so the node is rekeyed in place
+            BST_Node* bst_node = search_ptr_in_bst(allocated_chunks_root, old_ptr);
+            if (bst_node != nullptr) {
+                bst_node->chunk_ptr = target->currentChunk();
+            }
+            profiler.on_move(old_ptr, target->currentChunk());
+            trace.record(TRACE_GC_MOVE, reinterpret_cast<std::size_t>(target->currentChunk()), old_ptr);
+        }
 
-        if (current->next != nullptr) {
-            current->next->prev = current; 
+        target->prev = placed;
+        if (placed != nullptr) {
+            placed->next = target;
         }
+        placed = target;
+        dest = reinterpret_cast<char*>(target) + sizeof(Chunk_Metadata) + target->chunk_size;
+        current = next;
     }
 
-    if (current->prev != nullptr && current->prev->is_free) {
-        current->prev->chunk_size += current->chunk_size + sizeof(Chunk_Metadata);
-        current->prev->next = current->next;
-
-        if (current->next != nullptr) {
-            current->next->prev = current->prev; 
-        }
+    // Everything after the last chunk is left to bump allocation
+    if (placed != nullptr) {
+        placed->next = nullptr;
     }
+    used_heap_size = dest - reinterpret_cast<char*>(heap_start);
+    stats.heap_used.set(used_heap_size);
 
+    out << "Compaction moved " << compactor.size() << " chunks, heap now ends at " << (void*)dest << LBR;
+    log_info();
 }
 
-void Allocator::heap_dump()
+void Allocator::gc_plan_evacuation(GC_Compactor& compactor, const GC_Line_Map& lines)
 {
-    if(DEBUG_MODE){
-        Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
-        std::size_t total_allocated = 0;
-        std::size_t total_free = 0;
-        std::size_t allocated_chunks = 0;
-        std::size_t free_chunks = 0;
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* hole = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+
+    // Destinations only split free chunks or extend the heap, the walk never meets a moved header
+    Chunk_Metadata* current = hole;
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        char* end = reinterpret_cast<char*>(current->currentChunk()) + current->chunk_size;
+        if (current->is_free || current->gc_fixed || current->gc_pinned || !lines.overlaps_candidate(current, end)) {
+            current = current->next;
+            continue;
+        }
 
-        std::cout << "----------------------------------------\n"
-            << "Heap Dump:\n"
-            << "Total Heap Capacity: " << HEAP_CAPACITY << " bytes\n"
-            << "Used Heap Size: " << used_heap_size << " bytes\n"
+        // Skip the allocated chunks at the front of the search for good
+        while (hole != nullptr && !hole->is_free) {
+            hole = hole->next;
+        }
+
+        std::size_t size = current->chunk_size;
+        Chunk_Metadata* target = nullptr;
+        for (Chunk_Metadata* candidate = hole; candidate != nullptr; candidate = candidate->next) {
+            if (candidate->is_free && (candidate->chunk_size == size || candidate->chunk_size > size + sizeof(Chunk_Metadata)) &&
+                !lines.overlaps_candidate(candidate, reinterpret_cast<char*>(candidate->currentChunk()) + size)) {
+                target = candidate;
+                break;
+            }
+        }
+
+        char* tail = reinterpret_cast<char*>(heap_start) + used_heap_size;
+        bool append = target == nullptr && used_heap_size + sizeof(Chunk_Metadata) + size < HEAP_CAPACITY &&
+            !lines.overlaps_candidate(tail, tail + sizeof(Chunk_Metadata) + size);
+        if (append) {
+            target = reinterpret_cast<Chunk_Metadata*>(tail);
+        }
+
+        // Out of room: what is left stays where it is this cycle
+        if (target == nullptr || !compactor.add(current->currentChunk(), target->currentChunk(), size)) {
+            break;
+        }
+
+        if (append) {
+            Chunk_Metadata* last = last_chunk();
+            target->chunk_size = size;
+            target->is_free = false;
+            target->gc_pinned = false;
+            target->in_quick_list = false;
+            target->prev = last;
+            target->next = nullptr;
+            last->next = target;
+            used_heap_size += sizeof(Chunk_Metadata) + size;
+            stats.heap_used.set(used_heap_size);
+        }
+        else {
+            take_free_chunk(target, size);
+        }
+
+        // No layout until the copy, so that gc_relocate_fields() skips what the chunk held before
+        target->layout = 0;
+        target->finalizer = 0;
+
+        current = current->next;
+    }
+}
+
+void Allocator::gc_evacuate_chunks(const GC_Compactor& compactor, GC_Line_Map& lines)
+{
+    for (std::size_t i = 0; i < compactor.size(); i++) {
+        const GC_Relocation& move = compactor.at(i);
+        Chunk_Metadata* source = reinterpret_cast<Chunk_Metadata*>(move.from - sizeof(Chunk_Metadata));
+        Chunk_Metadata* target = reinterpret_cast<Chunk_Metadata*>(move.to - sizeof(Chunk_Metadata));
+
+        std::memcpy(move.to, move.from, move.size);
+        target->requested_size = source->requested_size;
+        target->finalizer = source->finalizer;
+        target->layout = source->layout;
+
+        // Freeing the source returns its BST node, which the destination then takes
+        free_chunk(move.from, false);
+        allocated_chunks_root = insert_in_bst(allocated_chunks_root, move.to, move.size);
+
+        lines.mark(target, move.to + move.size);
+        profiler.on_move(move.from, move.to);
+        trace.record(TRACE_GC_MOVE, reinterpret_cast<std::size_t>(move.to), move.from);
+    }
+}
+
+void Allocator::gc_find_holes(const GC_Line_Map* lines)
+{
+    hole_cursor = nullptr;
+    hole_epoch = stats.coalesces.get();
+    if (lines == nullptr) {
+        return;
+    }
+
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        if (current->is_free && lines->is_recycled(lines->block_of(current))) {
+            hole_cursor = current;
+            break;
+        }
+        current = current->next;
+    }
+
+    out << "First hole of a recycled block at " << (void*)hole_cursor << LBR;
+    log_info();
+}
+
+Garbage_Collector& Allocator::getGC()
+{
+    return *gc;
+}
+
+std::size_t Allocator::get_heap_capacity() const
+{
+    return HEAP_CAPACITY;
+}
+
+bool Allocator::start_trace(const char* path)
+{
+    out << "Starting allocation trace " << path << LBR;
+    log_info();
+    return trace.start(path);
+}
+
+void Allocator::stop_trace()
+{
+    out << "Stopping allocation trace" << LBR;
+    log_info();
+    trace.stop();
+}
+
+bool Allocator::start_heap_profile(std::size_t sample_interval)
+{
+    out << "Starting heap profile, sampling every " << sample_interval << " bytes" << LBR;
+    log_info();
+    return profiler.start(sample_interval);
+}
+
+void Allocator::stop_heap_profile()
+{
+    out << "Stopping heap profile" << LBR;
+    log_info();
+    profiler.stop();
+}
+
+bool Allocator::write_heap_profile(const char* path, Heap_Profile_Format format) const
+{
+    return profiler.write(path, format);
+}
+
+Allocator_Stats Allocator::get_stats() const
+{
+    return stats.snapshot();
+}
+
+void Allocator::note_allocation(std::size_t size, void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(reinterpret_cast<char*>(ptr) - sizeof(Chunk_Metadata));
+    chunk->requested_size = size;
+    chunk->finalizer = 0;
+    chunk->layout = 0;
+    trace.record(TRACE_ALLOCATE, size, ptr);
+    stats.on_allocate(chunk->chunk_size);
+    profiler.on_allocate(ptr, size);
+}
+
+void Allocator::note_free(void* ptr)
+{
+    if (ptr == nullptr || !contains(ptr)) {
+        return;
+    }
+    trace.record(TRACE_FREE, 0, ptr);
+    profiler.on_free(ptr);
+    stats.on_free(reinterpret_cast<Chunk_Metadata*>(reinterpret_cast<char*>(ptr) - sizeof(Chunk_Metadata))->chunk_size);
+}
+
+void Allocator::note_gc_free(Chunk_Metadata* chunk)
+{
+    trace.record(TRACE_GC_FREE, 0, chunk->currentChunk());
+    profiler.on_free(chunk->currentChunk());
+    stats.on_free(chunk->chunk_size);
+    stats.gc_chunks_reclaimed.add(1);
+    stats.gc_bytes_reclaimed.add(chunk->chunk_size);
+}
+
+std::size_t Allocator::get_heap_footprint() const
+{
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    char* footprint_end = reinterpret_cast<char*>(heap_start);
+
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (used_heap_size != 0 && current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        if (!current->is_free) {
+            footprint_end = reinterpret_cast<char*>(current) + sizeof(Chunk_Metadata) + current->chunk_size;
+        }
+        current = current->next;
+    }
+
+    return footprint_end - reinterpret_cast<char*>(heap_start);
+}
+
+Heap_Report Allocator::analyze_heap() const
+{
+    Heap_Report report = {};
+    report.heap_capacity = HEAP_CAPACITY;
+    report.heap_used = used_heap_size;
+
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (used_heap_size != 0 && current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        report.header_bytes += sizeof(Chunk_Metadata);
+
+        if (current->is_free) {
+            std::size_t size_class = Allocator_Stats::size_class(current->chunk_size);
+            report.free_chunks++;
+            report.free_bytes += current->chunk_size;
+            report.free_histogram_chunks[size_class]++;
+            report.free_histogram_bytes[size_class] += current->chunk_size;
+            report.largest_free_block = std::max<std::uint64_t>(report.largest_free_block, current->chunk_size);
+        }
+        else if (current->in_quick_list) {
+            report.parked_chunks++;
+            report.parked_bytes += current->chunk_size;
+        }
+        else {
+            report.allocated_chunks++;
+            report.allocated_bytes += current->chunk_size;
+            report.requested_bytes += current->requested_size;
+            if (current->requested_size < current->chunk_size) {
+                report.slack_bytes += current->chunk_size - current->requested_size;
+            }
+        }
+
+        current = current->next;
+    }
+
+    if (report.free_bytes != 0) {
+        report.external_fragmentation = 1.0 - static_cast<double>(report.largest_free_block) / static_cast<double>(report.free_bytes);
+    }
+    if (report.heap_used != 0) {
+        report.internal_waste = static_cast<double>(report.header_bytes + report.slack_bytes) / static_cast<double>(report.heap_used);
+    }
+
+    return report;
+}
+
+void Allocator::write_heap_map(std::ostream& os, std::size_t page_size) const
+{
+    if (page_size == 0) {
+        page_size = 4096;
+    }
+
+    Heap_Report report = analyze_heap();
+
+    os << "{\"heap_start\":\"" << heap_start << "\""
+       << ",\"page_size\":" << page_size
+       << ",\"heap_capacity\":" << report.heap_capacity
+       << ",\"heap_used\":" << report.heap_used
+       << ",\"allocated_chunks\":" << report.allocated_chunks
+       << ",\"allocated_bytes\":" << report.allocated_bytes
+       << ",\"requested_bytes\":" << report.requested_bytes
+       << ",\"parked_chunks\":" << report.parked_chunks
+       << ",\"parked_bytes\":" << report.parked_bytes
+       << ",\"free_chunks\":" << report.free_chunks
+       << ",\"free_bytes\":" << report.free_bytes
+       << ",\"largest_free_block\":" << report.largest_free_block
+       << ",\"header_bytes\":" << report.header_bytes
+       << ",\"slack_bytes\":" << report.slack_bytes
+       << ",\"external_fragmentation\":" << report.external_fragmentation
+       << ",\"internal_waste\":" << report.internal_waste;
+
+    // Only size classes that hold a free chunk, as [largest size in the class, chunks, bytes]
+    os << ",\"free_histogram\":[";
+    bool first = true;
+    for (std::size_t i = 0; i < Allocator_Stats::SIZE_CLASSES; i++) {
+        if (report.free_histogram_chunks[i] == 0) {
+            continue;
+        }
+        os << (first ? "" : ",") << "[" << (std::uint64_t(16) << i) << "," << report.free_histogram_chunks[i] << "," << report.free_histogram_bytes[i] << "]";
+        first = false;
+    }
+    os << "]";
+
+    // The chunks are contiguous and in address order, so the map is built in one pass without a per-page buffer
+    os << ",\"pages\":[";
+    std::size_t page_count = (used_heap_size + page_size - 1) / page_size;
+    std::size_t page = 0;
+    std::size_t page_in_use = 0;
+    auto emit_page = [&]() {
+        os << (page == 0 ? "" : ",") << (page_in_use * 100 + page_size / 2) / page_size;
+        page++;
+        page_in_use = 0;
+    };
+
+    char* heap_end = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (used_heap_size != 0 && current != nullptr && reinterpret_cast<char*>(current) < heap_end) {
+        if (!current->is_free && !current->in_quick_list) {
+            std::size_t begin = reinterpret_cast<char*>(current) - reinterpret_cast<char*>(heap_start);
+            std::size_t end = std::min(begin + sizeof(Chunk_Metadata) + current->chunk_size, used_heap_size);
+            while (begin < end) {
+                while (page < begin / page_size) {
+                    emit_page();
+                }
+                std::size_t page_end = std::min(end, (page + 1) * page_size);
+                page_in_use += page_end - begin;
+                begin = page_end;
+            }
+        }
+        current = current->next;
+    }
+    while (page < page_count) {
+        emit_page();
+    }
+    os << "]}" << LBR;
+}
+
+
+void Allocator::deallocate(void* ptr)
+{
+    GC_Mutator_Guard guard(*gc);
+    free_chunk(ptr, true);
+}
+
+bool Allocator::free_chunk(void* ptr, bool note)
+{
+    out << "Received request for deallocation of pointer " << ptr << LBR;
+    log_info();
+
+    // to implement deallocate function
+    // first we need to check if the ptr provided is valid or not
+    // there are two cases for invalid pointers
+    // 1. if the pointer is pointing to the memory location inside of heap but it is not starting, i.e currentChunk()
+    // 2. if the pointer is pointing to memory location completely outside the heap
+    // we are going to treat both of them the same by throwing an error
+    // NOTE: nullptr is valid and thus we also need to check if the ptr is nullptr
+    // in case of nullptr, we simply want to end the function as it has no effect
+    // we need to iterate through the heap using (current!=nullptr) while loop
+    // if the current->currentChunk() == ptr then it is valid
+    // after entire iteration of heap, if we do not find the chunk ptr, then exit with error state
+    // if we found the chunk to be deallocated, then we need to do the following
+    // 1. set the is_free flag = true
+    // 2. check if the next chunk is free. If it is, then let the size of the current chunk_size += next chunk size and current next = next chunk next()
+    // 3. check if the previous chunk if free. If it is then let the size of the previous chunk += current chunk size and prev chunk next() = current chunk
+    // essentially we need to coalesces the free adjacent chunks
+
+    // Check if the pointer is nullptr
+    if (ptr == nullptr) {
+        return true;
+    }
+
+    // Check if the pointer is within the heap range
+    if (reinterpret_cast<char*>(ptr) < reinterpret_cast<char*>(heap_start) ||
+        reinterpret_cast<char*>(ptr) >= reinterpret_cast<char*>(heap_start) + used_heap_size) {
+        invalid_free(ptr, "Invalid pointer provided to deallocate");
+        return false;
+    }
+
+    out << "Verification Done:  " << ptr << " is valid" << LBR;
+    log_info();
+
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+    bool found = false;
+
+    /*while (current != nullptr) {
+        if (current->currentChunk() == ptr) {
+            found = true;
+            break;
+        }
+        current = current->next;
+    }*/
+
+    BST_Node* bst_node = search_ptr_in_bst(allocated_chunks_root, ptr);
+    if (bst_node != nullptr) {
+        found = true;
+        current = reinterpret_cast<Chunk_Metadata*>(reinterpret_cast<char*>(bst_node->chunk_ptr) - sizeof(Chunk_Metadata));
+        out << "Pointer found in allocation tree" << LBR
+            << " ptr=" << ptr << LBR
+            << " chunk_ptr=" << bst_node->chunk_ptr << LBR
+            << " bst_chunk_node=" << current << LBR;
+        log_info();
+    }
+
+    if (!found || current->in_quick_list) {
+        invalid_free(ptr, "Pointer does not point to a valid allocated chunk");
+        return false;
+    }
+
+    if (note) {
+        note_free(ptr);
+    }
+
+    release_chunk(current);
+    return true;
+}
+
+void Allocator::release_chunk(Chunk_Metadata* current)
+{
+    current->is_free = true;
+    current->gc_pinned = false;
+    // Unlinking needs one descent of the BST, since nodes keep no parent link for the header to point at
+    allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, current->currentChunk());
+
+    // Coalescing adjacent free chunks
+    if (current->next != nullptr && current->next->is_free) {
+        stats.coalesces.add(1);
+        current->chunk_size += current->next->chunk_size + sizeof(Chunk_Metadata);
+        current->next = current->next->next; 
+
+        if (current->next != nullptr) {
+            current->next->prev = current; 
+        }
+    }
+
+    if (current->prev != nullptr && current->prev->is_free) {
+        stats.coalesces.add(1);
+        current->prev->chunk_size += current->chunk_size + sizeof(Chunk_Metadata);
+        current->prev->next = current->next;
+
+        if (current->next != nullptr) {
+            current->next->prev = current->prev; 
+        }
+    }
+}
+
+void Allocator::deallocate(void* ptr, std::size_t size)
+{
+    GC_Mutator_Guard guard(*gc);
+
+    out << "Received request for sized deallocation of pointer " << ptr << " size " << size << LBR;
+    log_info();
+
+    if (ptr == nullptr) {
+        return;
+    }
+
+    if (reinterpret_cast<char*>(ptr) < reinterpret_cast<char*>(heap_start) + sizeof(Chunk_Metadata) ||
+        reinterpret_cast<char*>(ptr) >= reinterpret_cast<char*>(heap_start) + used_heap_size) {
+        invalid_free(ptr, "Invalid pointer provided to deallocate");
+        return;
+    }
+
+    // The size hint lets us trust the header directly instead of searching the BST to validate the pointer
+    Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(
+        reinterpret_cast<char*>(ptr) - sizeof(Chunk_Metadata)
+    );
+    if (chunk->is_free || chunk->in_quick_list || chunk->chunk_size < size) {
+        invalid_free(ptr, "Pointer does not point to a valid allocated chunk");
+        return;
+    }
+
+    note_free(ptr);
+
+    std::size_t index = chunk->chunk_size / ALIGNMENT;
+    // A parked chunk stays allocated to every other process sharing the heap, so shared heaps free at once
+    if (chunk->chunk_size <= QUICK_LIST_MAX_SIZE && quick_list_counts[index] < QUICK_LIST_CAPACITY && heap_backing != HEAP_BACKING_SHARED) {
+        // Park the chunk: it stays allocated in the heap and in the BST, the list link lives in its payload
+        *reinterpret_cast<Chunk_Metadata**>(ptr) = quick_lists[index];
+        quick_lists[index] = chunk;
+        quick_list_counts[index]++;
+        chunk->in_quick_list = true;
+        return;
+    }
+
+    release_chunk(chunk);
+}
+
+std::size_t Allocator::usable_size(void* ptr)
+{
+    if (ptr == nullptr) {
+        return 0;
+    }
+
+    Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(
+        reinterpret_cast<char*>(ptr) - sizeof(Chunk_Metadata)
+    );
+    return chunk->chunk_size;
+}
+
+bool Allocator::contains(void* ptr)
+{
+    return reinterpret_cast<char*>(ptr) >= reinterpret_cast<char*>(heap_start) + sizeof(Chunk_Metadata) &&
+        reinterpret_cast<char*>(ptr) < reinterpret_cast<char*>(heap_start) + used_heap_size;
+}
+
+void Allocator::flush_quick_lists()
+{
+    out << "Flushing quick lists" << LBR;
+    log_info();
+
+    for (std::size_t index = 0; index <= QUICK_LIST_MAX_SIZE / ALIGNMENT; index++) {
+        while (quick_lists[index] != nullptr) {
+            Chunk_Metadata* cached = quick_lists[index];
+            quick_lists[index] = *reinterpret_cast<Chunk_Metadata**>(cached->currentChunk());
+            cached->in_quick_list = false;
+            release_chunk(cached);
+        }
+        quick_list_counts[index] = 0;
+    }
+}
+
+std::size_t Allocator::allocate_batch(std::size_t size, std::size_t count, void** out_ptrs)
+{
+    GC_Mutator_Guard guard(*gc);
+
+    out << "Received Batch Allocation Request for " << count << " chunks of " << size << LBR;
+    log_info();
+
+    if (size == 0 || count == 0 || out_ptrs == nullptr) {
+        return 0;
+    }
+
+    // The region computed below must not wrap around, nor exceed what allocate() would serve
+    if (size > MAX_ALLOCATION_SIZE - ALIGNMENT ||
+        count - 1 > (MAX_ALLOCATION_SIZE - align_size(size)) / (align_size(size) + sizeof(Chunk_Metadata))) {
+        stats.oom_failures.add(1);
+        std::cerr << "Error: Batch of " << count << " chunks of " << size << " bytes is too large" << LBR;
+        return 0;
+    }
+
+    size = align_size(size);
+
+    if (may_collect() && gc->pacer.should_collect(stats.bytes_allocated.get())) {
+        gc->gc_collect(GC_TRIGGER_PACER);
+    }
+
+    // A single free region has to hold `count` chunks back to back, i.e. the data of the
+    // first chunk followed by (count - 1) metadata headers and data areas
+    std::size_t span = size + (count - 1) * (size + sizeof(Chunk_Metadata));
+
+    // carve_chunks() cannot fail half way, so the BST nodes are reserved up front
+    int attempts = reserve_nodes(count) ? 3 : 0;
+
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        Chunk_Metadata* best_fit = nullptr;
+        Chunk_Metadata* last_chunk = nullptr;
+        Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+
+        while (current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size) {
+            if (current->is_free && current->chunk_size >= span) {
+                if (!best_fit || current->chunk_size < best_fit->chunk_size) {
+                    best_fit = current;
+                }
+            }
+            last_chunk = current;
+            current = current->next;
+        }
+
+        if (best_fit) {
+            out << "Batch region found at " << best_fit << " with chunk_size=" << best_fit->chunk_size << LBR;
+            log_info();
+            carve_chunks(best_fit, size, count, span, out_ptrs);
+            return count;
+        }
+
+        if (HEAP_CAPACITY - used_heap_size > sizeof(Chunk_Metadata) && span < HEAP_CAPACITY - used_heap_size - sizeof(Chunk_Metadata)) {
+            // Append one region at the end of the heap and split it in place
+            Chunk_Metadata* region = reinterpret_cast<Chunk_Metadata*>(
+                reinterpret_cast<char*>(heap_start) + used_heap_size
+            );
+            region->chunk_size = span;
+            region->is_free = true;
+            region->gc_pinned = false;
+            region->in_quick_list = false;
+            region->next = nullptr;
+            region->prev = last_chunk;
+            if (last_chunk != nullptr) {
+                last_chunk->next = region;
+            }
+            used_heap_size += sizeof(Chunk_Metadata) + span;
+            stats.heap_used.set(used_heap_size);
+
+            out << "Batch region appended at " << region << LBR;
+            log_info();
+            carve_chunks(region, size, count, span, out_ptrs);
+            return count;
+        }
+
+        // Same policy as allocate(): collect once before growing the heap, unless the pacer decides when to collect
+        if (attempt == 0 && may_collect() && !gc->pacer.is_enabled()) {
+            out << "Calling Garbage Collector to collect free space for batch" << LBR;
+            log_info();
+            collect_for_allocation(span);
+            continue;
+        }
+
+        if (attempt < 2 && expand_heap(span + sizeof(Chunk_Metadata)) != 0) {
+            if (attempt == 0 && may_collect()) {
+                collect_for_allocation(span);
+                continue;
+            }
+            break;
+        }
+    }
+
+    // Fall back to one allocation per chunk if the heap could not provide a single region;
+    // these go through the out-of-memory path one by one
+    std::size_t allocated = 0;
+    try {
+        for (; allocated < count; allocated++) {
+            out_ptrs[allocated] = allocate(size, false);
+            if (out_ptrs[allocated] == nullptr) {
+                break;
+            }
+            note_allocation(size, out_ptrs[allocated]);
+        }
+    }
+    catch (const std::bad_alloc&) {
+        // The batch is all or nothing for the caller when the policy throws
+        deallocate_batch(out_ptrs, allocated);
+        throw;
+    }
+    return allocated;
+}
+
+void Allocator::carve_chunks(Chunk_Metadata* region, std::size_t size, std::size_t count, std::size_t span, void** out_ptrs)
+{
+    std::size_t region_size = region->chunk_size;
+    Chunk_Metadata* region_next = region->next;
+    Chunk_Metadata* current = region;
+
+    for (std::size_t i = 0; i < count; i++) {
+        current->chunk_size = size;
+        current->is_free = false;
+        current->gc_pinned = false;
+        current->in_quick_list = false;
+
+        if (i + 1 < count) {
+            Chunk_Metadata* next_chunk = reinterpret_cast<Chunk_Metadata*>(
+                reinterpret_cast<char*>(current) + sizeof(Chunk_Metadata) + size
+            );
+            current->next = next_chunk;
+            next_chunk->prev = current;
+        }
+
+        out_ptrs[i] = current->currentChunk();
+        allocated_chunks_root = insert_in_bst(allocated_chunks_root, out_ptrs[i], size);
+        note_allocation(size, out_ptrs[i]);
+
+        if (i + 1 < count) {
+            current = current->next;
+            stats.splits.add(1);
+        }
+    }
+
+    // Whatever is left of the region after the last chunk becomes a free chunk, as in allocate()
+    std::size_t remaining = region_size - span;
+
+    if (remaining > sizeof(Chunk_Metadata)) {
+        Chunk_Metadata* rest = reinterpret_cast<Chunk_Metadata*>(
+            reinterpret_cast<char*>(current) + sizeof(Chunk_Metadata) + size
+        );
+        rest->chunk_size = remaining - sizeof(Chunk_Metadata);
+        rest->is_free = true;
+        rest->gc_pinned = false;
+        rest->in_quick_list = false;
+        rest->prev = current;
+        rest->next = region_next;
+        current->next = rest;
+        if (region_next != nullptr) {
+            region_next->prev = rest;
+        }
+        stats.splits.add(1);
+    }
+    else {
+        current->chunk_size += remaining;
+        current->next = region_next;
+        if (region_next != nullptr) {
+            region_next->prev = current;
+        }
+    }
+}
+
+void Allocator::deallocate_batch(void** ptrs, std::size_t count)
+{
+    GC_Mutator_Guard guard(*gc);
+
+    out << "Received Batch Deallocation Request for " << count << " pointers" << LBR;
+    log_info();
+
+    if (ptrs == nullptr || count == 0) {
+        return;
+    }
+
+    // Sorting by address lets the coalescing pass below walk the heap once, front to back
+    std::sort(ptrs, ptrs + count, [](void* a, void* b) {
+        return reinterpret_cast<std::uintptr_t>(a) < reinterpret_cast<std::uintptr_t>(b);
+    });
+
+    Chunk_Metadata* first_freed = nullptr;
+    Chunk_Metadata* last_freed = nullptr;
+
+    for (std::size_t i = 0; i < count; i++) {
+        void* ptr = ptrs[i];
+        if (ptr == nullptr) {
+            continue;
+        }
+
+        if (reinterpret_cast<char*>(ptr) < reinterpret_cast<char*>(heap_start) ||
+            reinterpret_cast<char*>(ptr) >= reinterpret_cast<char*>(heap_start) + used_heap_size) {
+            invalid_free(ptr, "Invalid pointer provided to deallocate_batch");
+            continue;
+        }
+
+        BST_Node* bst_node = search_ptr_in_bst(allocated_chunks_root, ptr);
+        Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(
+            reinterpret_cast<char*>(ptr) - sizeof(Chunk_Metadata)
+        );
+        if (bst_node == nullptr || chunk->in_quick_list) {
+            invalid_free(ptr, "Pointer does not point to a valid allocated chunk");
+            continue;
+        }
+        note_free(ptr);
+        chunk->is_free = true;
+        chunk->gc_pinned = false;
+        allocated_chunks_root = remove_node_in_bst(allocated_chunks_root, ptr);
+
+        if (first_freed == nullptr) {
+            first_freed = chunk;
+        }
+        last_freed = chunk;
+    }
+
+    if (first_freed == nullptr) {
+        return;
+    }
+
+    // Single coalescing pass from the free neighbour before the first chunk to the one after the last
+    Chunk_Metadata* current = first_freed;
+    if (current->prev != nullptr && current->prev->is_free) {
+        current = current->prev;
+    }
+
+    while (current != nullptr && reinterpret_cast<char*>(current) <= reinterpret_cast<char*>(last_freed)) {
+        if (current->is_free) {
+            while (current->next != nullptr && current->next->is_free) {
+                stats.coalesces.add(1);
+                current->chunk_size += current->next->chunk_size + sizeof(Chunk_Metadata);
+                current->next = current->next->next;
+                if (current->next != nullptr) {
+                    current->next->prev = current;
+                }
+            }
+        }
+        current = current->next;
+    }
+}
+
+void Allocator::heap_dump()
+{
+    if(DEBUG_MODE){
+        Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+        std::size_t total_allocated = 0;
+        std::size_t total_free = 0;
+        std::size_t allocated_chunks = 0;
+        std::size_t free_chunks = 0;
+
+        std::cout << "----------------------------------------\n"
+            << "Heap Dump:\n"
+            << "Total Heap Capacity: " << HEAP_CAPACITY << " bytes\n"
+            << "Used Heap Size: " << used_heap_size << " bytes\n"
             << "Chunks:\n";
 
         while (current != nullptr) {
@@ -522,193 +1724,1081 @@ void Allocator::heap_dump()
                 allocated_chunks++;
             }
 
-            current = current->next; // Move to the next chunk
+            current = current->next; // Move to the next chunk
+        }
+
+        std::cout << "Summary:\n"
+            << "Total Allocated Memory: " << total_allocated << " bytes\n"
+            << "Total Free Memory: " << total_free << " bytes\n"
+            << "Number of Allocated Chunks: " << allocated_chunks << "\n"
+            << "Number of Free Chunks: " << free_chunks << "\n"
+            << "----------------------------------------" << LBR;
+    }
+}
+
+void Allocator::print_allocated_chunks()
+{
+    if(DEBUG_MODE){
+        std::cout << "-- PRINTING ALLOCATED CHUNKS --" << LBR;
+        print_bst(allocated_chunks_root);
+    }
+}
+
+void Allocator::print_bst(BST_Node* root, int space, int height)
+{
+    // Base case
+    if (root == nullptr) {
+        return;
+    }
+
+    // Increase distance between levels
+    space += height;
+
+    // Process right child first
+    print_bst(root->right, space);
+
+    // Print current node after space
+    std::cout << LBR;
+    std::cout << std::setw(space) << reinterpret_cast<void*>(reinterpret_cast<char*>(root->chunk_ptr) - sizeof(Chunk_Metadata)) << " : " << root->chunk_size; // You can change this to root->size or any other property
+    std::cout << LBR;
+
+    // Process left child
+    print_bst(root->left, space);
+}
+
+BST_Node* Allocator::allocate_node(std::size_t size, void* chunk)
+{
+    out << "Received request for node allocation: size=" << size << " chunk=" << chunk << LBR;
+    log_info();
+
+    if (free_nodes == nullptr) {
+        out << "Node pool exhausted, mapping another node pool" << LBR;
+        log_info();
+
+        // mmap keeps the program break (and therefore the heap) contiguous
+        void* pool = mmap(nullptr, MAX_NODES * sizeof(BST_Node), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        // Allocations reserve their node first, so this only fails outside of allocate()
+        if (pool == MAP_FAILED) {
+            std::cerr << "Failed to grow node pool" << LBR;
+            exit(1);
+        }
+        add_node_pool(static_cast<BST_Node*>(pool), MAX_NODES);
+    }
+
+    BST_Node* node = free_nodes;
+    free_nodes = node->right;
+    free_node_count--;
+    *node = BST_Node(chunk, size);
+    return node;
+}
+
+void Allocator::deallocate_node(BST_Node* node)
+{
+    if (node) {
+        node->right = free_nodes;             // Push the node back on the free list
+        free_nodes = node;
+        free_node_count++;
+    }
+}
+
+void Allocator::add_node_pool(BST_Node* pool, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        pool[i].right = free_nodes;
+        free_nodes = &pool[i];
+    }
+    free_node_count += count;
+}
+
+bool Allocator::reserve_nodes(std::size_t count)
+{
+    while (free_node_count < count) {
+        out << "Reserving node pool for " << count << " nodes" << LBR;
+        log_info();
+
+        void* pool = mmap(nullptr, MAX_NODES * sizeof(BST_Node), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pool == MAP_FAILED) {
+            return false;
+        }
+        add_node_pool(static_cast<BST_Node*>(pool), MAX_NODES);
+    }
+    return true;
+}
+
+BST_Node* Allocator::insert_in_bst(BST_Node* root, void* chunk_ptr, std::size_t chunk_size)
+{
+    out << "Received Request for inserting node in BST: root=" << root << " chunk_ptr=" << chunk_ptr << " chunk_size=" << chunk_size << LBR;
+    log_info();
+
+    BST_Node* node = allocate_node(chunk_size, chunk_ptr);
+    if (root == nullptr) {
+        return node;
+    }
+
+    // Iterative descent: the tree degenerates into a list for monotonically growing addresses,
+    // so recursion depth would grow with the number of live chunks
+    BST_Node* current = root;
+    while (true) {
+        if (chunk_ptr < current->chunk_ptr) {
+            if (current->left == nullptr) {
+                current->left = node;
+                break;
+            }
+            current = current->left;
+        }
+        else {
+            if (current->right == nullptr) {
+                current->right = node;
+                break;
+            }
+            current = current->right;
+        }
+    }
+    return root;
+}
+
+BST_Node* Allocator::search_ptr_in_bst(BST_Node* root, void* chunk_ptr)
+{
+    BST_Node* current = root;
+    while (current != nullptr && current->chunk_ptr != chunk_ptr) {
+        // Compare the given pointer with the current node's address
+        current = chunk_ptr < current->chunk_ptr ? current->left : current->right;
+    }
+    return current;
+}
+
+BST_Node* Allocator::remove_node_in_bst(BST_Node* root, void* chunk_ptr)
+{
+    BST_Node* parent = nullptr;
+    BST_Node* current = root;
+    while (current != nullptr && current->chunk_ptr != chunk_ptr) {
+        parent = current;
+        current = chunk_ptr < current->chunk_ptr ? current->left : current->right;
+    }
+
+    // Return the tree unchanged if the node is not found
+    if (current == nullptr) {
+        return root;
+    }
+
+    if (current->left != nullptr && current->right != nullptr) {
+        // Node with two children: copy the inorder successor and unlink it instead
+        BST_Node* successor_parent = current;
+        BST_Node* successor = current->right;
+        while (successor->left != nullptr) {
+            successor_parent = successor;
+            successor = successor->left;
+        }
+
+        current->chunk_ptr = successor->chunk_ptr;
+        current->chunk_size = successor->chunk_size;
+
+        if (successor_parent == current) {
+            successor_parent->right = successor->right;
+        }
+        else {
+            successor_parent->left = successor->right;
+        }
+        deallocate_node(successor);
+        return root;
+    }
+
+    // Node with only one child or no child
+    BST_Node* child = current->left != nullptr ? current->left : current->right;
+    if (parent == nullptr) {
+        root = child;
+    }
+    else if (parent->left == current) {
+        parent->left = child;
+    }
+    else {
+        parent->right = child;
+    }
+    deallocate_node(current);
+
+    return root; 
+}
+
+BST_Node* Allocator::find_min_node(BST_Node* node)
+{
+    BST_Node* current = node;
+    while (current && current->left != nullptr) {
+        current = current->left;
+    }
+    return current;
+}
+
+int Allocator::expand_heap(std::size_t size)
+{
+    if (size <= 0) {
+        return 0;  
+    }
+
+    // Free space at the end of the heap is merged with the new space, so it only has to make up the difference
+    Chunk_Metadata* last = last_chunk();
+    std::size_t tail_free = HEAP_CAPACITY - used_heap_size;
+    if (last != nullptr && last->is_free) {
+        tail_free += sizeof(Chunk_Metadata) + last->chunk_size;
+    }
+    std::size_t expansion_size = growth_step(size > tail_free ? size - tail_free : ALIGNMENT);
+    if (expansion_size == 0) {
+        return 1;
+    }
+    char* heap_end = reinterpret_cast<char*>(heap_start) + HEAP_CAPACITY;
+
+    if (heap_backing != HEAP_BACKING_SBRK) {
+        // The reservation is already mapped, growing only moves the end of the heap within it
+        if (HEAP_CAPACITY + expansion_size > heap_reserve) {
+            std::cerr << "Error: Heap reservation of " << heap_reserve << " bytes exhausted" << LBR;
+            return 1;
+        }
+        // The file must cover the new space before it is touched, or the access faults
+        if (persistent != nullptr && ftruncate(persistent_fd, persistent->header_size + HEAP_CAPACITY + expansion_size) != 0) {
+            std::cerr << "Error: Failed to extend the heap file by " << expansion_size << " bytes" << LBR;
+            return 1;
+        }
+    }
+    else {
+        void* result = sbrk(expansion_size);
+        if (result == (void*)-1) {
+            std::cerr << "Error: Failed to expand heap by " << expansion_size << " bytes" << LBR;
+            return 1; 
+        }
+
+        // Another sbrk user (e.g. the system malloc) moved the program break since the last expansion,
+        // so the new space does not extend the heap. Give it back rather than overlap foreign memory.
+        if (result != heap_end) {
+            sbrk(-static_cast<std::intptr_t>(expansion_size));
+            std::cerr << "Error: Program break moved by another allocator, heap cannot be expanded contiguously" << LBR;
+            return 1;
+        }
+    }
+
+    HEAP_CAPACITY += expansion_size;
+    stats.heap_expansions.add(1);
+    stats.heap_capacity.set(HEAP_CAPACITY);
+    // Keep the collector's heap bounds in sync so that pointers into the new space are traced
+    gc->HEAP_CAPACITY = HEAP_CAPACITY;
+    out << "Heap successfully expanded by " << expansion_size
+        << " bytes. New HEAP_CAPACITY: " << HEAP_CAPACITY << LBR;
+    log_info();
+
+    append_free_space(last);
+
+    return 0; 
+}
+
+Chunk_Metadata* Allocator::last_chunk() const
+{
+    char* tail = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    Chunk_Metadata* last = nullptr;
+    Chunk_Metadata* current = used_heap_size == 0 ? nullptr : reinterpret_cast<Chunk_Metadata*>(heap_start);
+    while (current != nullptr && reinterpret_cast<char*>(current) < tail) {
+        last = current;
+        current = current->next;
+    }
+    return last;
+}
+
+std::size_t Allocator::growth_step(std::size_t size)
+{
+    std::size_t needed = size;
+    double factor = growth_policy.growth_factor < 1.0 ? 1.0 : growth_policy.growth_factor;
+    double geometric = static_cast<double>(HEAP_CAPACITY) * (factor - 1.0);
+    std::size_t step = geometric >= static_cast<double>(growth_policy.max_step) ? growth_policy.max_step : static_cast<std::size_t>(geometric);
+    step = std::max(step, growth_policy.min_step);
+    step = std::max(step, needed);
+
+    // Round the new end of the heap up to a page, or a huge page for large steps
+    std::uintptr_t heap_end = reinterpret_cast<std::uintptr_t>(heap_start) + HEAP_CAPACITY;
+    std::size_t granularity = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    bool huge_backing = heap_backing == HEAP_BACKING_THP || heap_backing == HEAP_BACKING_HUGETLB;
+    if (huge_backing || (growth_policy.huge_page_rounding && step >= Heap_Growth_Policy::HUGE_PAGE_SIZE)) {
+        granularity = Heap_Growth_Policy::HUGE_PAGE_SIZE;
+    }
+    std::uintptr_t new_end = (heap_end + step + granularity - 1) / granularity * granularity;
+    step = new_end - heap_end;
+
+    // A mapped heap cannot grow past its reservation, settle for the rest of it if that is enough
+    if (heap_backing != HEAP_BACKING_SBRK && HEAP_CAPACITY + step > heap_reserve && heap_reserve - HEAP_CAPACITY >= needed) {
+        step = heap_reserve - HEAP_CAPACITY;
+    }
+
+    if (growth_policy.soft_limit == 0 || HEAP_CAPACITY + step <= growth_policy.soft_limit) {
+        return step;
+    }
+
+    // Use whatever room is left below the limit, if that is enough for this allocation
+    std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    if (growth_policy.soft_limit > HEAP_CAPACITY) {
+        std::uintptr_t limit_end = (heap_end + (growth_policy.soft_limit - HEAP_CAPACITY)) / page_size * page_size;
+        if (limit_end > heap_end && limit_end - heap_end >= needed) {
+            return limit_end - heap_end;
         }
+    }
 
-        std::cout << "Summary:\n"
-            << "Total Allocated Memory: " << total_allocated << " bytes\n"
-            << "Total Free Memory: " << total_free << " bytes\n"
-            << "Number of Allocated Chunks: " << allocated_chunks << "\n"
-            << "Number of Free Chunks: " << free_chunks << "\n"
-            << "----------------------------------------" << LBR;
+    out << "Heap soft limit of " << growth_policy.soft_limit << " bytes reached" << LBR;
+    log_info();
+    if (growth_policy.on_soft_limit == nullptr || !growth_policy.on_soft_limit(HEAP_CAPACITY, needed, growth_policy.callback_context)) {
+        std::cerr << "Error: Heap soft limit of " << growth_policy.soft_limit << " bytes reached" << LBR;
+        return 0;
     }
+
+    // Allowed past the limit: grow by no more than this allocation needs
+    return (heap_end + needed + page_size - 1) / page_size * page_size - heap_end;
 }
 
-void Allocator::print_allocated_chunks()
+void Allocator::append_free_space(Chunk_Metadata* last_chunk)
 {
-    if(DEBUG_MODE){
-        std::cout << "-- PRINTING ALLOCATED CHUNKS --" << LBR;
-        print_bst(allocated_chunks_root);
+    char* tail = reinterpret_cast<char*>(heap_start) + used_heap_size;
+    char* heap_end = reinterpret_cast<char*>(heap_start) + HEAP_CAPACITY;
+
+    if (last_chunk != nullptr && last_chunk->is_free) {
+        // Grow the trailing free chunk over the new space
+        last_chunk->chunk_size += heap_end - tail;
+        stats.coalesces.add(1);
+    }
+    else {
+        Chunk_Metadata* free_chunk = reinterpret_cast<Chunk_Metadata*>(tail);
+        free_chunk->chunk_size = (heap_end - tail) - sizeof(Chunk_Metadata);
+        free_chunk->is_free = true;
+        free_chunk->gc_mark = false;
+        free_chunk->gc_pinned = false;
+        free_chunk->in_quick_list = false;
+        free_chunk->prev = last_chunk;
+        free_chunk->next = nullptr;
+        if (last_chunk != nullptr) {
+            last_chunk->next = free_chunk;
+        }
     }
+
+    used_heap_size = HEAP_CAPACITY;
+    stats.heap_used.set(used_heap_size);
 }
 
-void Allocator::print_bst(BST_Node* root, int space, int height)
+void Allocator::set_heap_growth_policy(const Heap_Growth_Policy& policy)
 {
-    // Base case
-    if (root == nullptr) {
-        return;
+    out << "Heap growth policy set: growth_factor = " << policy.growth_factor << ", soft_limit = " << policy.soft_limit << LBR;
+    log_info();
+    growth_policy = policy;
+}
+
+const Heap_Growth_Policy& Allocator::get_heap_growth_policy() const
+{
+    return growth_policy;
+}
+
+bool Allocator::set_heap_backing(Heap_Backing backing, std::size_t reserve_size)
+{
+    out << "Received request for " << heap_backing_name(backing) << " heap backing with a reserve of " << reserve_size << " bytes" << LBR;
+    log_info();
+
+    if (used_heap_size != 0) {
+        out << "Error: Heap backing can only be changed before the first allocation" << LBR;
+        log_info();
+        return false;
+    }
+    if (backing == HEAP_BACKING_SBRK) {
+        return heap_backing == HEAP_BACKING_SBRK;
+    }
+    if (backing == HEAP_BACKING_FILE) {
+        out << "Error: A file backed heap is opened with open_persistent_heap()" << LBR;
+        log_info();
+        return false;
     }
 
-    // Increase distance between levels
-    space += height;
+    const std::size_t huge_page = Heap_Growth_Policy::HUGE_PAGE_SIZE;
+    std::size_t reserve = std::max((reserve_size + huge_page - 1) / huge_page * huge_page, huge_page);
+    char* base = nullptr;
 
-    // Process right child first
-    print_bst(root->right, space);
+    if (backing == HEAP_BACKING_HUGETLB) {
+        // Huge page mappings are huge page aligned, and mmap fails unless the pool can back all of it
+        void* mapping = mmap(nullptr, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping == MAP_FAILED) {
+            out << "Error: Failed to map " << reserve << " bytes of huge pages (see /proc/sys/vm/nr_hugepages)" << LBR;
+            log_info();
+            return false;
+        }
+        base = static_cast<char*>(mapping);
+    }
+    else {
+        // Over-map by one huge page and cut the mapping down to an aligned reservation; MAP_NORESERVE
+        // because only the part below HEAP_CAPACITY is ever touched
+        void* mapping = mmap(nullptr, reserve + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED) {
+            out << "Error: Failed to reserve " << reserve << " bytes for the heap" << LBR;
+            log_info();
+            return false;
+        }
+        char* start = static_cast<char*>(mapping);
+        base = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(start) + huge_page - 1) / huge_page * huge_page);
+        if (base != start) {
+            munmap(start, base - start);
+        }
+        munmap(base + reserve, start + huge_page - base);
 
-    // Print current node after space
-    std::cout << LBR;
-    std::cout << std::setw(space) << reinterpret_cast<void*>(reinterpret_cast<char*>(root->chunk_ptr) - sizeof(Chunk_Metadata)) << " : " << root->chunk_size; // You can change this to root->size or any other property
-    std::cout << LBR;
+        // Without THP (e.g. "never") the heap still works, just with base pages
+        if (madvise(base, reserve, MADV_HUGEPAGE) != 0) {
+            out << "Warning: madvise(MADV_HUGEPAGE) failed, heap is backed by base pages" << LBR;
+            log_info();
+        }
+    }
 
-    // Process left child
-    print_bst(root->left, space);
+    // Release the previous heap: a reservation is unmapped, sbrk space is only returned if it is at the break
+    if (heap_backing != HEAP_BACKING_SBRK) {
+        munmap(heap_start, heap_reserve);
+    }
+    else if (HEAP_CAPACITY != 0 && sbrk(0) == reinterpret_cast<char*>(heap_start) + HEAP_CAPACITY) {
+        sbrk(-static_cast<std::intptr_t>(HEAP_CAPACITY));
+    }
+
+    heap_backing = backing;
+    heap_reserve = reserve;
+    heap_start = base;
+    HEAP_CAPACITY = huge_page;
+    stats.heap_capacity.set(HEAP_CAPACITY);
+    gc->heap_start = heap_start;
+    compressed_ptr_base = static_cast<char*>(heap_start);
+    gc->HEAP_CAPACITY = HEAP_CAPACITY;
+
+    out << "Heap moved to " << heap_backing_name(backing) << " reservation at " << heap_start << LBR;
+    log_info();
+    return true;
 }
 
-BST_Node* Allocator::allocate_node(std::size_t size, void* chunk)
+Heap_Backing Allocator::get_heap_backing() const
 {
-    out << "Received request for node allocation: size=" << size << " chunk=" << chunk << LBR;
+    return heap_backing;
+}
+
+bool Allocator::open_persistent_heap(const char* path, std::size_t reserve_size, void* address)
+{
+    out << "Received request for persistent heap " << path << " with a reserve of " << reserve_size << " bytes" << LBR;
     log_info();
-    for (std::size_t i = 0; i < MAX_NODES; ++i) {
-        out << "Node: i=" << i << LBR;
-        log_info();
 
-        out << " node_pool=" << &node_pool[i] << LBR;
-        log_info();
+    if (used_heap_size != 0 || persistent != nullptr) {
+        std::cerr << "Error: A persistent heap can only be opened before the first allocation" << LBR;
+        return false;
+    }
 
-        out << " node_used=" << node_used[i] << LBR;
-        log_info();
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "Error: Failed to open heap file " << path << LBR;
+        return false;
+    }
+    return map_heap_file(fd, path, reserve_size, address, HEAP_BACKING_FILE);
+}
 
-        if (!node_used[i]) {
-            out << "Found free node" << LBR;
-            log_info();
+bool Allocator::attach_shared_heap(const char* name, std::size_t reserve_size, void* address)
+{
+    out << "Received request for shared heap " << (name != nullptr ? name : "(memfd)") << " with a reserve of " << reserve_size << " bytes" << LBR;
+    log_info();
 
-            node_used[i] = true;
-            node_pool[i] = BST_Node(chunk, size);
-            return &node_pool[i];
-        }
+    if (used_heap_size != 0 || persistent != nullptr) {
+        std::cerr << "Error: A shared heap can only be attached before the first allocation" << LBR;
+        return false;
     }
-    return nullptr;
+
+    // A named segment is created by whichever process gets there first, the others attach to it
+    int fd = name != nullptr ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : memfd_create("allocator_heap", MFD_CLOEXEC);
+    if (fd < 0 && name != nullptr && errno == EEXIST) {
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        std::cerr << "Error: Failed to open shared memory segment " << (name != nullptr ? name : "(memfd)") << LBR;
+        return false;
+    }
+    return map_heap_file(fd, name != nullptr ? name : "(memfd)", reserve_size, address, HEAP_BACKING_SHARED);
 }
 
-void Allocator::deallocate_node(BST_Node* node)
+bool Allocator::map_heap_file(int fd, const char* path, std::size_t reserve_size, void* address, Heap_Backing backing)
 {
-    if (node) {
-        std::size_t index = node - node_pool; // Calculate the node's index
-        node_used[index] = false;             // Mark node as free
+    const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t header_size = (sizeof(Persistent_Heap_Header) + page_size - 1) / page_size * page_size;
+    std::size_t reserve = std::max((reserve_size + page_size - 1) / page_size * page_size, page_size);
+    std::size_t capacity = page_size;
+    Persistent_Heap_Header saved = {};
+    struct stat st;
+    bool existing = false;
+
+    // A segment being created by another process has no header yet, give it a moment
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        if (fstat(fd, &st) != 0) {
+            break;
+        }
+        existing = st.st_size > 0;
+        if (!existing || backing != HEAP_BACKING_SHARED ||
+            (pread(fd, &saved, sizeof(saved), 0) == static_cast<ssize_t>(sizeof(saved)) &&
+             __atomic_load_n(&saved.magic, __ATOMIC_ACQUIRE) == Persistent_Heap_Header::MAGIC)) {
+            break;
+        }
+        usleep(1000);
+    }
+
+    if (existing) {
+        // Only a file written by a build with the same chunk layout can be mapped back
+        std::size_t file_size = static_cast<std::size_t>(st.st_size);
+        bool valid = pread(fd, &saved, sizeof(saved), 0) == static_cast<ssize_t>(sizeof(saved)) &&
+                     saved.magic == Persistent_Heap_Header::MAGIC && saved.version == Persistent_Heap_Header::VERSION &&
+                     saved.metadata_size == sizeof(Chunk_Metadata) && saved.alignment == ALIGNMENT &&
+                     saved.header_size % page_size == 0 && file_size > saved.header_size &&
+                     file_size - saved.header_size <= saved.reserve;
+        if (!valid) {
+            std::cerr << "Error: " << path << " is not a heap file of this build" << LBR;
+            close(fd);
+            return false;
+        }
+        header_size = saved.header_size;
+        reserve = saved.reserve;
+        capacity = file_size - header_size;
+        address = saved.base;
+    }
+    else if (ftruncate(fd, header_size + capacity) != 0) {
+        std::cerr << "Error: Failed to size heap file " << path << LBR;
+        close(fd);
+        return false;
+    }
+
+    // The whole reservation is mapped up front, pages past the end of the file are never touched.
+    // Without MAP_FIXED the address is only a hint, so the result is checked rather than clobbering
+    // whatever the program has mapped there.
+    char* hint = address != nullptr ? static_cast<char*>(address) - header_size : nullptr;
+    void* mapping = mmap(hint, header_size + reserve, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (mapping == MAP_FAILED || (existing && mapping != hint)) {
+        std::cerr << "Error: Failed to map heap file " << path << " at " << address << LBR;
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, header_size + reserve);
+        }
+        close(fd);
+        return false;
+    }
+
+    Persistent_Heap_Header* header = static_cast<Persistent_Heap_Header*>(mapping);
+    char* base = static_cast<char*>(mapping) + header_size;
+    if (!existing) {
+        header->version = Persistent_Heap_Header::VERSION;
+        header->metadata_size = sizeof(Chunk_Metadata);
+        header->alignment = ALIGNMENT;
+        header->header_size = header_size;
+        header->base = base;
+        header->reserve = reserve;
+        header->used_heap_size = 0;
+        header->heap_capacity = capacity;
+        header->generation = 0;
+
+        // Robust, so that a process dying inside the allocator does not leave the others waiting forever
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+
+        // Written last: processes attaching to a shared segment wait for it
+        __atomic_store_n(&header->magic, Persistent_Heap_Header::MAGIC, __ATOMIC_RELEASE);
+    }
+
+    // Switch over before restoring, which walks the heap at heap_start
+    void* old_start = heap_start;
+    std::size_t old_capacity = HEAP_CAPACITY;
+    Heap_Backing old_backing = heap_backing;
+    std::size_t old_reserve = heap_reserve;
+
+    heap_backing = backing;
+    heap_reserve = reserve;
+    heap_start = base;
+    HEAP_CAPACITY = capacity;
+    persistent = header;
+    persistent_fd = fd;
+
+    bool restored = true;
+    if (existing && backing == HEAP_BACKING_SHARED) {
+        // The other processes keep allocating, so their view is loaded under the lock
+        int result = pthread_mutex_lock(&header->lock);
+        if (result != 0 && result != EOWNERDEAD) {
+            restored = false;
+        }
+        else {
+            HEAP_CAPACITY = header->heap_capacity;
+            restored = restore_persistent_heap(header->used_heap_size, false);
+            shared_generation = header->generation;
+            // As in lock_shared_heap(), a heap left corrupt by a dead owner makes the lock unrecoverable
+            if (restored && result == EOWNERDEAD) {
+                pthread_mutex_consistent(&header->lock);
+            }
+            pthread_mutex_unlock(&header->lock);
+        }
+    }
+    else if (existing) {
+        restored = restore_persistent_heap(header->used_heap_size, true);
+    }
+
+    if (!restored) {
+        std::cerr << "Error: Heap file " << path << " is corrupt" << LBR;
+        heap_backing = old_backing;
+        heap_reserve = old_reserve;
+        heap_start = old_start;
+        HEAP_CAPACITY = old_capacity;
+        persistent = nullptr;
+        persistent_fd = -1;
+        munmap(mapping, header_size + reserve);
+        close(fd);
+        return false;
+    }
+
+    // Release the previous heap, as set_heap_backing() does
+    if (old_backing != HEAP_BACKING_SBRK) {
+        munmap(old_start, old_reserve);
+    }
+    else if (old_capacity != 0 && sbrk(0) == static_cast<char*>(old_start) + old_capacity) {
+        sbrk(-static_cast<std::intptr_t>(old_capacity));
+    }
+
+    stats.heap_capacity.set(HEAP_CAPACITY);
+    stats.heap_used.set(used_heap_size);
+    gc->heap_start = heap_start;
+    compressed_ptr_base = static_cast<char*>(heap_start);
+    gc->HEAP_CAPACITY = HEAP_CAPACITY;
+
+    // The collector only sees this process's roots, it would reclaim what the others still use
+    if (backing == HEAP_BACKING_SHARED) {
+        GC_ENABLED = false;
+        gc->heap_shared = true;
     }
+
+    out << "Heap " << (existing ? "reopened" : "created") << " in " << path << " at " << heap_start
+        << " with " << used_heap_size << " bytes in use" << LBR;
+    log_info();
+    return true;
 }
 
-BST_Node* Allocator::insert_in_bst(BST_Node* root, void* chunk_ptr, std::size_t chunk_size)
+void Allocator::detach_heap()
 {
-    out << "Received Request for inserting node in BST: root=" << root << " chunk_ptr=" << chunk_ptr << " chunk_size=" << chunk_size << LBR;
+    out << "Received request to detach the heap" << LBR;
     log_info();
 
-    if (root == nullptr) {
-        return allocate_node(chunk_size, chunk_ptr);
+    if (persistent == nullptr) {
+        return;
     }
-    if (chunk_ptr < root->chunk_ptr) {
-        root->left = insert_in_bst(root->left, chunk_ptr, chunk_size);
+    if (heap_backing == HEAP_BACKING_FILE) {
+        sync_persistent_heap();
     }
-    else {
-        root->right = insert_in_bst(root->right, chunk_ptr, chunk_size);
+
+    release_bst(allocated_chunks_root);
+    allocated_chunks_root = nullptr;
+    munmap(persistent, persistent->header_size + heap_reserve);
+    close(persistent_fd);
+    persistent = nullptr;
+    persistent_fd = -1;
+    use_empty_sbrk_heap();
+}
+
+void Allocator::abandon_shared_heap()
+{
+    // The mapping stays, so that the objects the program already holds can still be read
+    release_bst(allocated_chunks_root);
+    allocated_chunks_root = nullptr;
+    close(persistent_fd);
+    persistent = nullptr;
+    persistent_fd = -1;
+    use_empty_sbrk_heap();
+}
+
+void Allocator::use_empty_sbrk_heap()
+{
+    // Back to an empty sbrk heap, which grows from the current program break
+    std::uintptr_t brk_addr = reinterpret_cast<std::uintptr_t>(sbrk(0));
+    std::size_t padding = (ALIGNMENT - brk_addr % ALIGNMENT) % ALIGNMENT;
+    if (padding != 0) {
+        sbrk(padding);
     }
-    return root;
+    heap_backing = HEAP_BACKING_SBRK;
+    heap_reserve = 0;
+    heap_start = reinterpret_cast<void*>(brk_addr + padding);
+    HEAP_CAPACITY = 0;
+    used_heap_size = 0;
+    hole_cursor = nullptr;
+    stats.heap_capacity.set(HEAP_CAPACITY);
+    stats.heap_used.set(used_heap_size);
+    gc->heap_start = heap_start;
+    compressed_ptr_base = static_cast<char*>(heap_start);
+    gc->HEAP_CAPACITY = HEAP_CAPACITY;
+    gc->heap_shared = false;
 }
 
-BST_Node* Allocator::search_ptr_in_bst(BST_Node* root, void* chunk_ptr)
+bool Allocator::lock_shared_heap()
 {
-    if (root == nullptr || root->chunk_ptr == chunk_ptr) {
-        return root; 
+    if (shared_lock_depth++ != 0) {
+        return true;
     }
 
-    // Compare the given pointer with the current node's address
-    if (chunk_ptr < root->chunk_ptr) {
-        // Search in the left subtree
-        return search_ptr_in_bst(root->left, chunk_ptr);
+    int result = pthread_mutex_lock(&persistent->lock);
+    if (result != 0 && result != EOWNERDEAD) {
+        // ENOTRECOVERABLE: the process that recovered the lock found the heap corrupt
+        shared_lock_depth--;
+        std::cerr << "Error: Shared heap lock is unusable, falling back to a private heap" << LBR;
+        abandon_shared_heap();
+        return false;
     }
-    else {
-        // Search in the right subtree
-        return search_ptr_in_bst(root->right, chunk_ptr);
+
+    bool owner_died = result == EOWNERDEAD;
+    if (owner_died) {
+        // The owner may have died halfway through an update, so the chunk list is reloaded and checked
+        std::cerr << "Warning: A process died while holding the shared heap lock" << LBR;
+        shared_generation = persistent->generation - 1;
     }
+
+    // Another process changed the heap since this one last held the lock
+    if (persistent->generation != shared_generation) {
+        out << "Reloading shared heap, generation " << persistent->generation << LBR;
+        log_info();
+
+        HEAP_CAPACITY = persistent->heap_capacity;
+        if (!restore_persistent_heap(persistent->used_heap_size, false)) {
+            // Unlocked without being marked consistent, a lock whose owner died becomes unrecoverable,
+            // so the other processes stop using the heap too instead of allocating from a broken list
+            std::cerr << "Error: Shared heap is corrupt, falling back to a private heap" << LBR;
+            shared_lock_depth--;
+            pthread_mutex_unlock(&persistent->lock);
+            abandon_shared_heap();
+            return false;
+        }
+        hole_cursor = nullptr;
+        shared_generation = persistent->generation;
+        stats.heap_capacity.set(HEAP_CAPACITY);
+        stats.heap_used.set(used_heap_size);
+        gc->HEAP_CAPACITY = HEAP_CAPACITY;
+    }
+
+    if (owner_died) {
+        pthread_mutex_consistent(&persistent->lock);
+    }
+    return true;
 }
 
-BST_Node* Allocator::remove_node_in_bst(BST_Node* root, void* chunk_ptr)
+void Allocator::unlock_shared_heap()
 {
-    // Base case: if the tree is empty
-    if (root == nullptr) {
-        return root; // Return null if the node is not found
+    if (--shared_lock_depth != 0) {
+        return;
+    }
+
+    persistent->used_heap_size = used_heap_size;
+    persistent->heap_capacity = HEAP_CAPACITY;
+    shared_generation = ++persistent->generation;
+    pthread_mutex_unlock(&persistent->lock);
+}
+
+bool Allocator::restore_persistent_heap(std::size_t used, bool reopened)
+{
+    char* start = static_cast<char*>(heap_start);
+    char* heap_end = start + HEAP_CAPACITY;
+    release_bst(allocated_chunks_root);
+    allocated_chunks_root = nullptr;
+    used_heap_size = 0;
+    if (used == 0) {
+        return true;
     }
 
-    if (chunk_ptr < root->chunk_ptr) {
-        root->left = remove_node_in_bst(root->left, chunk_ptr);
+    // The chunks tile the heap from heap_start, so every link can be checked against the sizes
+    std::size_t allocated = 0;
+    Chunk_Metadata* prev = nullptr;
+    Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(start);
+    while (current != nullptr) {
+        char* chunk_end = reinterpret_cast<char*>(current) + sizeof(Chunk_Metadata);
+        if (chunk_end > heap_end || current->prev != prev || current->chunk_size % ALIGNMENT != 0 ||
+            current->chunk_size > static_cast<std::size_t>(heap_end - chunk_end)) {
+            return false;
+        }
+        chunk_end += current->chunk_size;
+        if (current->next != nullptr && reinterpret_cast<char*>(current->next) != chunk_end) {
+            return false;
+        }
+
+        // Per process state: thunk and layout indices, marks, and the quick lists, whose chunks are freed
+        if (reopened) {
+            current->finalizer = 0;
+            current->layout = 0;
+            current->gc_mark = false;
+            current->gc_fixed = false;
+            if (current->in_quick_list) {
+                current->in_quick_list = false;
+                current->is_free = true;
+            }
+        }
+        if (!current->is_free) {
+            allocated++;
+        }
+
+        used_heap_size = chunk_end - start;
+        prev = current;
+        current = current->next;
     }
-    else if (chunk_ptr > root->chunk_ptr) {
-        root->right = remove_node_in_bst(root->right, chunk_ptr);
+
+    // Merge the freed quick list chunks with their free neighbours
+    current = reinterpret_cast<Chunk_Metadata*>(start);
+    while (reopened && current != nullptr) {
+        while (current->is_free && current->next != nullptr && current->next->is_free) {
+            current->chunk_size += sizeof(Chunk_Metadata) + current->next->chunk_size;
+            current->next = current->next->next;
+            if (current->next != nullptr) {
+                current->next->prev = current;
+            }
+        }
+        current = current->next;
     }
-    else {
-        // Node with only one child or no child
-        if (root->left == nullptr) {
-            // Node has no left child
-            BST_Node* temp = root->right; 
-            deallocate_node(root);
-            return temp;
+
+    if (!reserve_nodes(allocated)) {
+        return false;
+    }
+    current = reinterpret_cast<Chunk_Metadata*>(start);
+    allocated_chunks_root = build_bst(current, allocated);
+
+    // Count the restored chunks as allocations, so that live bytes stay right as they are freed
+    for (current = reinterpret_cast<Chunk_Metadata*>(start); reopened && current != nullptr; current = current->next) {
+        if (!current->is_free) {
+            stats.on_allocate(current->chunk_size);
+        }
+    }
+    return true;
+}
+
+BST_Node* Allocator::build_bst(Chunk_Metadata*& cursor, std::size_t count)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // In order, so the depth is log2(count) rather than the list insert_in_bst() makes of sorted keys
+    BST_Node* left = build_bst(cursor, count / 2);
+    while (cursor->is_free) {
+        cursor = cursor->next;
+    }
+    BST_Node* node = allocate_node(cursor->chunk_size, cursor->currentChunk());
+    cursor = cursor->next;
+    node->left = left;
+    node->right = build_bst(cursor, count - count / 2 - 1);
+    return node;
+}
+
+void Allocator::release_bst(BST_Node* root)
+{
+    // Rotate left children up until there are none, so the walk needs no stack however deep the tree is
+    while (root != nullptr) {
+        if (root->left != nullptr) {
+            BST_Node* left = root->left;
+            root->left = left->right;
+            left->right = root;
+            root = left;
         }
-        else if (root->right == nullptr) {
-            // Node has no right child
-            BST_Node* temp = root->left;
+        else {
+            BST_Node* right = root->right;
             deallocate_node(root);
-            return temp;
+            root = right;
         }
+    }
+}
 
-        // Node with two children: Get the inorder successor
-        BST_Node* temp = find_min_node(root->right);
+bool Allocator::sync_persistent_heap()
+{
+    GC_Mutator_Guard guard(*gc);
 
-        root->chunk_ptr = temp->chunk_ptr;
-        root->chunk_size = temp->chunk_size;
+    if (persistent == nullptr) {
+        return false;
+    }
 
-        // Delete the inorder successor
-        root->right = remove_node_in_bst(root->right, temp->chunk_ptr);
+    flush_quick_lists();
+    persistent->used_heap_size = used_heap_size;
+    persistent->heap_capacity = HEAP_CAPACITY;
+    if (msync(persistent, persistent->header_size + HEAP_CAPACITY, MS_SYNC) != 0) {
+        std::cerr << "Error: Failed to write back the heap file" << LBR;
+        return false;
     }
 
-    return root; 
+    out << "Persistent heap synced, " << used_heap_size << " bytes in use" << LBR;
+    log_info();
+    return true;
 }
 
-BST_Node* Allocator::find_min_node(BST_Node* node)
+bool Allocator::set_persistent_root(std::size_t index, void* ptr)
 {
-    BST_Node* current = node;
-    while (current && current->left != nullptr) {
-        current = current->left;
+    GC_Mutator_Guard guard(*gc);
+
+    if (persistent == nullptr || index >= Persistent_Heap_Header::MAX_ROOTS) {
+        return false;
     }
-    return current;
+    persistent->roots[index] = ptr;
+    return true;
 }
 
-int Allocator::expand_heap(std::size_t size)
+void* Allocator::get_persistent_root(std::size_t index) const
 {
-    if (size <= 0) {
-        return 0;  
+    if (persistent == nullptr || index >= Persistent_Heap_Header::MAX_ROOTS) {
+        return nullptr;
+    }
+    return persistent->roots[index];
+}
+
+void Allocator::set_oom_policy(const Oom_Policy& policy)
+{
+    out << "OOM policy set: mode = " << policy.mode << ", emergency_gc = " << policy.emergency_gc << ", trim = " << policy.trim << LBR;
+    log_info();
+    oom_policy = policy;
+}
+
+const Oom_Policy& Allocator::get_oom_policy() const
+{
+    return oom_policy;
+}
+
+void Allocator::collect_for_allocation(std::size_t size)
+{
+    gc->gc_collect(GC_TRIGGER_HEAP_FULL);
+
+    // Soft references only go when keeping them would make this allocation grow the heap
+    if (!fits_in_heap(size) && gc->has_soft_references()) {
+        out << "Collection did not make room for " << size << " bytes, clearing soft references" << LBR;
+        log_info();
+        gc->gc_collect(GC_TRIGGER_LOW_MEMORY);
+    }
+}
+
+bool Allocator::fits_in_heap(std::size_t size) const
+{
+    if (HEAP_CAPACITY - used_heap_size > sizeof(Chunk_Metadata) && size < HEAP_CAPACITY - used_heap_size - sizeof(Chunk_Metadata)) {
+        return true;
+    }
+    for (Chunk_Metadata* current = reinterpret_cast<Chunk_Metadata*>(heap_start);
+         current != nullptr && reinterpret_cast<char*>(current) < reinterpret_cast<char*>(heap_start) + used_heap_size;
+         current = current->next) {
+        if (current->is_free && current->chunk_size >= size) {
+            return true;
+        }
     }
+    return false;
+}
 
-    std::size_t expansion_size = size * 2;
+void* Allocator::out_of_memory(std::size_t size)
+{
+    // A retry below ran out of memory again, let the outer call decide
+    if (handling_oom) {
+        return nullptr;
+    }
 
-    void* result = sbrk(expansion_size);
-    if (result == (void*)-1) {
-        std::cerr << "Error: Failed to expand heap by " << expansion_size << " bytes" << LBR;
-        return 1; 
+    out << "Out of memory for allocation of " << size << " bytes, attempting recovery" << LBR;
+    log_info();
+    stats.oom_events.add(1);
+    handling_oom = true;
+
+    void* chunk_ptr = nullptr;
+    if (oom_policy.low_memory_handler != nullptr) {
+        stats.low_memory_handler_calls.add(1);
+        if (oom_policy.low_memory_handler(size, oom_policy.handler_context)) {
+            chunk_ptr = allocate(size, false);
+        }
     }
 
-    HEAP_CAPACITY += expansion_size;
-    std::cout << "Heap successfully expanded by " << expansion_size
-        << " bytes. New HEAP_CAPACITY: " << HEAP_CAPACITY << LBR;
+    if (chunk_ptr == nullptr) {
+        bool recovered = false;
+        if (oom_policy.emergency_gc && may_collect()) {
+            stats.emergency_gcs.add(1);
+            gc->gc_collect(GC_TRIGGER_EMERGENCY);
+            recovered = true;
+        }
+        if (oom_policy.trim) {
+            recovered = trim() != 0 || recovered;
+        }
+        if (recovered) {
+            chunk_ptr = allocate(size, false);
+        }
+    }
 
-    return 0; 
+    handling_oom = false;
+
+    if (chunk_ptr != nullptr) {
+        out << "Recovered from out of memory for allocation of " << size << " bytes" << LBR;
+        log_info();
+        stats.oom_recoveries.add(1);
+        return chunk_ptr;
+    }
+
+    stats.oom_failures.add(1);
+    std::cerr << "Error: Out of memory, allocation of " << size << " bytes failed" << LBR;
+    if (oom_policy.mode == OOM_THROW_BAD_ALLOC) {
+        throw std::bad_alloc();
+    }
+    if (oom_policy.mode == OOM_EXIT) {
+        exit(1);
+    }
+    return nullptr;
 }
 
-void Allocator::log_info()
+void Allocator::invalid_free(void* ptr, const char* reason)
 {
-    if(DEBUG_MODE){
-        std::string str = out.str();
-        std::cout << "[INFO]    " << str << LBR;
+    stats.invalid_frees.add(1);
+    std::cerr << "Error: " << reason << " (" << ptr << ")" << LBR;
+    if (oom_policy.exit_on_invalid_free) {
+        exit(1);
+    }
+}
+
+std::size_t Allocator::trim(std::size_t pad)
+{
+    char* heap_end = reinterpret_cast<char*>(heap_start) + HEAP_CAPACITY;
+
+    // The space can only go back if nothing was mapped above the heap since it last grew
+    if (heap_backing == HEAP_BACKING_SBRK && sbrk(0) != heap_end) {
+        out << "Heap cannot be trimmed, the program break moved" << LBR;
+        log_info();
+        return 0;
     }
-    out.str(""); // Clear out the contents after logging
-    out.clear();
+
+    // Keep the trailing free chunk (or the untracked space after the last chunk) down to `pad` bytes
+    Chunk_Metadata* last = last_chunk();
+    bool free_tail = last != nullptr && last->is_free && reinterpret_cast<char*>(last) + sizeof(Chunk_Metadata) + last->chunk_size == heap_end;
+    char* keep_from = free_tail ? reinterpret_cast<char*>(last->currentChunk()) : reinterpret_cast<char*>(heap_start) + used_heap_size;
+
+    // A huge page heap keeps whole huge pages, so that it never splits one the kernel has collapsed
+    bool huge_backing = heap_backing == HEAP_BACKING_THP || heap_backing == HEAP_BACKING_HUGETLB;
+    std::uintptr_t page_size = huge_backing ? Heap_Growth_Policy::HUGE_PAGE_SIZE : static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    std::uintptr_t new_end = (reinterpret_cast<std::uintptr_t>(keep_from) + align_size(pad == 0 ? ALIGNMENT : pad) + page_size - 1) / page_size * page_size;
+    if (new_end >= reinterpret_cast<std::uintptr_t>(heap_end)) {
+        return 0;
+    }
+
+    std::size_t released = reinterpret_cast<std::uintptr_t>(heap_end) - new_end;
+    if (persistent != nullptr) {
+        // Shrinking the file frees its blocks, the mapping stays reserved
+        if (ftruncate(persistent_fd, persistent->header_size + HEAP_CAPACITY - released) != 0) {
+            return 0;
+        }
+    }
+    else if (heap_backing != HEAP_BACKING_SBRK) {
+        // Keep the reservation, only drop the pages behind it
+        if (madvise(reinterpret_cast<void*>(new_end), released, MADV_DONTNEED) != 0) {
+            return 0;
+        }
+    }
+    else if (sbrk(-static_cast<std::intptr_t>(released)) == (void*)-1) {
+        return 0;
+    }
+
+    HEAP_CAPACITY -= released;
+    if (free_tail) {
+        last->chunk_size -= released;
+        used_heap_size = HEAP_CAPACITY;
+    }
+    stats.heap_capacity.set(HEAP_CAPACITY);
+    stats.heap_used.set(used_heap_size);
+    stats.heap_trims.add(1);
+    stats.trimmed_bytes.add(released);
+    gc->HEAP_CAPACITY = HEAP_CAPACITY;
+
+    out << "Heap trimmed by " << released << " bytes. New HEAP_CAPACITY: " << HEAP_CAPACITY << LBR;
+    log_info();
+    return released;
+}
+
+void Allocator::log_info()
+{
+    out.flush();
 }
\ No newline at end of file
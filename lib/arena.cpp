@@ -0,0 +1,139 @@
+#include "arena.h"
+#include "allocator.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+Arena::Arena(std::size_t block_size)
+    : owner(this), block_size(block_size), current_block(nullptr), offset(0), destructors(nullptr), allocated(0),
+      saved_block(nullptr), saved_offset(0), saved_destructors(nullptr), saved_allocated(0)
+{
+}
+
+Arena::Arena(Arena& parent)
+    : owner(parent.owner), block_size(parent.block_size), current_block(nullptr), offset(0), destructors(nullptr), allocated(0),
+      saved_block(parent.owner->current_block), saved_offset(parent.owner->offset),
+      saved_destructors(parent.owner->destructors), saved_allocated(parent.owner->allocated)
+{
+}
+
+Arena::~Arena()
+{
+    if (owner != this) {
+        reset();
+        return;
+    }
+    rewind(nullptr, 0, nullptr, 0);
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    if (owner != this) {
+        return owner->allocate(size, alignment);
+    }
+
+    if (size == 0) {
+        size = 1;
+    }
+
+    // Try to fit the request in the current block, otherwise start a new one
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (current_block != nullptr) {
+            std::uintptr_t data_start = reinterpret_cast<std::uintptr_t>(current_block) + sizeof(Block_Header);
+            std::uintptr_t aligned = (data_start + offset + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            std::size_t new_offset = static_cast<std::size_t>(aligned - data_start) + size;
+
+            if (new_offset <= current_block->capacity) {
+                offset = new_offset;
+                allocated += size;
+                return reinterpret_cast<void*>(aligned);
+            }
+        }
+
+        if (attempt == 0 && !grow(size, alignment)) {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool Arena::register_destructor(void (*destructor)(void*), void* object)
+{
+    if (owner != this) {
+        return owner->register_destructor(destructor, object);
+    }
+
+    Destructor_Record* record = static_cast<Destructor_Record*>(allocate(sizeof(Destructor_Record), alignof(Destructor_Record)));
+    if (record == nullptr) {
+        return false;
+    }
+
+    record->destructor = destructor;
+    record->object = object;
+    record->next = destructors;
+    destructors = record;
+    return true;
+}
+
+void Arena::reset()
+{
+    if (owner != this) {
+        owner->rewind(saved_block, saved_offset, saved_destructors, saved_allocated);
+        return;
+    }
+
+    // Keep the first block around so that the next round of allocations does not hit the Allocator
+    Block_Header* first_block = current_block;
+    while (first_block != nullptr && first_block->prev != nullptr) {
+        first_block = first_block->prev;
+    }
+    rewind(first_block, 0, nullptr, 0);
+}
+
+std::size_t Arena::bytes_allocated() const
+{
+    if (owner != this) {
+        return owner->allocated - saved_allocated;
+    }
+    return allocated;
+}
+
+bool Arena::grow(std::size_t size, std::size_t alignment)
+{
+    std::size_t needed = sizeof(Block_Header) + size + alignment;
+    std::size_t bytes = needed > block_size ? needed : block_size;
+
+    // Blocks are pinned so that the collector neither sweeps them nor misses the objects they reference
+    Allocator& alloc = Allocator::getInstance();
+    Block_Header* block = static_cast<Block_Header*>(alloc.allocate_pinned(bytes));
+    if (block == nullptr) {
+        return false;
+    }
+
+    block->prev = current_block;
+    block->capacity = bytes - sizeof(Block_Header);
+    current_block = block;
+    offset = 0;
+    return true;
+}
+
+void Arena::rewind(Block_Header* block, std::size_t block_offset, Destructor_Record* destructor_list, std::size_t allocated_bytes)
+{
+    // Destroy objects in reverse order of construction. Records live inside the blocks, so run them before freeing.
+    while (destructors != nullptr && destructors != destructor_list) {
+        Destructor_Record* record = destructors;
+        destructors = record->next;
+        record->destructor(record->object);
+    }
+
+    Allocator& alloc = Allocator::getInstance();
+    while (current_block != nullptr && current_block != block) {
+        Block_Header* prev = current_block->prev;
+        alloc.deallocate(current_block);
+        current_block = prev;
+    }
+
+    offset = current_block != nullptr ? block_offset : 0;
+    allocated = allocated_bytes;
+}
@@ -5,14 +5,25 @@
 #include <sstream>
 #include <string>
 #include <iostream>
+#include <new>
+#include <chrono>
+#include <cstdint>
+#include <csetjmp>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 
 #define LBR '\n'
 #define MAX_ARRAY_CAP 1000
+#define ROOT_SLOT_POOL_SIZE 4096
 
+const std::size_t Garbage_Collector::MAX_THREADS;
+thread_local GC_Thread* Garbage_Collector::current_thread = nullptr;
 
 
-Garbage_Collector::Garbage_Collector(bool debug_mode, void* heap_start, size_t HEAP_CAPACITY):DEBUG_MODE(debug_mode), heap_start(heap_start), HEAP_CAPACITY(HEAP_CAPACITY) {
+Garbage_Collector::Garbage_Collector(bool debug_mode, void* heap_start, size_t HEAP_CAPACITY):out(debug_mode), DEBUG_MODE(debug_mode), heap_start(heap_start), HEAP_CAPACITY(HEAP_CAPACITY) {
     out << "Garbage Collector Instantiated" << LBR;
     log_info();
     out << "HEAP_START : " << heap_start << LBR;
@@ -23,12 +34,7 @@ Garbage_Collector::Garbage_Collector(bool debug_mode, void* heap_start, size_t H
 }
 
 void Garbage_Collector::log_info(){
-    if (DEBUG_MODE) {
-        std::string str = out.str();
-        std::cout << "[INFO]    " << str << LBR;
-    }
-    out.str(""); // Clear out the contents after logging
-    out.clear();
+    out.flush();
 }
 
 bool Garbage_Collector::is_pointer_within_heap(void* ptr)
@@ -59,6 +65,7 @@ void Garbage_Collector::get_roots() {
 
     // Reset the root list size for this round
     root_chunk_list_size = 0;
+    mark_overflow = false;
 
     // Variable `j` is used to compact the list of potential stack variables containing roots for next round
     int j = 0;
@@ -83,11 +90,15 @@ void Garbage_Collector::get_roots() {
             Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
             Chunk_Metadata* chunk_ptr = alloc.get_chunk(*potential_root);
 
-            // If a valid chunk is found, add it to the root chunk list
-            if (chunk_ptr != nullptr) {
-                // Add the pointer to the chunk metadata to the root chunk list
-                root_chunk_list[root_chunk_list_size] = reinterpret_cast<void*>(chunk_ptr);
-                root_chunk_list_size++;
+            // If a valid allocated chunk is found, add it to the root chunk list
+            if (chunk_ptr != nullptr && !chunk_ptr->is_free) {
+                // A root stored in the heap may also be a traced field of its chunk, so its target stays in place
+                if (is_pointer_within_heap(potential_root)) {
+                    chunk_ptr->gc_fixed = true;
+                }
+                if (push_root(chunk_ptr)) {
+                    cycle.roots++;
+                }
 
                 // Optimize: Retain only valid roots in the potential stack variables list for the next call
                 potential_stack_vars_containing_roots_list[j] = potential_root;
@@ -99,10 +110,255 @@ void Garbage_Collector::get_roots() {
     // Update the size of the potential stack variables list to include only valid roots
     potential_roots_size = j;
 
-    out << "Root list updated. Total roots: " << root_chunk_list_size << LBR;
+    // Pinned chunks are manually managed and act as roots for whatever they reference
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    cycle.roots += alloc.gc_add_pinned_roots();
+
+    // The root table of a persistent heap is how the program finds its objects after a restart
+    cycle.roots += alloc.gc_add_persistent_roots();
+
+    // Objects waiting for their destructors still own what they reference
+    finalizer.for_each_object([&](void* object) {
+        Chunk_Metadata* chunk_ptr = alloc.get_chunk(object);
+        if (chunk_ptr == nullptr || chunk_ptr->is_free) {
+            return;
+        }
+        // The queue refers to them, and the finalizer thread may be running a destructor on one
+        chunk_ptr->gc_fixed = true;
+        if (push_root(chunk_ptr)) {
+            cycle.roots++;
+        }
+    });
+
+    // Soft references keep their targets until the heap runs out of room
+    if (!clearing_soft_refs) {
+        add_handle_roots(soft_refs);
+    }
+
+    // Every live gc_ptr handle is a root, and nothing else in the handle lists is
+    add_handle_roots(root_slots);
+    for (std::size_t i = 0; i < MAX_THREADS; i++) {
+        if (threads[i].in_use) {
+            add_handle_roots(threads[i].roots);
+        }
+    }
+
+    out << "Root list updated. Total roots: " << cycle.roots << LBR;
     log_info();
 }
 
+bool Garbage_Collector::push_root(Chunk_Metadata* chunk)
+{
+    // Drain the root list by marking instead of dropping the root
+    if (!chunk->gc_mark && root_chunk_list_size >= MAX_ARRAY_CAP) {
+        mark_phase();
+    }
+    // Marking may have reached the chunk in the meantime
+    if (chunk->gc_mark) {
+        return false;
+    }
+    root_chunk_list[root_chunk_list_size] = reinterpret_cast<void*>(chunk);
+    root_chunk_list_size++;
+    return true;
+}
+
+void Garbage_Collector::add_handle_roots(GC_Root_List& list)
+{
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    for (GC_Root_Slot* slot = list.head.next; slot != &list.head; slot = slot->next) {
+        if (slot->ptr != nullptr && is_pointer_within_heap(slot->ptr)) {
+            Chunk_Metadata* chunk_ptr = alloc.get_chunk(slot->ptr);
+            if (chunk_ptr != nullptr && !chunk_ptr->is_free && push_root(chunk_ptr)) {
+                cycle.roots++;
+            }
+        }
+    }
+}
+
+std::uint64_t Garbage_Collector::clear_references(GC_Root_List& list)
+{
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    std::uint64_t cleared = 0;
+    for (GC_Root_Slot* slot = list.head.next; slot != &list.head; slot = slot->next) {
+        if (slot->ptr == nullptr) {
+            continue;
+        }
+        Chunk_Metadata* chunk_ptr = alloc.get_chunk(slot->ptr);
+        if (chunk_ptr == nullptr || chunk_ptr->is_free || !chunk_ptr->gc_mark) {
+            slot->ptr = nullptr;
+            cleared++;
+        }
+    }
+    return cleared;
+}
+
+bool Garbage_Collector::has_soft_references()
+{
+    soft_refs.lock();
+    bool found = false;
+    for (GC_Root_Slot* slot = soft_refs.head.next; slot != &soft_refs.head && !found; slot = slot->next) {
+        found = slot->ptr != nullptr;
+    }
+    soft_refs.unlock();
+    return found;
+}
+
+bool Garbage_Collector::add_root_slot_pool(GC_Root_List* list)
+{
+    // mmap, like the BST node pools, so handles work while the Allocator replaces malloc
+    void* pool = mmap(nullptr, ROOT_SLOT_POOL_SIZE * sizeof(GC_Root_Slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED) {
+        std::cerr << "Error: Failed to map root slot pool" << LBR;
+        return false;
+    }
+
+    GC_Root_Slot* slots = static_cast<GC_Root_Slot*>(pool);
+    for (std::size_t i = 0; i < ROOT_SLOT_POOL_SIZE; i++) {
+        slots[i].next = list->free_slots;
+        list->free_slots = &slots[i];
+    }
+    return true;
+}
+
+void Garbage_Collector::finalize_phase()
+{
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    std::size_t first = finalizer.begin_batch();
+    alloc.gc_find_finalizable(finalizer);
+    Finalizer_Entry* candidates = finalizer.batch(first);
+    std::size_t count = finalizer.batch_size(first);
+
+    // Keep what each candidate references alive for its destructor. The candidate itself is
+    // marked meanwhile, so that a pointer to itself does not count as being referenced.
+    for (std::size_t i = 0; i < count; i++) {
+        Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(static_cast<char*>(candidates[i].object) - sizeof(Chunk_Metadata));
+        if (chunk->gc_mark) {
+            continue;
+        }
+        chunk->gc_mark = true;
+        find_chunks_within_chunk(chunk);
+        mark_phase();
+        chunk->gc_mark = false;
+    }
+
+    // A candidate marked by now is referenced by another one, whose destructor may still use it
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        Chunk_Metadata* chunk = reinterpret_cast<Chunk_Metadata*>(static_cast<char*>(candidates[i].object) - sizeof(Chunk_Metadata));
+        if (chunk->gc_mark) {
+            continue;
+        }
+        chunk->gc_mark = true;
+        chunk->gc_fixed = true;
+        chunk->finalizer = 0;
+        lines.mark(chunk, reinterpret_cast<char*>(chunk->currentChunk()) + chunk->chunk_size);
+        candidates[kept] = candidates[i];
+        kept++;
+    }
+    finalizer.end_batch(first, kept);
+
+    cycle.finalizers_queued = kept;
+    alloc.stats.finalizers_queued.add(kept);
+    out << "Queued " << kept << " of " << count << " unreachable finalizable chunks" << LBR;
+    log_info();
+}
+
+void Garbage_Collector::compact_phase()
+{
+    out << "Starting compaction phase.." << LBR;
+    log_info();
+
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    compactor.clear();
+    if (!alloc.gc_plan_compaction(compactor, cycle.chunks_fixed)) {
+        std::cerr << "Error: Failed to map the relocation table, heap left uncompacted" << LBR;
+        return;
+    }
+    if (compactor.size() == 0) {
+        out << "Nothing to compact" << LBR;
+        log_info();
+        return;
+    }
+
+    relocate_references();
+    alloc.gc_move_chunks(compactor);
+
+    cycle.chunks_moved = compactor.size();
+    cycle.bytes_moved = compactor.moved_bytes();
+    alloc.stats.gc_compactions.add(1);
+    alloc.stats.gc_bytes_moved.add(compactor.moved_bytes());
+    out << "Moved " << cycle.chunks_moved << " chunks (" << cycle.bytes_moved << " bytes), "
+        << cycle.chunks_fixed << " stayed in place" << LBR;
+    log_info();
+}
+
+void Garbage_Collector::evacuate_phase()
+{
+    out << "Starting evacuation phase.." << LBR;
+    log_info();
+
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    cycle.blocks_evacuated = lines.select_candidates(region_config.evacuation_threshold, region_config.max_evacuated_blocks);
+    if (cycle.blocks_evacuated == 0) {
+        out << "No block sparse enough to evacuate" << LBR;
+        log_info();
+        return;
+    }
+
+    // Destinations are reserved by the plan, what does not fit stays in its block
+    compactor.clear();
+    alloc.gc_plan_evacuation(compactor, lines);
+    if (compactor.size() == 0) {
+        out << "Nothing to evacuate" << LBR;
+        log_info();
+        return;
+    }
+
+    relocate_references();
+    alloc.gc_evacuate_chunks(compactor, lines);
+
+    cycle.chunks_moved = compactor.size();
+    cycle.bytes_moved = compactor.moved_bytes();
+    alloc.stats.gc_evacuations.add(1);
+    alloc.stats.gc_bytes_moved.add(compactor.moved_bytes());
+    out << "Evacuated " << cycle.chunks_moved << " chunks (" << cycle.bytes_moved << " bytes) out of "
+        << cycle.blocks_evacuated << " blocks" << LBR;
+    log_info();
+}
+
+void Garbage_Collector::relocate_references()
+{
+    // Every reference is rewritten where it is now, before the chunk holding it moves. The new
+    // values are computed first, since the same variable may have been registered more than once.
+    void* targets[MAX_ARRAY_CAP];
+    for (int i = 0; i < potential_roots_size; i++) {
+        targets[i] = compactor.relocate(*potential_stack_vars_containing_roots_list[i]);
+    }
+    for (int i = 0; i < potential_roots_size; i++) {
+        *potential_stack_vars_containing_roots_list[i] = targets[i];
+        potential_stack_vars_containing_roots_list[i] = static_cast<void**>(compactor.relocate(potential_stack_vars_containing_roots_list[i]));
+    }
+
+    relocate_slots(root_slots);
+    for (std::size_t i = 0; i < MAX_THREADS; i++) {
+        if (threads[i].in_use) {
+            relocate_slots(threads[i].roots);
+        }
+    }
+    relocate_slots(weak_refs);
+    relocate_slots(soft_refs);
+
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    alloc.gc_relocate_fields(compactor);
+}
+
+void Garbage_Collector::relocate_slots(GC_Root_List& list)
+{
+    for (GC_Root_Slot* slot = list.head.next; slot != &list.head; slot = slot->next) {
+        slot->ptr = compactor.relocate(slot->ptr);
+    }
+}
+
 void Garbage_Collector::unmark_chunks()
 {
     out << "Called unmarked_chunks().." << LBR
@@ -111,6 +367,11 @@ void Garbage_Collector::unmark_chunks()
 
     Allocator& alloc = Allocator::getInstance();
     alloc.gc_unmark_chunks();
+
+    // Line marks are rebuilt by every mark phase
+    if (!lines.reset(heap_start, HEAP_CAPACITY)) {
+        std::cerr << "Error: Failed to map the line mark table" << LBR;
+    }
 }
 
 void Garbage_Collector::find_chunks_within_chunk(Chunk_Metadata* top)
@@ -118,7 +379,7 @@ void Garbage_Collector::find_chunks_within_chunk(Chunk_Metadata* top)
     out << "Searching chunks within >> " << top << LBR;
     log_info();
     Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
-    alloc.find_chunks_within_chunk(top, root_chunk_list, root_chunk_list_size);
+    alloc.find_chunks_within_chunk(top, root_chunk_list, root_chunk_list_size, mark_overflow);
 }
 
 void Garbage_Collector::sweep_phase()
@@ -135,29 +396,598 @@ void Garbage_Collector::sweep_phase()
 
 Garbage_Collector& Garbage_Collector::getInstance(void* heap_start, size_t HEAP_CAPACITY, bool debug_mode)
 {
-    static Garbage_Collector gc(debug_mode, heap_start, HEAP_CAPACITY);
-    return gc;
+    // Never destroyed, for the same reason as the Allocator singleton
+    alignas(Garbage_Collector) static unsigned char storage[sizeof(Garbage_Collector)];
+    static Garbage_Collector* gc = new (storage) Garbage_Collector(debug_mode, heap_start, HEAP_CAPACITY);
+    return *gc;
+}
+
+namespace {
+
+std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
 }
 
-void Garbage_Collector::gc_collect()
+}
+
+void Garbage_Collector::gc_collect(GC_Trigger trigger)
 {
-    out << "-------- Called GC Collect --------" << LBR;
+    // Other processes' roots are invisible here, see Allocator::attach_shared_heap()
+    if (heap_shared) {
+        out << "Collection skipped, the heap is shared" << LBR;
+        log_info();
+        return;
+    }
+
+    // Nested inside an allocation this only takes the heap lock once more
+    GC_Mutator_Guard guard(*this);
+
+    out << "-------- Called GC Collect (" << gc_trigger_name(trigger) << ") --------" << LBR;
     log_info();
 
-    get_roots();
-    
+    auto start = std::chrono::steady_clock::now();
+    cycle = GC_Cycle_Record();
+    cycle.cycle = telemetry.total_cycles() + 1;
+    cycle.trigger = trigger;
+    cycle.start_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count());
+
+    clearing_soft_refs = trigger == GC_TRIGGER_LOW_MEMORY || trigger == GC_TRIGGER_EMERGENCY;
+
+    // Registration takes the heap lock, so the registry cannot change until the guard is released
+    bool stopped = threads_active();
+    if (stopped) {
+        stop_the_world();
+    }
+
+    // Parked chunks look allocated but are unreachable, hand them back before marking
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    alloc.flush_quick_lists();
+
+    // Unmark first: pushing roots may already mark, when the root list fills up
+    auto phase_start = std::chrono::steady_clock::now();
     unmark_chunks();
-    
+    auto phase_end = std::chrono::steady_clock::now();
+    cycle.unmark_ns = elapsed_ns(phase_start, phase_end);
+
+    phase_start = phase_end;
+    get_roots();
+    phase_end = std::chrono::steady_clock::now();
+    cycle.get_roots_ns = elapsed_ns(phase_start, phase_end);
+
+    if (conservative_roots) {
+        phase_start = phase_end;
+        scan_conservative_roots();
+        phase_end = std::chrono::steady_clock::now();
+        cycle.scan_ns = elapsed_ns(phase_start, phase_end);
+    }
+
+    phase_start = phase_end;
     mark_phase();
 
+    // References to unmarked targets are cleared before finalization keeps those targets alive
+    cycle.weak_cleared = clear_references(weak_refs);
+    if (clearing_soft_refs) {
+        cycle.soft_cleared = clear_references(soft_refs);
+    }
+    if (finalizer.is_running()) {
+        finalize_phase();
+    }
+    phase_end = std::chrono::steady_clock::now();
+    cycle.mark_ns = elapsed_ns(phase_start, phase_end);
+    cycle.lines_marked = lines.get_lines_marked();
+    for (std::size_t block = 0; block < lines.get_block_count(); block++) {
+        if (lines.is_recycled(block)) {
+            cycle.blocks_recycled++;
+        }
+    }
+
+    // The sweep reports what it frees through the allocator's counters
+    std::uint64_t chunks_reclaimed = alloc.stats.gc_chunks_reclaimed.get();
+    std::uint64_t bytes_reclaimed = alloc.stats.gc_bytes_reclaimed.get();
+    phase_start = phase_end;
     sweep_phase();
-    
+    phase_end = std::chrono::steady_clock::now();
+    cycle.sweep_ns = elapsed_ns(phase_start, phase_end);
+    cycle.chunks_freed = alloc.stats.gc_chunks_reclaimed.get() - chunks_reclaimed;
+    cycle.bytes_swept = alloc.stats.gc_bytes_reclaimed.get() - bytes_reclaimed;
+
+    std::size_t free_bytes = 0;
+    std::size_t largest_free_block = 0;
+    alloc.gc_measure_free_space(free_bytes, largest_free_block);
+    bool compacting = trigger == GC_TRIGGER_COMPACT || compactor.should_compact(free_bytes, largest_free_block);
+    if (compacting) {
+        phase_start = phase_end;
+        compact_phase();
+        phase_end = std::chrono::steady_clock::now();
+        cycle.compact_ns = elapsed_ns(phase_start, phase_end);
+    }
+    else if (region_config.evacuate) {
+        phase_start = phase_end;
+        evacuate_phase();
+        phase_end = std::chrono::steady_clock::now();
+        cycle.evacuate_ns = elapsed_ns(phase_start, phase_end);
+    }
+
+    // Compaction leaves no holes worth bumping through, and moved chunks the line marks describe
+    alloc.gc_find_holes(region_config.recycle && !compacting ? &lines : nullptr);
+
+    if (stopped) {
+        start_the_world();
+    }
+
+    cycle.pause_ns = elapsed_ns(start, phase_end);
+    alloc.stats.gc_cycles.add(1);
+    alloc.stats.gc_pause_ns.add(cycle.pause_ns);
+
+    out << "GC cycle " << cycle.cycle << " took " << cycle.pause_ns << " ns, freed " << cycle.chunks_freed
+        << " chunks (" << cycle.bytes_swept << " bytes)" << LBR;
+    log_info();
+
+    pacer.on_cycle_end(cycle, alloc.stats.bytes_allocated.get() - alloc.stats.bytes_freed.get(), alloc.stats.bytes_allocated.get());
+    telemetry.record(cycle);
+}
+
+void Garbage_Collector::set_cycle_callback(GC_Cycle_Callback callback, void* context)
+{
+    telemetry.set_callback(callback, context);
+}
+
+std::size_t Garbage_Collector::get_cycle_records(GC_Cycle_Record* out, std::size_t max_records) const
+{
+    return telemetry.get_records(out, max_records);
+}
+
+GC_Pause_Summary Garbage_Collector::get_pause_summary() const
+{
+    return telemetry.summary();
+}
+
+void Garbage_Collector::set_pacing_config(const GC_Pacing_Config& config)
+{
+    out << "Pacing " << (config.enabled ? "enabled" : "disabled") << ", gc_percent = " << config.gc_percent << LBR;
+    log_info();
+    pacer.set_config(config);
+}
+
+const GC_Pacing_Config& Garbage_Collector::get_pacing_config() const
+{
+    return pacer.get_config();
+}
+
+const GC_Pacing_State& Garbage_Collector::get_pacing_state() const
+{
+    return pacer.get_state();
+}
+
+namespace {
+
+// Highest address of the calling thread's stack, or nullptr if it cannot be found
+void* calling_thread_stack_base()
+{
+    pthread_attr_t attr;
+    void* stack_addr = nullptr;
+    std::size_t stack_size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return nullptr;
+    }
+    pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+    pthread_attr_destroy(&attr);
+    return reinterpret_cast<char*>(stack_addr) + stack_size;
+}
+
+}
+
+bool Garbage_Collector::set_conservative_roots(bool enabled, void* stack_base)
+{
+    if (enabled && stack_base == nullptr) {
+        stack_base = calling_thread_stack_base();
+        if (stack_base == nullptr) {
+            std::cerr << "Error: Cannot find the stack of the calling thread" << LBR;
+            return false;
+        }
+    }
+
+    out << "Conservative root scanning " << (enabled ? "enabled" : "disabled") << ", stack base = " << stack_base << LBR;
+    log_info();
+    conservative_roots = enabled;
+    this->stack_base = enabled ? stack_base : nullptr;
+    return true;
+}
+
+void Garbage_Collector::set_compaction_config(const GC_Compaction_Config& config)
+{
+    out << "Compaction config set: enabled = " << config.enabled << ", fragmentation_threshold = "
+        << config.fragmentation_threshold << ", min_free_bytes = " << config.min_free_bytes << LBR;
+    log_info();
+    compactor.set_config(config);
+}
+
+const GC_Compaction_Config& Garbage_Collector::get_compaction_config() const
+{
+    return compactor.get_config();
+}
+
+void Garbage_Collector::set_region_config(const GC_Region_Config& config)
+{
+    out << "Region config set: recycle = " << config.recycle << ", evacuate = " << config.evacuate
+        << ", evacuation_threshold = " << config.evacuation_threshold << ", max_evacuated_blocks = " << config.max_evacuated_blocks << LBR;
+    log_info();
+    region_config = config;
+}
+
+const GC_Region_Config& Garbage_Collector::get_region_config() const
+{
+    return region_config;
+}
+
+void Garbage_Collector::gc_compact()
+{
+    gc_collect(GC_TRIGGER_COMPACT);
+}
+
+bool Garbage_Collector::get_conservative_roots() const
+{
+    return conservative_roots;
+}
+
+void Garbage_Collector::set_compressed_scan(bool enabled)
+{
+    out << "Compressed pointer scanning " << (enabled ? "enabled" : "disabled") << LBR;
+    log_info();
+    compressed_scan = enabled;
+}
+
+bool Garbage_Collector::get_compressed_scan() const
+{
+    return compressed_scan;
+}
+
+bool Garbage_Collector::register_thread(void* stack_base)
+{
+    if (current_thread != nullptr) {
+        return true;
+    }
+    if (stack_base == nullptr) {
+        stack_base = calling_thread_stack_base();
+        if (stack_base == nullptr) {
+            std::cerr << "Error: Cannot find the stack of the calling thread" << LBR;
+            return false;
+        }
+    }
+
+    // Not registered yet, so no collection waits for this thread while it waits for the lock
+    Heap_Lock_Guard lock;
+    for (std::size_t i = 0; i < MAX_THREADS; i++) {
+        GC_Thread& thread = threads[i];
+        if (thread.in_use) {
+            continue;
+        }
+        thread.in_use = true;
+        thread.stack_base = stack_base;
+        thread.stack_pointer = nullptr;
+        thread.lock_depth = 0;
+        thread.state.store(GC_THREAD_RUNNING, std::memory_order_seq_cst);
+        current_thread = &thread;
+        registered_threads.fetch_add(1, std::memory_order_relaxed);
+
+        out << "Registered thread " << i << ", stack base = " << stack_base << LBR;
+        log_info();
+        return true;
+    }
+
+    std::cerr << "Error: Cannot register more than " << MAX_THREADS << " threads" << LBR;
+    return false;
+}
+
+void Garbage_Collector::unregister_thread()
+{
+    GC_Thread* self = current_thread;
+    if (self == nullptr) {
+        return;
+    }
+
+    GC_Mutator_Guard guard(*this);
+
+    // The thread's handles may outlive it, hand them and its free slots to the shared list
+    self->roots.lock();
+    root_slots.lock();
+    if (self->roots.head.next != &self->roots.head) {
+        for (GC_Root_Slot* slot = self->roots.head.next; slot != &self->roots.head; slot = slot->next) {
+            slot->list.store(&root_slots, std::memory_order_release);
+        }
+        GC_Root_Slot* first = self->roots.head.next;
+        GC_Root_Slot* last = self->roots.head.prev;
+        first->prev = &root_slots.head;
+        last->next = root_slots.head.next;
+        root_slots.head.next->prev = last;
+        root_slots.head.next = first;
+        self->roots.head.next = &self->roots.head;
+        self->roots.head.prev = &self->roots.head;
+    }
+    while (self->roots.free_slots != nullptr) {
+        GC_Root_Slot* slot = self->roots.free_slots;
+        self->roots.free_slots = slot->next;
+        slot->next = root_slots.free_slots;
+        root_slots.free_slots = slot;
+    }
+    root_slots.unlock();
+    self->roots.unlock();
+
+    out << "Unregistered thread " << (self - threads) << LBR;
+    log_info();
+
+    self->in_use = false;
+    registered_threads.fetch_sub(1, std::memory_order_relaxed);
+    current_thread = nullptr;
+}
+
+bool Garbage_Collector::start_finalizer_thread()
+{
+    if (!finalizer.start(*this)) {
+        std::cerr << "Error: Failed to start the finalizer thread" << LBR;
+        return false;
+    }
+    out << "Finalizer thread started" << LBR;
+    log_info();
+    return true;
+}
+
+void Garbage_Collector::stop_finalizer_thread()
+{
+    finalizer.stop();
+    out << "Finalizer thread stopped" << LBR;
+    log_info();
+}
+
+std::size_t Garbage_Collector::get_pending_finalizers()
+{
+    return finalizer.pending();
+}
+
+std::size_t Garbage_Collector::get_registered_threads() const
+{
+    return registered_threads.load(std::memory_order_relaxed);
+}
+
+void Garbage_Collector::lock_heap_at_safepoint()
+{
+    GC_Thread* self = current_thread;
+
+    // Collections do not wait for unregistered threads, and a nested entry already holds the lock
+    if (self == nullptr || self->lock_depth != 0) {
+        lock_heap();
+        if (self != nullptr) {
+            self->lock_depth++;
+        }
+        return;
+    }
+
+    safepoint();
+
+    // Whoever holds the lock may be collecting and waiting for this thread
+    std::jmp_buf registers;
+    enter_blocking(registers);
+    lock_heap();
+    leave_blocking();
+    self->lock_depth++;
+}
+
+void Garbage_Collector::unlock_heap_at_safepoint()
+{
+    // unregister_thread() clears current_thread while its guard holds the lock
+    if (current_thread != nullptr) {
+        current_thread->lock_depth--;
+    }
+    unlock_heap();
+}
+
+bool Garbage_Collector::lock_shared_heap()
+{
+    return Allocator::getInstance(DEBUG_MODE).lock_shared_heap();
+}
+
+void Garbage_Collector::unlock_shared_heap()
+{
+    Allocator::getInstance(DEBUG_MODE).unlock_shared_heap();
+}
+
+void Garbage_Collector::park()
+{
+    GC_Thread* self = current_thread;
+    if (self == nullptr || self->lock_depth != 0) {
+        return;
+    }
+
+    std::jmp_buf registers;
+    enter_blocking(registers);
+    self->state.store(GC_THREAD_PARKED, std::memory_order_seq_cst);
+    leave_blocking();
+}
+
+void Garbage_Collector::enter_blocking(std::jmp_buf& registers)
+{
+    GC_Thread* self = current_thread;
+    if (self == nullptr) {
+        return;
+    }
+
+    // Spill the callee-saved registers as in scan_conservative_roots(), then publish the lowest
+    // address the collector has to scan: this frame, or the spill buffer if this call was inlined
+#if defined(__GNUC__)
+    __builtin_unwind_init();
+#endif
+    setjmp(registers);
+    char* frame = reinterpret_cast<char*>(__builtin_frame_address(0));
+    char* spill = reinterpret_cast<char*>(&registers);
+    self->stack_pointer = frame < spill ? frame : spill;
+    self->state.store(GC_THREAD_BLOCKED, std::memory_order_seq_cst);
+}
+
+void Garbage_Collector::leave_blocking()
+{
+    GC_Thread* self = current_thread;
+    if (self == nullptr) {
+        return;
+    }
+
+    // Running is published before stop_requested is read, and stop_the_world() publishes
+    // stop_requested before reading the state, so one of the two always sees the other
+    unsigned waiting_state = self->state.load(std::memory_order_relaxed);
+    for (;;) {
+        self->state.store(GC_THREAD_RUNNING, std::memory_order_seq_cst);
+        if (!stop_requested.load(std::memory_order_seq_cst)) {
+            return;
+        }
+
+        // The collector may already be scanning from stack_pointer, so wait without moving it
+        self->state.store(waiting_state, std::memory_order_seq_cst);
+        pthread_mutex_lock(&park_mutex);
+        while (stop_requested.load(std::memory_order_relaxed)) {
+            pthread_cond_wait(&resume, &park_mutex);
+        }
+        pthread_mutex_unlock(&park_mutex);
+    }
+}
+
+void Garbage_Collector::stop_the_world()
+{
+    auto start = std::chrono::steady_clock::now();
+    stop_requested.store(true, std::memory_order_seq_cst);
+
+    GC_Thread* self = current_thread;
+    for (std::size_t i = 0; i < MAX_THREADS; i++) {
+        GC_Thread& thread = threads[i];
+        if (!thread.in_use || &thread == self) {
+            continue;
+        }
+        // Threads reach a safepoint within one allocation or assign, spinning beats a futex round trip
+        while (thread.state.load(std::memory_order_seq_cst) == GC_THREAD_RUNNING) {
+            sched_yield();
+        }
+        cycle.threads_stopped++;
+    }
+
+    cycle.safepoint_ns = elapsed_ns(start, std::chrono::steady_clock::now());
+    out << "Stopped " << cycle.threads_stopped << " threads in " << cycle.safepoint_ns << " ns" << LBR;
+    log_info();
+}
+
+void Garbage_Collector::start_the_world()
+{
+    pthread_mutex_lock(&park_mutex);
+    stop_requested.store(false, std::memory_order_seq_cst);
+    pthread_cond_broadcast(&resume);
+    pthread_mutex_unlock(&park_mutex);
+}
+
+namespace {
+
+// Writable segments of the loaded objects, collected without allocating
+struct Segment_List {
+    static const std::size_t CAPACITY = 1024;
+    char* ranges[CAPACITY][2];
+    std::size_t count;
+};
+
+int collect_writable_segments(dl_phdr_info* info, std::size_t, void* data)
+{
+    Segment_List* segments = static_cast<Segment_List*>(data);
+    for (int i = 0; i < info->dlpi_phnum && segments->count < Segment_List::CAPACITY; i++) {
+        const ElfW(Phdr)& segment = info->dlpi_phdr[i];
+        if (segment.p_type == PT_LOAD && (segment.p_flags & PF_W) != 0) {
+            char* begin = reinterpret_cast<char*>(info->dlpi_addr + segment.p_vaddr);
+            segments->ranges[segments->count][0] = begin;
+            segments->ranges[segments->count][1] = begin + segment.p_memsz;
+            segments->count++;
+        }
+    }
+    return 0;
+}
+
+}
+
+void Garbage_Collector::scan_conservative_roots()
+{
+    out << "Scanning stack, registers and static data for roots" << LBR;
+    log_info();
+
+    // Spill the callee-saved registers: __builtin_unwind_init() saves them in this frame's prologue,
+    // setjmp() into a buffer on this frame, so that the stack scan below sees them either way
+#if defined(__GNUC__)
+    __builtin_unwind_init();
+#endif
+    std::jmp_buf registers;
+    setjmp(registers);
+
+    // Everything from here up to the stack base belongs to this frame or its callers
+    GC_Thread* self = current_thread;
+    scan_range(&registers, self != nullptr ? self->stack_base : stack_base);
+
+    // The other registered threads are stopped, their frames and spilled registers lie above stack_pointer
+    for (std::size_t i = 0; i < MAX_THREADS; i++) {
+        if (threads[i].in_use && &threads[i] != self) {
+            scan_range(threads[i].stack_pointer, threads[i].stack_base);
+        }
+    }
+
+    // .data and .bss of the program and of every shared library
+    Segment_List segments;
+    segments.count = 0;
+    dl_iterate_phdr(collect_writable_segments, &segments);
+    for (std::size_t i = 0; i < segments.count; i++) {
+        scan_range(segments.ranges[i][0], segments.ranges[i][1]);
+    }
+
+    out << "Conservative scan found " << cycle.conservative_roots << " roots" << LBR;
+    log_info();
+}
+
+void Garbage_Collector::scan_range(void* begin, void* end)
+{
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    char* heap_begin = reinterpret_cast<char*>(heap_start);
+    char* heap_end = heap_begin + HEAP_CAPACITY;
+
+    // The collector's and the allocator's own fields point into the heap without keeping anything alive
+    char* own_state[2][2] = {
+        { reinterpret_cast<char*>(this), reinterpret_cast<char*>(this + 1) },
+        { reinterpret_cast<char*>(&alloc), reinterpret_cast<char*>(&alloc + 1) },
+    };
+
+    std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(begin) + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    for (char* word = reinterpret_cast<char*>(first); word + sizeof(void*) <= end; word += sizeof(void*)) {
+        if ((word >= own_state[0][0] && word < own_state[0][1]) || (word >= own_state[1][0] && word < own_state[1][1])) {
+            continue;
+        }
+
+        char* value = *reinterpret_cast<char**>(word);
+        if (value < heap_begin || value >= heap_end) {
+            continue;
+        }
+
+        // The word may not be a pointer, so compaction must neither rewrite it nor move its target
+        Chunk_Metadata* chunk = alloc.get_chunk(value);
+        if (chunk == nullptr || chunk->is_free) {
+            continue;
+        }
+        chunk->gc_fixed = true;
+        if (push_root(chunk)) {
+            cycle.conservative_roots++;
+        }
+    }
 }
 
 void Garbage_Collector::add_gc_roots(void** root)
 {
+    // Variables on the scanned stack are found by the conservative scan, no need to remember them
+    void* scanned_stack_base = current_thread != nullptr ? current_thread->stack_base : stack_base;
+    if (conservative_roots && reinterpret_cast<char*>(root) >= reinterpret_cast<char*>(__builtin_frame_address(0)) &&
+        reinterpret_cast<char*>(root) < reinterpret_cast<char*>(scanned_stack_base)) {
+        return;
+    }
+
     if (potential_roots_size >= MAX_ARRAY_CAP) {
-        gc_collect();
+        gc_collect(GC_TRIGGER_ROOT_LIST_FULL);
         if (potential_roots_size >= MAX_ARRAY_CAP) {
             out << "Reached Potential Nodes Limit" << LBR;
             log_info();
@@ -200,6 +1030,29 @@ void Garbage_Collector::gc_dump()
 
     out << "Root Chunk List Size = " << root_chunk_list_size << LBR;
     log_info();
+
+    const GC_Cycle_Record* last = telemetry.last();
+    if (last != nullptr) {
+        out << "--- Last cycle ----" << LBR
+            << "Cycle " << last->cycle << " (" << gc_trigger_name(last->trigger) << "): pause " << last->pause_ns << " ns"
+            << " [get_roots " << last->get_roots_ns << ", unmark " << last->unmark_ns
+            << ", scan " << last->scan_ns << ", mark " << last->mark_ns << ", sweep " << last->sweep_ns << "]" << LBR
+            << "Stopped " << last->threads_stopped << " threads, time to safepoint " << last->safepoint_ns << " ns" << LBR
+            << "Roots " << last->roots << " (+" << last->conservative_roots << " conservative), marked " << last->chunks_marked << " chunks (" << last->bytes_marked << " bytes)"
+            << ", freed " << last->chunks_freed << " chunks (" << last->bytes_swept << " bytes)"
+            << ", queued " << last->finalizers_queued << " for finalization" << LBR
+            << "Cleared " << last->weak_cleared << " weak and " << last->soft_cleared << " soft references" << LBR
+            << "Compacted: moved " << last->chunks_moved << " chunks (" << last->bytes_moved << " bytes), "
+            << last->chunks_fixed << " fixed, in " << last->compact_ns << " ns" << LBR
+            << "Lines marked " << last->lines_marked << ", blocks recycled " << last->blocks_recycled
+            << ", evacuated " << last->blocks_evacuated << " in " << last->evacuate_ns << " ns" << LBR;
+        log_info();
+
+        GC_Pause_Summary summary = telemetry.summary();
+        out << "Pauses over last " << summary.cycles << " cycles: p50 " << summary.p50_ns << " ns, p99 "
+            << summary.p99_ns << " ns, max " << summary.max_ns << " ns, max time to safepoint " << summary.max_safepoint_ns << " ns" << LBR;
+        log_info();
+    }
 }
 
 void Garbage_Collector::mark_phase()
@@ -207,23 +1060,47 @@ void Garbage_Collector::mark_phase()
     out << "Starting marking phase.." << LBR;
     log_info();
     // Use the root_chunk_list as stack
-    if (root_chunk_list_size == 0) {
+    if (root_chunk_list_size == 0 && !mark_overflow) {
         out << "Nothing to mark" << LBR;
         log_info();
         return;
     }
 
+    drain_root_list();
+
+    // A chunk dropped from the full root list is referenced by a marked chunk, so scanning the
+    // marked chunks again pushes it. Each pass marks at least one more chunk, so this terminates.
+    Allocator& alloc = Allocator::getInstance(DEBUG_MODE);
+    while (mark_overflow) {
+        out << "Root list overflowed. Rescanning marked chunks" << LBR;
+        log_info();
+        mark_overflow = false;
+        alloc.gc_rescan_marked();
+    }
+}
+
+void Garbage_Collector::drain_root_list()
+{
     while (root_chunk_list_size > 0) {
         root_chunk_list_size--;
         Chunk_Metadata* top = reinterpret_cast<Chunk_Metadata*>(root_chunk_list[root_chunk_list_size]);
 
+        // A chunk referenced from several places can be pushed more than once before it is popped.
+        // Scan it only the first time, otherwise shared chunks are rescanned over and over.
+        if (top->gc_mark) {
+            continue;
+        }
+
+        // Mark the chunk before scanning it, so that pointers back to it are not pushed again
+        top->gc_mark = true;
+        cycle.chunks_marked++;
+        cycle.bytes_marked += top->chunk_size;
+        lines.mark(top, reinterpret_cast<char*>(top->currentChunk()) + top->chunk_size);
+
         // Find pointers (chunk_ptrs) inside the current chunk and add them to the root list
         // This expands the stack with new potential chunks to be marked
         find_chunks_within_chunk(top);
         
-        // Mark the chunk
-        top->gc_mark = true;
-        
         out << "------------ CHUNK : " << top << " -> " << top->currentChunk() << " MARKED ------------";
         log_info();
 
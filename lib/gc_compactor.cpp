@@ -0,0 +1,99 @@
+#include "gc_compactor.h"
+
+#include <atomic>
+#include <sys/mman.h>
+
+#define INITIAL_TABLE_CAPACITY 1024
+
+const std::size_t GC_Compactor::MAX_LAYOUTS;
+
+namespace {
+
+// Index 0 means "scan conservatively", so the table starts at 1
+GC_Type_Layout layouts[GC_Compactor::MAX_LAYOUTS];
+std::atomic<std::uint32_t> layout_count{1};
+
+}
+
+std::uint32_t GC_Compactor::register_layout(const std::size_t* offsets, std::size_t count,
+                                           const std::size_t* compressed_offsets, std::size_t compressed_count)
+{
+    std::uint32_t index = layout_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_LAYOUTS) {
+        return 0;
+    }
+    layouts[index].offsets = offsets;
+    layouts[index].count = count;
+    layouts[index].compressed_offsets = compressed_offsets;
+    layouts[index].compressed_count = compressed_count;
+    return index;
+}
+
+const GC_Type_Layout* GC_Compactor::get_layout(std::uint32_t index)
+{
+    return index != 0 && index < MAX_LAYOUTS ? &layouts[index] : nullptr;
+}
+
+bool GC_Compactor::should_compact(std::size_t free_bytes, std::size_t largest_free_block) const
+{
+    if (!config.enabled || free_bytes == 0 || free_bytes < config.min_free_bytes) {
+        return false;
+    }
+    double fragmentation = 1.0 - static_cast<double>(largest_free_block) / static_cast<double>(free_bytes);
+    return fragmentation >= config.fragmentation_threshold;
+}
+
+bool GC_Compactor::add(void* from, void* to, std::size_t size)
+{
+    if (count == capacity && !grow()) {
+        return false;
+    }
+    moves[count].from = static_cast<char*>(from);
+    moves[count].to = static_cast<char*>(to);
+    moves[count].size = size;
+    count++;
+    bytes += size;
+    return true;
+}
+
+void* GC_Compactor::relocate(void* ptr) const
+{
+    char* address = static_cast<char*>(ptr);
+    if (count == 0 || address < moves[0].from) {
+        return ptr;
+    }
+
+    // Last move starting at or below the address
+    std::size_t low = 0;
+    std::size_t high = count;
+    while (high - low > 1) {
+        std::size_t middle = low + (high - low) / 2;
+        if (moves[middle].from <= address) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    const GC_Relocation& move = moves[low];
+    if (address >= move.from + move.size) {
+        return ptr;
+    }
+    return move.to + (address - move.from);
+}
+
+bool GC_Compactor::grow()
+{
+    // mmap, like the finalizer queue, so nothing is allocated from the heap being compacted
+    std::size_t new_capacity = capacity == 0 ? INITIAL_TABLE_CAPACITY : capacity * 2;
+    void* mapping = moves == nullptr
+        ? mmap(nullptr, new_capacity * sizeof(GC_Relocation), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        : mremap(moves, capacity * sizeof(GC_Relocation), new_capacity * sizeof(GC_Relocation), MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    moves = static_cast<GC_Relocation*>(mapping);
+    capacity = new_capacity;
+    return true;
+}
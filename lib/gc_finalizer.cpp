@@ -0,0 +1,200 @@
+#include "gc_finalizer.h"
+#include "allocator.h"
+#include "garbage_collector.h"
+
+#include <atomic>
+#include <cstring>
+#include <sys/mman.h>
+
+#define INITIAL_QUEUE_CAPACITY 1024
+
+const std::size_t GC_Finalizer::MAX_THUNKS;
+
+namespace {
+
+// Index 0 means "no finalizer", so the table starts at 1
+Finalizer_Thunk thunks[GC_Finalizer::MAX_THUNKS];
+std::atomic<std::uint32_t> thunk_count{1};
+
+thread_local bool finalizer_thread = false;
+
+}
+
+std::uint32_t GC_Finalizer::register_thunk(Finalizer_Thunk thunk)
+{
+    std::uint32_t index = thunk_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_THUNKS) {
+        return 0;
+    }
+    thunks[index] = thunk;
+    return index;
+}
+
+Finalizer_Thunk GC_Finalizer::get_thunk(std::uint32_t index)
+{
+    return index != 0 && index < MAX_THUNKS ? thunks[index] : nullptr;
+}
+
+bool GC_Finalizer::on_finalizer_thread()
+{
+    return finalizer_thread;
+}
+
+bool GC_Finalizer::start(Garbage_Collector& gc)
+{
+    if (running) {
+        return true;
+    }
+
+    this->gc = &gc;
+    started = false;
+    stopping = false;
+    if (pthread_create(&thread, nullptr, thread_main, this) != 0) {
+        return false;
+    }
+
+    // Once it is registered, every Allocator entry point takes the heap lock
+    pthread_mutex_lock(&mutex);
+    while (!started) {
+        pthread_cond_wait(&work, &mutex);
+    }
+    bool registered = running;
+    pthread_mutex_unlock(&mutex);
+
+    if (!registered) {
+        pthread_join(thread, nullptr);
+    }
+    return registered;
+}
+
+void GC_Finalizer::stop()
+{
+    if (!running) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&work);
+    pthread_mutex_unlock(&mutex);
+
+    // The thread still deallocates; a collection on this thread must not wait for the join
+    {
+        GC_Blocking_Scope blocked(*gc);
+        pthread_join(thread, nullptr);
+    }
+    running = false;
+}
+
+std::size_t GC_Finalizer::begin_batch()
+{
+    pthread_mutex_lock(&mutex);
+    if (head != 0) {
+        std::memmove(entries, entries + head, (ready - head) * sizeof(Finalizer_Entry));
+        ready -= head;
+        head = 0;
+    }
+    tail = ready;
+    pthread_mutex_unlock(&mutex);
+    return tail;
+}
+
+bool GC_Finalizer::push(void* object, Finalizer_Thunk thunk)
+{
+    pthread_mutex_lock(&mutex);
+    bool pushed = tail < capacity || grow();
+    if (pushed) {
+        entries[tail].object = object;
+        entries[tail].thunk = thunk;
+        tail++;
+    }
+    pthread_mutex_unlock(&mutex);
+    return pushed;
+}
+
+void GC_Finalizer::end_batch(std::size_t first, std::size_t keep)
+{
+    pthread_mutex_lock(&mutex);
+    ready = first + keep;
+    tail = ready;
+    if (keep != 0) {
+        pthread_cond_broadcast(&work);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+std::size_t GC_Finalizer::pending()
+{
+    pthread_mutex_lock(&mutex);
+    std::size_t count = ready - head;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+bool GC_Finalizer::grow()
+{
+    // mmap, like the root slot pools, so queueing never allocates from the heap being collected
+    std::size_t new_capacity = capacity == 0 ? INITIAL_QUEUE_CAPACITY : capacity * 2;
+    void* mapping = entries == nullptr
+        ? mmap(nullptr, new_capacity * sizeof(Finalizer_Entry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        : mremap(entries, capacity * sizeof(Finalizer_Entry), new_capacity * sizeof(Finalizer_Entry), MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    entries = static_cast<Finalizer_Entry*>(mapping);
+    capacity = new_capacity;
+    return true;
+}
+
+void* GC_Finalizer::thread_main(void* finalizer)
+{
+    GC_Finalizer& self = *static_cast<GC_Finalizer*>(finalizer);
+    Garbage_Collector& gc = *self.gc;
+    Allocator& alloc = Allocator::getInstance();
+    finalizer_thread = true;
+
+    bool registered = gc.register_thread();
+    pthread_mutex_lock(&self.mutex);
+    self.running = registered;
+    self.started = true;
+    pthread_cond_broadcast(&self.work);
+    pthread_mutex_unlock(&self.mutex);
+    if (!registered) {
+        return nullptr;
+    }
+
+    for (;;) {
+        Finalizer_Entry entry;
+        bool have_entry;
+        {
+            // Waiting for work must not hold up collections
+            GC_Blocking_Scope blocked(gc);
+            pthread_mutex_lock(&self.mutex);
+            while (self.head == self.ready && !self.stopping) {
+                pthread_cond_wait(&self.work, &self.mutex);
+            }
+            have_entry = self.head < self.ready;
+            if (have_entry) {
+                entry = self.entries[self.head];
+                self.head++;
+                self.in_progress = entry.object;
+            }
+            pthread_mutex_unlock(&self.mutex);
+        }
+        if (!have_entry) {
+            break;
+        }
+
+        // The object stays a root through in_progress until it is deallocated
+        entry.thunk(entry.object);
+        alloc.deallocate(entry.object);
+        alloc.stats.finalizers_run.add(1);
+
+        pthread_mutex_lock(&self.mutex);
+        self.in_progress = nullptr;
+        pthread_mutex_unlock(&self.mutex);
+    }
+
+    gc.unregister_thread();
+    return nullptr;
+}
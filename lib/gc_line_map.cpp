@@ -0,0 +1,102 @@
+#include "gc_line_map.h"
+
+#include <cstring>
+#include <sys/mman.h>
+
+const std::size_t GC_Line_Map::LINE_SIZE;
+const std::size_t GC_Line_Map::BLOCK_SIZE;
+const std::size_t GC_Line_Map::LINES_PER_BLOCK;
+
+bool GC_Line_Map::reset(void* heap_start, std::size_t heap_capacity)
+{
+    this->heap_start = static_cast<const char*>(heap_start);
+    std::size_t block_count = (heap_capacity + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (block_count > capacity && !grow(block_count)) {
+        blocks = 0;
+        lines_marked = 0;
+        return false;
+    }
+
+    blocks = block_count;
+    lines_marked = 0;
+    std::memset(line_marks, 0, blocks * LINES_PER_BLOCK);
+    std::memset(block_lines, 0, blocks * sizeof(std::uint16_t));
+    std::memset(candidates, 0, blocks);
+    return true;
+}
+
+void GC_Line_Map::mark(const void* begin, const void* end)
+{
+    std::size_t first = static_cast<std::size_t>(static_cast<const char*>(begin) - heap_start) / LINE_SIZE;
+    std::size_t last = (static_cast<std::size_t>(static_cast<const char*>(end) - heap_start) + LINE_SIZE - 1) / LINE_SIZE;
+    if (last > blocks * LINES_PER_BLOCK) {
+        last = blocks * LINES_PER_BLOCK;
+    }
+
+    for (std::size_t line = first; line < last; line++) {
+        if (line_marks[line] == 0) {
+            line_marks[line] = 1;
+            block_lines[line / LINES_PER_BLOCK]++;
+            lines_marked++;
+        }
+    }
+}
+
+std::size_t GC_Line_Map::select_candidates(double threshold, std::size_t max_blocks)
+{
+    std::size_t limit = static_cast<std::size_t>(threshold * LINES_PER_BLOCK);
+    std::size_t selected = 0;
+
+    // Few candidates are wanted, so pick the sparsest remaining block each time
+    while (selected < max_blocks) {
+        std::size_t best = blocks;
+        for (std::size_t block = 0; block < blocks; block++) {
+            if (candidates[block] == 0 && block_lines[block] != 0 && block_lines[block] <= limit &&
+                (best == blocks || block_lines[block] < block_lines[best])) {
+                best = block;
+            }
+        }
+        if (best == blocks) {
+            break;
+        }
+        candidates[best] = 1;
+        selected++;
+    }
+    return selected;
+}
+
+bool GC_Line_Map::overlaps_candidate(const void* begin, const void* end) const
+{
+    std::size_t first = block_of(begin);
+    std::size_t last = block_of(static_cast<const char*>(end) - 1);
+    for (std::size_t block = first; block <= last && block < blocks; block++) {
+        if (candidates[block] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GC_Line_Map::grow(std::size_t block_count)
+{
+    // mmap, like the relocation table, so marking never allocates from the heap being marked
+    std::size_t new_capacity = capacity == 0 ? block_count : capacity * 2;
+    if (new_capacity < block_count) {
+        new_capacity = block_count;
+    }
+    std::size_t bytes = new_capacity * (LINES_PER_BLOCK + sizeof(std::uint16_t) + 1);
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    // Marks do not outlive a cycle, nothing needs copying
+    if (line_marks != nullptr) {
+        munmap(line_marks, capacity * (LINES_PER_BLOCK + sizeof(std::uint16_t) + 1));
+    }
+    line_marks = static_cast<unsigned char*>(mapping);
+    block_lines = reinterpret_cast<std::uint16_t*>(line_marks + new_capacity * LINES_PER_BLOCK);
+    candidates = reinterpret_cast<unsigned char*>(block_lines + new_capacity);
+    capacity = new_capacity;
+    return true;
+}
@@ -0,0 +1,77 @@
+#include "gc_pacer.h"
+
+#include <algorithm>
+
+namespace {
+
+// Weight of the newest measurement in the smoothed rates
+const double RATE_SMOOTHING = 0.5;
+
+double smooth(double average, double sample) {
+    return average == 0.0 ? sample : average + RATE_SMOOTHING * (sample - average);
+}
+
+}
+
+const std::size_t GC_Pacer::MIN_RUNWAY;
+
+GC_Pacer::GC_Pacer()
+{
+    state = GC_Pacing_State();
+    set_goal(0, 0);
+}
+
+void GC_Pacer::set_config(const GC_Pacing_Config& config)
+{
+    this->config = config;
+    // Rebase the trigger on the allocations made since the last cycle
+    set_goal(state.live_bytes, allocated_at_last_cycle);
+}
+
+void GC_Pacer::on_cycle_end(const GC_Cycle_Record& cycle, std::uint64_t live_bytes, std::uint64_t bytes_allocated)
+{
+    if (cycle.mark_ns != 0 && cycle.bytes_marked != 0) {
+        state.mark_rate = smooth(state.mark_rate, static_cast<double>(cycle.bytes_marked) / static_cast<double>(cycle.mark_ns));
+    }
+
+    // The collector does not allocate, so everything since the last cycle was allocated by the program
+    if (last_cycle_end_ns != 0 && cycle.start_ns > last_cycle_end_ns) {
+        double mutator_ns = static_cast<double>(cycle.start_ns - last_cycle_end_ns);
+        state.allocation_rate = smooth(state.allocation_rate, static_cast<double>(bytes_allocated - allocated_at_last_cycle) / mutator_ns);
+        state.gc_cpu_fraction = static_cast<double>(cycle.pause_ns) / (mutator_ns + static_cast<double>(cycle.pause_ns));
+    }
+
+    last_cycle_end_ns = cycle.start_ns + cycle.pause_ns;
+    allocated_at_last_cycle = bytes_allocated;
+
+    set_goal(live_bytes, bytes_allocated);
+
+    // Predict the next pause from the mark rate, plus what the rest of the last cycle cost, and
+    // give the program enough runway that the pause stays within the CPU budget
+    if (config.max_gc_cpu_fraction > 0.0 && config.max_gc_cpu_fraction < 1.0 && state.mark_rate > 0.0 && state.allocation_rate > 0.0) {
+        double other_ns = static_cast<double>(cycle.pause_ns > cycle.mark_ns ? cycle.pause_ns - cycle.mark_ns : 0);
+        double predicted_pause_ns = static_cast<double>(live_bytes) / state.mark_rate + other_ns;
+        double fraction = config.max_gc_cpu_fraction;
+        double runway = state.allocation_rate * predicted_pause_ns * (1.0 - fraction) / fraction;
+        std::uint64_t cpu_goal = live_bytes + static_cast<std::uint64_t>(runway);
+        if (cpu_goal > state.heap_goal) {
+            state.heap_goal = config.max_heap_goal != 0 ? std::min<std::uint64_t>(cpu_goal, config.max_heap_goal) : cpu_goal;
+            state.runway_bytes = std::max<std::uint64_t>(state.heap_goal > live_bytes ? state.heap_goal - live_bytes : 0, MIN_RUNWAY);
+            state.trigger_at = bytes_allocated + state.runway_bytes;
+        }
+    }
+}
+
+void GC_Pacer::set_goal(std::uint64_t live_bytes, std::uint64_t bytes_allocated)
+{
+    std::uint64_t goal = live_bytes + live_bytes / 100 * config.gc_percent + live_bytes % 100 * config.gc_percent / 100;
+    goal = std::max<std::uint64_t>(goal, config.min_heap_goal);
+    if (config.max_heap_goal != 0) {
+        goal = std::min<std::uint64_t>(goal, config.max_heap_goal);
+    }
+
+    state.live_bytes = live_bytes;
+    state.heap_goal = goal;
+    state.runway_bytes = std::max<std::uint64_t>(goal > live_bytes ? goal - live_bytes : 0, MIN_RUNWAY);
+    state.trigger_at = bytes_allocated + state.runway_bytes;
+}
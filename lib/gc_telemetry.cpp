@@ -0,0 +1,71 @@
+#include "gc_telemetry.h"
+
+#include <algorithm>
+
+const char* gc_trigger_name(GC_Trigger trigger)
+{
+    switch (trigger) {
+    case GC_TRIGGER_EXPLICIT:
+        return "explicit";
+    case GC_TRIGGER_HEAP_FULL:
+        return "heap_full";
+    case GC_TRIGGER_ROOT_LIST_FULL:
+        return "root_list_full";
+    case GC_TRIGGER_PACER:
+        return "pacer";
+    case GC_TRIGGER_EMERGENCY:
+        return "emergency";
+    case GC_TRIGGER_LOW_MEMORY:
+        return "low_memory";
+    case GC_TRIGGER_COMPACT:
+        return "compact";
+    }
+    return "unknown";
+}
+
+void GC_Telemetry::record(const GC_Cycle_Record& cycle)
+{
+    records[next] = cycle;
+    next = (next + 1) % CAPACITY;
+    if (count < CAPACITY) {
+        count++;
+    }
+    cycles++;
+
+    if (callback != nullptr) {
+        callback(cycle, callback_context);
+    }
+}
+
+std::size_t GC_Telemetry::get_records(GC_Cycle_Record* out, std::size_t max_records) const
+{
+    std::size_t copied = std::min(max_records, count);
+    std::size_t first = (next + CAPACITY - copied) % CAPACITY;
+    for (std::size_t i = 0; i < copied; i++) {
+        out[i] = records[(first + i) % CAPACITY];
+    }
+    return copied;
+}
+
+GC_Pause_Summary GC_Telemetry::summary() const
+{
+    GC_Pause_Summary result = {};
+    if (count == 0) {
+        return result;
+    }
+
+    std::uint64_t pauses[CAPACITY];
+    for (std::size_t i = 0; i < count; i++) {
+        pauses[i] = records[i].pause_ns;
+        result.total_ns += pauses[i];
+        result.max_safepoint_ns = std::max(result.max_safepoint_ns, records[i].safepoint_ns);
+    }
+    std::sort(pauses, pauses + count);
+
+    // Nearest-rank percentiles
+    result.cycles = count;
+    result.p50_ns = pauses[(count * 50 + 99) / 100 - 1];
+    result.p99_ns = pauses[(count * 99 + 99) / 100 - 1];
+    result.max_ns = pauses[count - 1];
+    return result;
+}
@@ -0,0 +1,36 @@
+#include "heap_lock.h"
+
+#include <pthread.h>
+
+namespace {
+
+pthread_mutex_t heap_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+bool fork_handlers_installed = false;
+
+// The child's only thread does not own the parent's lock, so it gets a fresh one
+void reset_heap_lock() {
+    pthread_mutex_t fresh_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    heap_lock = fresh_lock;
+}
+
+}
+
+void lock_heap()
+{
+    pthread_mutex_lock(&heap_lock);
+}
+
+void unlock_heap()
+{
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void install_heap_lock_fork_handlers()
+{
+    Heap_Lock_Guard guard;
+    if (!fork_handlers_installed) {
+        fork_handlers_installed = true;
+        // Keep the heap consistent in the child if another thread is inside the allocator during fork()
+        pthread_atfork(lock_heap, unlock_heap, reset_heap_lock);
+    }
+}
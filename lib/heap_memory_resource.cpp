@@ -0,0 +1,32 @@
+#include "heap_memory_resource.h"
+#include "allocator.h"
+
+#include <new>
+
+
+Heap_Memory_Resource& Heap_Memory_Resource::getInstance()
+{
+    static Heap_Memory_Resource instance;
+    return instance;
+}
+
+void* Heap_Memory_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    Allocator& alloc = Allocator::getInstance();
+    void* ptr = alloc.allocate_pinned(bytes == 0 ? 1 : bytes, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void Heap_Memory_Resource::do_deallocate(void* ptr, std::size_t bytes, std::size_t /*alignment*/)
+{
+    Allocator& alloc = Allocator::getInstance();
+    alloc.deallocate(ptr, bytes);
+}
+
+bool Heap_Memory_Resource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return dynamic_cast<const Heap_Memory_Resource*>(&other) != nullptr;
+}
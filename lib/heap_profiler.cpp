@@ -0,0 +1,328 @@
+#include "heap_profiler.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LBR '\n'
+
+namespace {
+
+// Frames belonging to the profiler itself: Heap_Profiler::sample and Allocator::note_allocation
+const int SKIPPED_FRAMES = 2;
+
+/**
+ * @brief Buffers formatted output and writes it to a file descriptor without allocating.
+ */
+class Profile_Writer {
+public:
+    explicit Profile_Writer(int fd) : fd(fd) {}
+
+    void append(const char* data, std::size_t size) {
+        while (size > 0 && ok) {
+            if (length == sizeof(buffer)) {
+                flush();
+            }
+            std::size_t chunk = sizeof(buffer) - length;
+            if (chunk > size) {
+                chunk = size;
+            }
+            std::memcpy(buffer + length, data, chunk);
+            length += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    void append(const char* text) {
+        append(text, std::strlen(text));
+    }
+
+    template <typename... Args>
+    void format(const char* fmt, Args... args) {
+        char line[256];
+        int size = std::snprintf(line, sizeof(line), fmt, args...);
+        if (size > 0) {
+            append(line, static_cast<std::size_t>(size) < sizeof(line) ? static_cast<std::size_t>(size) : sizeof(line) - 1);
+        }
+    }
+
+    /**
+     * @brief Writes the buffered output. Returns false if any write so far has failed.
+     */
+    bool flush() {
+        const char* bytes = buffer;
+        while (length > 0 && ok) {
+            ssize_t written = ::write(fd, bytes, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ok = false;
+                break;
+            }
+            bytes += written;
+            length -= static_cast<std::size_t>(written);
+        }
+        length = 0;
+        return ok;
+    }
+
+private:
+    int fd;
+    char buffer[4096];
+    std::size_t length = 0;
+    bool ok = true;
+};
+
+/**
+ * @brief Appends a frame name: the symbol if the dynamic symbol table has one, otherwise module+offset.
+ */
+void append_frame_name(Profile_Writer& writer, void* frame) {
+    // Return addresses point after the call, step back into the calling instruction
+    void* address = reinterpret_cast<char*>(frame) - 1;
+    Dl_info info;
+    if (dladdr(address, &info) != 0 && info.dli_sname != nullptr) {
+        writer.append(info.dli_sname);
+    }
+    else if (info.dli_fname != nullptr && info.dli_fbase != nullptr) {
+        const char* module = std::strrchr(info.dli_fname, '/');
+        writer.format("%s+0x%lx", module != nullptr ? module + 1 : info.dli_fname,
+            static_cast<unsigned long>(reinterpret_cast<char*>(address) - reinterpret_cast<char*>(info.dli_fbase)));
+    }
+    else {
+        writer.format("0x%lx", static_cast<unsigned long>(reinterpret_cast<std::uintptr_t>(frame)));
+    }
+}
+
+}
+
+bool Heap_Profiler::start(std::size_t sample_interval)
+{
+    stop();
+
+    // The first backtrace() call loads the unwinder, which may allocate. Get that over with now.
+    void* warm_up[1];
+    backtrace(warm_up, 1);
+
+    void* mapping = mmap(nullptr, TABLE_SLOTS * sizeof(Sample), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Cannot map heap profile table" << LBR;
+        return false;
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    random_state = (static_cast<std::uint64_t>(now.tv_nsec) << 1) | 1;
+
+    table = static_cast<Sample*>(mapping);
+    live_samples = 0;
+    dropped = 0;
+    interval = sample_interval == 0 ? DEFAULT_SAMPLE_INTERVAL : sample_interval;
+    bytes_until_sample = next_gap();
+    return true;
+}
+
+void Heap_Profiler::stop()
+{
+    if (table == nullptr) {
+        return;
+    }
+    munmap(table, TABLE_SLOTS * sizeof(Sample));
+    table = nullptr;
+    live_samples = 0;
+}
+
+std::size_t Heap_Profiler::next_gap()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    // Uniform in (0, 1], so the logarithm is finite
+    double uniform = static_cast<double>((random_state >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double gap = -std::log(uniform) * static_cast<double>(interval);
+    return static_cast<std::size_t>(gap) + 1;
+}
+
+std::size_t Heap_Profiler::slot_of(const void* ptr)
+{
+    std::uint64_t key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr) >> 4);
+    return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (TABLE_SLOTS - 1);
+}
+
+void Heap_Profiler::sample(void* ptr, std::size_t size)
+{
+    bytes_until_sample = next_gap();
+
+    if (in_sample || ptr == nullptr) {
+        return;
+    }
+    if (live_samples >= MAX_SAMPLES) {
+        dropped++;
+        return;
+    }
+
+    void* frames[MAX_DEPTH + SKIPPED_FRAMES];
+    in_sample = true;
+    int depth = backtrace(frames, static_cast<int>(MAX_DEPTH + SKIPPED_FRAMES));
+    in_sample = false;
+
+    std::size_t slot = slot_of(ptr);
+    while (table[slot].ptr != nullptr && table[slot].ptr != ptr) {
+        slot = (slot + 1) & (TABLE_SLOTS - 1);
+    }
+    if (table[slot].ptr == nullptr) {
+        live_samples++;
+    }
+
+    Sample& entry = table[slot];
+    entry.ptr = ptr;
+    entry.size = size;
+    entry.depth = depth > SKIPPED_FRAMES ? static_cast<std::size_t>(depth - SKIPPED_FRAMES) : 0;
+    for (std::size_t i = 0; i < entry.depth; i++) {
+        entry.frames[i] = frames[i + SKIPPED_FRAMES];
+    }
+}
+
+void Heap_Profiler::forget(void* ptr)
+{
+    if (table == nullptr) {
+        return;
+    }
+
+    std::size_t slot = slot_of(ptr);
+    while (table[slot].ptr != ptr) {
+        if (table[slot].ptr == nullptr) {
+            return;
+        }
+        slot = (slot + 1) & (TABLE_SLOTS - 1);
+    }
+
+    // Backward-shift deletion: move later entries of the probe run into the hole so that no
+    // lookup ever stops early at it
+    std::size_t hole = slot;
+    std::size_t next = slot;
+    while (true) {
+        next = (next + 1) & (TABLE_SLOTS - 1);
+        if (table[next].ptr == nullptr) {
+            break;
+        }
+        std::size_t home = slot_of(table[next].ptr);
+        bool stays = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stays) {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole].ptr = nullptr;
+    live_samples--;
+}
+
+void Heap_Profiler::move(void* from, void* to)
+{
+    if (table == nullptr) {
+        return;
+    }
+
+    std::size_t slot = slot_of(from);
+    while (table[slot].ptr != from) {
+        if (table[slot].ptr == nullptr) {
+            return;
+        }
+        slot = (slot + 1) & (TABLE_SLOTS - 1);
+    }
+
+    // Forgetting leaves room for the copy, so the table cannot be full when it is reinserted
+    Sample sample = table[slot];
+    forget(from);
+    sample.ptr = to;
+    slot = slot_of(to);
+    while (table[slot].ptr != nullptr) {
+        slot = (slot + 1) & (TABLE_SLOTS - 1);
+    }
+    table[slot] = sample;
+    live_samples++;
+}
+
+bool Heap_Profiler::write(const char* path, Heap_Profile_Format format) const
+{
+    if (table == nullptr) {
+        return false;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open heap profile " << path << LBR;
+        return false;
+    }
+
+    Profile_Writer writer(fd);
+    if (format == HEAP_PROFILE_PPROF) {
+        std::size_t total_bytes = 0;
+        for (std::size_t i = 0; i < TABLE_SLOTS; i++) {
+            if (table[i].ptr != nullptr) {
+                total_bytes += table[i].size;
+            }
+        }
+
+        // Raw sampled counts; pprof scales them up using the sampling interval in the header
+        writer.format("heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", live_samples, total_bytes, live_samples, total_bytes, interval);
+        for (std::size_t i = 0; i < TABLE_SLOTS; i++) {
+            const Sample& entry = table[i];
+            if (entry.ptr == nullptr) {
+                continue;
+            }
+            writer.format("%d: %zu [%d: %zu] @", 1, entry.size, 1, entry.size);
+            for (std::size_t frame = 0; frame < entry.depth; frame++) {
+                writer.format(" 0x%lx", static_cast<unsigned long>(reinterpret_cast<std::uintptr_t>(entry.frames[frame])));
+            }
+            writer.append("\n");
+        }
+
+        // pprof symbolizes the addresses against the mappings
+        writer.append("\nMAPPED_LIBRARIES:\n");
+        int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        if (maps >= 0) {
+            char buffer[4096];
+            ssize_t bytes;
+            while ((bytes = read(maps, buffer, sizeof(buffer))) > 0) {
+                writer.append(buffer, static_cast<std::size_t>(bytes));
+            }
+            close(maps);
+        }
+    }
+    else {
+        for (std::size_t i = 0; i < TABLE_SLOTS; i++) {
+            const Sample& entry = table[i];
+            if (entry.ptr == nullptr) {
+                continue;
+            }
+            // Outermost frame first
+            for (std::size_t frame = entry.depth; frame > 0; frame--) {
+                append_frame_name(writer, entry.frames[frame - 1]);
+                writer.append(frame > 1 ? ";" : "");
+            }
+
+            // A sample of `size` bytes stands for size / P(sampled) bytes of allocations
+            double size = static_cast<double>(entry.size);
+            double estimate = size / (1.0 - std::exp(-size / static_cast<double>(interval)));
+            writer.format(" %llu\n", static_cast<unsigned long long>(estimate + 0.5));
+        }
+    }
+
+    bool ok = writer.flush();
+    close(fd);
+    if (!ok) {
+        std::cerr << "Error: Failed to write heap profile " << path << LBR;
+    }
+    return ok;
+}
@@ -0,0 +1,252 @@
+// Drop-in replacements for the C allocation functions, built as liballocator_preload.so.
+//
+// Usage: LD_PRELOAD=./liballocator_preload.so <program>
+//
+// Every call is serialised by one recursive mutex and routed into the Allocator singleton.
+// Memory is allocated as pinned chunks and automatic garbage collection is disabled, since
+// the collector cannot see the roots of an unmodified program. Nothing on these paths may
+// allocate through the system allocator: debug logging stays disabled and the singletons
+// live in static storage, so bootstrapping from the first malloc call is safe.
+//
+// Set ALLOCATOR_TRACE=<file> to record every allocation and free of the program to a trace
+// file for bench/trace_replay. The trace is flushed when the program exits normally.
+//
+// Set ALLOCATOR_HEAP_PROFILE=<file> to sample allocations with their call stacks and write the
+// ones still live at exit as a pprof heap profile. ALLOCATOR_HEAP_PROFILE_INTERVAL=<bytes>
+// changes the average distance between samples (default 512 KB).
+//
+// Set ALLOCATOR_HEAP_BACKING=thp or hugetlb to put the heap in a huge page backed reservation of
+// ALLOCATOR_HEAP_RESERVE=<bytes> (default 4 GB) instead of growing it with sbrk.
+
+#include "allocator.h"
+#include "heap_lock.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <unistd.h>
+
+#define EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace {
+
+bool preload_initialized = false;
+const char* heap_profile_path = nullptr;
+const std::size_t DEFAULT_HEAP_RESERVE = std::size_t(4) * 1024 * 1024 * 1024;
+
+typedef void* (*Realloc_Function)(void*, std::size_t);
+Realloc_Function next_realloc = nullptr;     ///< The realloc interposed on, resolved on first use.
+
+void stop_trace_at_exit() {
+    Heap_Lock_Guard guard;
+    Allocator::getInstance().stop_trace();
+}
+
+void write_heap_profile_at_exit() {
+    Heap_Lock_Guard guard;
+    Allocator& alloc = Allocator::getInstance();
+    alloc.write_heap_profile(heap_profile_path);
+    alloc.stop_heap_profile();
+}
+
+/**
+ * @brief Returns the allocator, configuring it for malloc use on first call. Heap lock must be held.
+ */
+Allocator& heap() {
+    Allocator& alloc = Allocator::getInstance();
+    if (!preload_initialized) {
+        preload_initialized = true;
+        alloc.GC_ENABLED = false;
+        install_heap_lock_fork_handlers();
+
+        // malloc reports failure with nullptr and ENOMEM; an exception must never reach C callers
+        Oom_Policy oom_policy = alloc.get_oom_policy();
+        oom_policy.mode = OOM_RETURN_NULL;
+        alloc.set_oom_policy(oom_policy);
+
+        const char* backing = std::getenv("ALLOCATOR_HEAP_BACKING");
+        if (backing != nullptr && *backing != '\0') {
+            const char* reserve = std::getenv("ALLOCATOR_HEAP_RESERVE");
+            std::size_t reserve_size = reserve != nullptr ? std::strtoull(reserve, nullptr, 10) : DEFAULT_HEAP_RESERVE;
+            if (std::strcmp(backing, "thp") == 0) {
+                alloc.set_heap_backing(HEAP_BACKING_THP, reserve_size);
+            }
+            else if (std::strcmp(backing, "hugetlb") == 0) {
+                alloc.set_heap_backing(HEAP_BACKING_HUGETLB, reserve_size);
+            }
+        }
+
+        const char* trace_path = std::getenv("ALLOCATOR_TRACE");
+        if (trace_path != nullptr && *trace_path != '\0' && alloc.start_trace(trace_path)) {
+            std::atexit(stop_trace_at_exit);
+        }
+
+        heap_profile_path = std::getenv("ALLOCATOR_HEAP_PROFILE");
+        if (heap_profile_path != nullptr && *heap_profile_path != '\0') {
+            const char* interval = std::getenv("ALLOCATOR_HEAP_PROFILE_INTERVAL");
+            std::size_t sample_interval = interval != nullptr ? std::strtoull(interval, nullptr, 10) : 0;
+            if (alloc.start_heap_profile(sample_interval)) {
+                std::atexit(write_heap_profile_at_exit);
+            }
+        }
+    }
+    return alloc;
+}
+
+void* allocate_locked(std::size_t size, std::size_t alignment) {
+    // C callers only check for nullptr, so a request the Allocator cannot serve must fail here
+    if (alignment > Allocator::MAX_ALLOCATION_SIZE || size > Allocator::MAX_ALLOCATION_SIZE - alignment) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    Allocator& alloc = heap();
+    void* ptr = alloc.allocate_pinned(size == 0 ? 1 : size, alignment);
+    if (ptr == nullptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void free_locked(void* ptr) {
+    Allocator& alloc = heap();
+    // Pointers handed out before interposition (e.g. by the dynamic loader) are not ours to free
+    if (ptr == nullptr || !alloc.contains(ptr)) {
+        return;
+    }
+    alloc.deallocate(ptr, alloc.usable_size(ptr));
+}
+
+bool is_power_of_two(std::size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+}
+
+EXPORT void* malloc(std::size_t size) {
+    Heap_Lock_Guard guard;
+    return allocate_locked(size, Allocator::ALIGNMENT);
+}
+
+EXPORT void free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    Heap_Lock_Guard guard;
+    free_locked(ptr);
+}
+
+EXPORT void* calloc(std::size_t count, std::size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    Heap_Lock_Guard guard;
+    void* ptr = allocate_locked(count * size, Allocator::ALIGNMENT);
+    if (ptr != nullptr) {
+        // Recycled chunks are not zeroed
+        std::memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+EXPORT void* realloc(void* ptr, std::size_t size) {
+    Heap_Lock_Guard guard;
+    if (ptr == nullptr) {
+        return allocate_locked(size, Allocator::ALIGNMENT);
+    }
+    if (size == 0) {
+        free_locked(ptr);
+        return nullptr;
+    }
+
+    Allocator& alloc = heap();
+    if (!alloc.contains(ptr)) {
+        // Handed out before interposition (see free_locked): only its own allocator knows its size
+        if (next_realloc == nullptr) {
+            next_realloc = reinterpret_cast<Realloc_Function>(dlsym(RTLD_NEXT, "realloc"));
+        }
+        if (next_realloc == nullptr) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        return next_realloc(ptr, size);
+    }
+
+    std::size_t old_size = alloc.usable_size(ptr);
+    if (size <= old_size) {
+        return ptr;
+    }
+
+    void* new_ptr = allocate_locked(size, Allocator::ALIGNMENT);
+    if (new_ptr == nullptr) {
+        return nullptr;
+    }
+    std::memcpy(new_ptr, ptr, old_size);
+    free_locked(ptr);
+    return new_ptr;
+}
+
+EXPORT void* reallocarray(void* ptr, std::size_t count, std::size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, count * size);
+}
+
+EXPORT int posix_memalign(void** memptr, std::size_t alignment, std::size_t size) {
+    if (!is_power_of_two(alignment) || alignment % sizeof(void*) != 0) {
+        return EINVAL;
+    }
+
+    Heap_Lock_Guard guard;
+    void* ptr = allocate_locked(size, alignment);
+    if (ptr == nullptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+EXPORT void* aligned_alloc(std::size_t alignment, std::size_t size) {
+    if (!is_power_of_two(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    Heap_Lock_Guard guard;
+    return allocate_locked(size, alignment);
+}
+
+EXPORT void* memalign(std::size_t alignment, std::size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+EXPORT void* valloc(std::size_t size) {
+    return aligned_alloc(static_cast<std::size_t>(sysconf(_SC_PAGESIZE)), size);
+}
+
+EXPORT void* pvalloc(std::size_t size) {
+    std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    // Rounding up would wrap to a zero byte request
+    if (size > SIZE_MAX - page_size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return aligned_alloc(page_size, (size + page_size - 1) & ~(page_size - 1));
+}
+
+EXPORT std::size_t malloc_usable_size(void* ptr) {
+    if (ptr == nullptr) {
+        return 0;
+    }
+
+    Heap_Lock_Guard guard;
+    Allocator& alloc = heap();
+    return alloc.contains(ptr) ? alloc.usable_size(ptr) : 0;
+}
@@ -0,0 +1,148 @@
+// Replacement global operator new/delete routed into the Allocator singleton.
+//
+// Linked into a program only when CMake is configured with -DALLOCATOR_OVERRIDE_NEW_DELETE=ON.
+// Objects are allocated as pinned chunks, so the garbage collector never reclaims them but
+// still scans them for references to collectable chunks. Sized (and aligned sized) delete
+// passes the size straight to Allocator::deallocate(ptr, size), which skips the validating BST
+// search and parks small chunks in their size-class quick list; other chunks still descend the
+// BST once to unlink their node.
+//
+// Allocations made while the allocator or its debug log is already running on the same thread
+// are served by malloc, and the matching deletes hand them back to free.
+
+#include "allocator.h"
+#include "debug_log.h"
+#include "heap_lock.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local bool inside_allocator = false;
+bool fork_handlers_installed = false;     ///< Set once the first override call has registered the heap lock's fork handlers.
+
+/**
+ * @brief Marks the current thread as running inside the allocator for the guard's lifetime.
+ */
+struct Reentrancy_Guard {
+    Reentrancy_Guard() { inside_allocator = true; }
+    ~Reentrancy_Guard() { inside_allocator = false; }
+};
+
+void* try_allocate(std::size_t size, std::size_t alignment) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    if (inside_allocator || Debug_Log::is_writing()) {
+        return alignment <= Allocator::ALIGNMENT ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+    }
+
+    Heap_Lock_Guard lock;
+    Reentrancy_Guard reentrancy;
+    // As in the preload library: a child forked while another thread is in here must not inherit the held lock
+    if (!fork_handlers_installed) {
+        fork_handlers_installed = true;
+        install_heap_lock_fork_handlers();
+    }
+    return Allocator::getInstance().allocate_pinned(size, alignment);
+}
+
+void* allocate_or_throw(std::size_t size, std::size_t alignment) {
+    // Standard new-handler loop: retry as long as a handler is installed
+    while (true) {
+        void* ptr = try_allocate(size, alignment);
+        if (ptr != nullptr) {
+            return ptr;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* allocate_nothrow(std::size_t size, std::size_t alignment) noexcept {
+    try {
+        return allocate_or_throw(size, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void release(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    // Checked before touching the singleton, which may still be under construction
+    if (inside_allocator || Debug_Log::is_writing()) {
+        std::free(ptr);
+        return;
+    }
+
+    Heap_Lock_Guard lock;
+    Allocator& alloc = Allocator::getInstance();
+    if (!alloc.contains(ptr)) {
+        std::free(ptr);
+        return;
+    }
+
+    Reentrancy_Guard reentrancy;
+    alloc.deallocate(ptr);
+}
+
+void release_sized(void* ptr, std::size_t size) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    // Checked before touching the singleton, which may still be under construction
+    if (inside_allocator || Debug_Log::is_writing()) {
+        std::free(ptr);
+        return;
+    }
+
+    Heap_Lock_Guard lock;
+    Allocator& alloc = Allocator::getInstance();
+    if (!alloc.contains(ptr)) {
+        std::free(ptr);
+        return;
+    }
+
+    Reentrancy_Guard reentrancy;
+    alloc.deallocate(ptr, size);
+}
+
+}
+
+void* operator new(std::size_t size) { return allocate_or_throw(size, Allocator::ALIGNMENT); }
+void* operator new[](std::size_t size) { return allocate_or_throw(size, Allocator::ALIGNMENT); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, Allocator::ALIGNMENT); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, Allocator::ALIGNMENT); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate_nothrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate_nothrow(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void* ptr) noexcept { release(ptr); }
+void operator delete[](void* ptr) noexcept { release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+
+void operator delete(void* ptr, std::size_t size) noexcept { release_sized(ptr, size); }
+void operator delete[](void* ptr, std::size_t size) noexcept { release_sized(ptr, size); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { release(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { release(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { release(ptr); }
+
+void operator delete(void* ptr, std::size_t size, std::align_val_t) noexcept { release_sized(ptr, size); }
+void operator delete[](void* ptr, std::size_t size, std::align_val_t) noexcept { release_sized(ptr, size); }
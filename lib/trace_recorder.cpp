@@ -0,0 +1,117 @@
+#include "trace_recorder.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+#define LBR '\n'
+
+namespace {
+
+std::uint64_t monotonic_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<std::uint64_t>(now.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(now.tv_nsec);
+}
+
+}
+
+bool Trace_Recorder::start(const char* path)
+{
+    stop();
+
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file < 0) {
+        std::cerr << "Error: Cannot open trace file " << path << LBR;
+        return false;
+    }
+
+    fd = file;
+    owner = getpid();
+    buffered = 0;
+    start_ns = monotonic_ns();
+
+    Trace_File_Header header;
+    std::memcpy(header.magic, "ATRC", sizeof(header.magic));
+    header.version = 1;
+    header.record_size = sizeof(Trace_Record);
+    header.reserved = 0;
+    write_all(&header, sizeof(header));
+
+    return is_active();
+}
+
+void Trace_Recorder::stop()
+{
+    if (fd < 0) {
+        return;
+    }
+
+    flush();
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void Trace_Recorder::abandon()
+{
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    buffered = 0;
+}
+
+void Trace_Recorder::append(Trace_Op op, std::size_t size, const void* ptr)
+{
+    Trace_Record& record = buffer[buffered];
+    record.timestamp_ns = monotonic_ns() - start_ns;
+    record.id = reinterpret_cast<std::uintptr_t>(ptr);
+    record.op_size = (static_cast<std::uint64_t>(op) << 56) | (static_cast<std::uint64_t>(size) & Trace_Record::SIZE_MASK);
+
+    buffered++;
+    if (buffered == BUFFER_RECORDS) {
+        flush();
+    }
+}
+
+void Trace_Recorder::write_all(const void* data, std::size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: Failed to write trace, recording stopped" << LBR;
+            close(fd);
+            fd = -1;
+            buffered = 0;
+            return;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+void Trace_Recorder::flush()
+{
+    if (buffered == 0) {
+        return;
+    }
+
+    // The records buffered in a forked child belong to the parent's trace, which the parent writes itself
+    if (getpid() != owner) {
+        abandon();
+        return;
+    }
+
+    std::size_t count = buffered;
+    buffered = 0;
+    write_all(buffer, count * sizeof(Trace_Record));
+}
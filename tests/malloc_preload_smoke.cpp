@@ -0,0 +1,97 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+
+// Smoke test for liballocator_preload.so: the C allocation functions must fail oversized requests
+// with nullptr (or an error code) and ENOMEM instead of handing out a chunk that overlaps others,
+// and ordinary requests made afterwards must still get distinct, usable memory.
+//
+// Usage: LD_PRELOAD=./liballocator_preload.so ./malloc_preload_smoke
+//
+// ctest runs it with the preload library. Without it, the same checks run against the system
+// allocator, which has to pass them too.
+
+static int failures = 0;
+
+/**
+ * @brief Reports a failed check.
+ */
+static void check(bool condition, const char* what) {
+	if (!condition) {
+		std::printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+/**
+ * @brief Checks that an entry point returned nullptr and set errno to ENOMEM.
+ */
+static void check_rejected(void* ptr, const char* what) {
+	check(ptr == nullptr && errno == ENOMEM, what);
+	if (ptr != nullptr) {
+		std::free(ptr);
+	}
+}
+
+int main() {
+	// volatile, so the compiler neither warns about nor folds the oversized calls
+	volatile std::size_t huge = SIZE_MAX;
+	volatile std::size_t near_huge = SIZE_MAX - 8;
+	volatile std::size_t past_max = static_cast<std::size_t>(PTRDIFF_MAX) + 1;
+
+	errno = 0;
+	check_rejected(std::malloc(huge), "malloc(SIZE_MAX)");
+	errno = 0;
+	check_rejected(std::malloc(near_huge), "malloc(SIZE_MAX - 8)");
+	errno = 0;
+	check_rejected(std::malloc(past_max), "malloc(PTRDIFF_MAX + 1)");
+	errno = 0;
+	check_rejected(std::calloc(2, huge / 2 + 1), "calloc overflow");
+	errno = 0;
+	check_rejected(std::realloc(nullptr, huge - 3), "realloc(NULL, SIZE_MAX - 3)");
+
+	void* small = std::malloc(32);
+	check(small != nullptr, "malloc(32)");
+	errno = 0;
+	void* grown = std::realloc(small, huge - 3);
+	check(grown == nullptr && errno == ENOMEM, "realloc(ptr, SIZE_MAX - 3)");
+	if (grown != nullptr) {
+		small = grown;
+	}
+
+	void* aligned = nullptr;
+	check(posix_memalign(&aligned, 64, huge - 10) == ENOMEM, "posix_memalign(64, SIZE_MAX - 10)");
+	check(posix_memalign(&aligned, 64, past_max) == ENOMEM, "posix_memalign(64, PTRDIFF_MAX + 1)");
+	errno = 0;
+	check_rejected(aligned_alloc(4096, huge - 4095), "aligned_alloc(4096, SIZE_MAX - 4095)");
+	errno = 0;
+	check_rejected(memalign(64, near_huge), "memalign(64, SIZE_MAX - 8)");
+	errno = 0;
+	check_rejected(valloc(near_huge), "valloc(SIZE_MAX - 8)");
+	errno = 0;
+	check_rejected(pvalloc(huge), "pvalloc(SIZE_MAX)");
+
+	// Later allocations must not overlap each other or the chunk still held
+	char* first = static_cast<char*>(std::malloc(64));
+	char* second = static_cast<char*>(std::malloc(64));
+	check(first != nullptr && second != nullptr, "malloc(64) after the oversized requests");
+	if (first != nullptr && second != nullptr) {
+		std::memset(first, 0x11, 64);
+		std::memset(second, 0x22, 64);
+		check(first + 64 <= second || second + 64 <= first, "later chunks are disjoint");
+		check(first[63] == 0x11 && second[0] == 0x22, "later chunks keep their contents");
+	}
+	check(posix_memalign(&aligned, 64, 100) == 0 && reinterpret_cast<std::uintptr_t>(aligned) % 64 == 0, "posix_memalign(64, 100)");
+
+	std::free(aligned);
+	std::free(first);
+	std::free(second);
+	std::free(small);
+
+	std::printf("%s\n", failures == 0 ? "All checks passed" : "Some checks failed");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}